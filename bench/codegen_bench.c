@@ -0,0 +1,63 @@
+// Code generation benchmark: parses a large synthetic program in memory and
+// times generate_mips_code on it, output file included.
+// usage: codegen_bench [megabytes]
+#include <unistd.h>
+#include "lexer.h"
+#include "parser.h"
+#include "code_gen.h"
+#include "timer.h"
+
+int main(int argc, char** argv){
+    size_t target = (argc > 1 ? (size_t) atol(argv[1]) : 8) << 20;
+    size_t capacity = target + 4096;
+    char* src = (char*) malloc(capacity);
+
+    size_t size = snprintf(src, capacity, "main () {\n");
+    for (int n = 0; size + 1024 < target; ++n) {
+        size += snprintf(src + size, capacity - size,
+            "    int counter_%d = %d\n"
+            "    string label_%d = \"label %d\"\n"
+            "    while (counter_%d <= 1000 and counter_%d != 17 or false) {\n"
+            "        += counter_%d 1;\n"
+            "        %% counter_%d counter_%d 3;\n"
+            "        if (counter_%d == 0) {\n"
+            "            print(label_%d \" ==> \" counter_%d \"\\n\")\n"
+            "        }\n"
+            "    }\n",
+            n, n, n, n, n, n, n, n, n, n, n, n);
+    }
+    size += snprintf(src + size, capacity - size, "    return 0\n}\n");
+
+    Program prog = {0};
+    prog.source.data = src;
+    prog.source.size = size;
+    lex_buffer(&prog);
+
+    AST ast;
+    build_ast(&prog, &ast);
+
+    char output[] = "/tmp/codegen_bench_XXXXXX";
+    int fd = mkstemp(output);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    double start = now_seconds();
+    generate_mips_code(&ast, output, NULL);
+    double elapsed = now_seconds() - start;
+
+    FILE* fp = fopen(output, "r");
+    fseek(fp, 0, SEEK_END);
+    long bytes = ftell(fp);
+    fclose(fp);
+    unlink(output);
+
+    printf("generate_mips_code: %d nodes -> %.1f MB of assembly in %.3f s (%.1f MB/s)\n",
+           ast.count, bytes / 1e6, elapsed, bytes / 1e6 / elapsed);
+
+    free_ast(&ast);
+    free_program(&prog);
+    return EXIT_SUCCESS;
+}
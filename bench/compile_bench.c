@@ -0,0 +1,71 @@
+// In-process compile benchmark: compiles a small program many times through
+// compile(), with every tenth one broken so the error path is timed too, and
+// checks that nothing allocated along the way is left behind.
+// usage: compile_bench [programs]
+#include <string.h>
+#include "compiler.h"
+#include "counted_alloc.h"
+#include "timer.h"
+
+static const char program[] =
+    "main () {\n"
+    "    int n = 15\n"
+    "    string sep = \", \"\n"
+    "    for (int i = 1; i <= n; += i 1) {\n"
+    "        if (i % 15 == 0) {\n"
+    "            print(\"FizzBuzz\" sep)\n"
+    "        }\n"
+    "        if (i % 3 == 0 and i % 5 != 0) {\n"
+    "            print(\"Fizz\" sep)\n"
+    "        }\n"
+    "        if (i % 5 == 0 and i % 3 != 0) {\n"
+    "            print(\"Buzz\" sep)\n"
+    "        }\n"
+    "        if (i % 3 != 0 and i % 5 != 0) {\n"
+    "            print(i sep)\n"
+    "        }\n"
+    "    }\n"
+    "    print(\"\\n\")\n"
+    "    return 0\n"
+    "}\n";
+
+// fails in code generation, after the lexer, parser and folding allocated
+static const char broken[] =
+    "main () {\n"
+    "    int n = 15\n"
+    "    while (n > 0) {\n"
+    "        -= n 1;\n"
+    "        print(n missing \"\\n\")\n"
+    "    }\n"
+    "    return 0\n"
+    "}\n";
+
+int main(int argc, char** argv){
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    CodegenOptions options = {1, 0, 1, 1, 0};
+
+    AllocStats before, after;
+    counted_stats(&before);
+    int failures = 0;
+    size_t bytes = 0;
+    double start = now_seconds();
+    for (int i = 0; i < count; ++i) {
+        const char* src = i % 10 == 9 ? broken : program;
+        CompileOutput output;
+        Diagnostics diagnostics;
+        if (compile(src, strlen(src), &options, &output, &diagnostics) == 0) {
+            bytes += output.length;
+            free_compile_output(&output);
+        } else {
+            ++failures;
+            free_diagnostics(&diagnostics);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    counted_stats(&after);
+
+    printf("compile: %d programs (%d failed) in %.3f s -> %.0f programs/s, %.1f us each, %.1f MB of assembly, %zu bytes left allocated\n",
+           count, failures, elapsed, count / elapsed, elapsed / count * 1e6, bytes / 1e6,
+           after.live_bytes - before.live_bytes);
+    return after.live_bytes == before.live_bytes ? EXIT_SUCCESS : EXIT_FAILURE;
+}
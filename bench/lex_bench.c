@@ -0,0 +1,53 @@
+// Lexer throughput benchmark: writes a large synthetic .code file and times lex_file on it.
+// usage: lex_bench [megabytes]
+#include <unistd.h>
+#include "lexer.h"
+#include "timer.h"
+
+int main(int argc, char** argv){
+    size_t target = (argc > 1 ? (size_t) atol(argv[1]) : 32) << 20;
+
+    char path[] = "/tmp/lex_bench_XXXXXX";
+    int fd = mkstemp(path);
+    FILE* fp = fd >= 0 ? fdopen(fd, "w+") : NULL;
+    if (!fp) {
+        fprintf(stderr, "Error: could not create temporary file\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t written = 0;
+    int n = 0;
+    written += fprintf(fp, "main () {\n");
+    while (written < target) {
+        written += fprintf(fp,
+            "# variable block %d\n"
+            "    int counter_%d = %d\n"
+            "    string label_%d = \"a somewhat longer string literal number %d\"\n"
+            "    while (counter_%d <= 1000 and counter_%d != 17) {\n"
+            "        += counter_%d 1;\n"
+            "        %% counter_%d counter_%d 3;\n"
+            "        print(label_%d \" ==> \" counter_%d \"\\n\")\n"
+            "    }\n",
+            n, n, n, n, n, n, n, n, n, n, n, n);
+        ++n;
+    }
+    written += fprintf(fp, "    return 0\n}\n");
+    fflush(fp);
+    rewind(fp);
+
+    Program prog;
+
+    double start = now_seconds();
+    lex_file(fp, &prog);
+    double elapsed = now_seconds() - start;
+    int token_count = prog.token_count;
+
+    printf("lex_file: %.1f MB, %d tokens (%d distinct strings) in %.3f s -> %.1f MB/s, %.1f Mtokens/s\n",
+           written / 1048576.0, token_count, prog.strings.count, elapsed,
+           written / 1048576.0 / elapsed, token_count / 1e6 / elapsed);
+
+    free_program(&prog);
+    fclose(fp);
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+// Counted loop benchmark: compiles the counting while loop from
+// tests/loops-and-arithmetic.code and the same loop written as a for at -O1,
+// then a loop over i * 12 both ways, and compares the cycles one iteration
+// of each costs, estimated from the emitted assembly with R3000 latencies
+// (mult 12 cycles, everything else 1 per machine instruction after pseudo
+// instruction expansion, syscalls included).
+#include <unistd.h>
+#include "lexer.h"
+#include "parser.h"
+#include "code_gen.h"
+
+static const char* sources[][2] = {
+    {
+        "main () {\n"
+        "    int i = 0\n"
+        "    int n = 15\n"
+        "    while (i <= n){\n"
+        "        print(i \"\\n\")\n"
+        "        += i 1;\n"
+        "    }\n"
+        "    return 0\n"
+        "}\n",
+        "main () {\n"
+        "    int n = 15\n"
+        "    for (int i = 0; i <= n; += i 1) {\n"
+        "        print(i \"\\n\")\n"
+        "    }\n"
+        "    return 0\n"
+        "}\n",
+    },
+    {
+        "main () {\n"
+        "    int i = 0\n"
+        "    int sum = 0\n"
+        "    while (i < 1000) {\n"
+        "        += sum (i * 12);\n"
+        "        += i 1;\n"
+        "    }\n"
+        "    print(sum)\n"
+        "    return 0\n"
+        "}\n",
+        "main () {\n"
+        "    int sum = 0\n"
+        "    for (int i = 0; i < 1000; += i 1) {\n"
+        "        += sum (i * 12);\n"
+        "    }\n"
+        "    print(sum)\n"
+        "    return 0\n"
+        "}\n",
+    },
+};
+
+static const char* names[] = {"count to n", "sum of i * 12"};
+
+static int cycles_of(const char* mnemonic, const char* operands) {
+    if (strcmp(mnemonic, "mult") == 0) return 12;
+    if (strcmp(mnemonic, "mul") == 0) return 13; // mult + mflo
+    if (strcmp(mnemonic, "la") == 0) return 2;   // lui + ori
+    if (strcmp(mnemonic, "li") == 0) {
+        long value = atol(operands + strcspn(operands, ",") + 1);
+        return value >= -32768 && value <= 65535 ? 1 : 2;
+    }
+    if (strcmp(mnemonic, "blt") == 0 || strcmp(mnemonic, "ble") == 0 ||
+        strcmp(mnemonic, "bgt") == 0 || strcmp(mnemonic, "bge") == 0) return 2; // slt + branch
+    return 1;
+}
+
+// cycles of the instructions between the first loop's head label and the
+// branch back to it
+static int loop_body_cycles(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    char line[256];
+    char head[64] = "";
+    int cycles = 0, in_loop = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        size_t length = strlen(line);
+        if (line[length - 1] == ':') {
+            if (!in_loop && strcmp(line, "main:") != 0) {
+                snprintf(head, sizeof(head), "%.*s", (int) length - 1, line);
+                in_loop = 1;
+            }
+            continue;
+        }
+        if (!in_loop) continue;
+        char mnemonic[16];
+        int consumed;
+        if (sscanf(line, "%15s %n", mnemonic, &consumed) != 1) continue;
+        cycles += cycles_of(mnemonic, line + consumed);
+        const char* target = strrchr(line, ' ') + 1;
+        if ((mnemonic[0] == 'b' || strcmp(mnemonic, "j") == 0) && strcmp(target, head) == 0) {
+            fclose(fp);
+            return cycles;
+        }
+    }
+    fclose(fp);
+    fprintf(stderr, "loop_bench: no loop found in %s\n", path);
+    exit(EXIT_FAILURE);
+}
+
+static int compile(const char* source) {
+    Program prog = {0};
+    prog.source.data = strdup(source);
+    prog.source.size = strlen(source);
+    lex_buffer(&prog);
+    AST ast;
+    build_ast(&prog, &ast);
+
+    char output[] = "/tmp/loop_bench_XXXXXX";
+    int fd = mkstemp(output);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    CodegenOptions options = {1, 0, 1, 1, 0};
+    generate_mips_code(&ast, output, &options);
+    int cycles = loop_body_cycles(output);
+    unlink(output);
+    free_ast(&ast);
+    free_program(&prog);
+    return cycles;
+}
+
+int main(void){
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); ++i) {
+        int while_cycles = compile(sources[i][0]);
+        int for_cycles = compile(sources[i][1]);
+        printf("counted loop, %s: while %d -> for %d cycles per iteration\n", names[i], while_cycles, for_cycles);
+    }
+    return EXIT_SUCCESS;
+}
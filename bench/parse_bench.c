@@ -0,0 +1,53 @@
+// Parser throughput benchmark: lexes a large synthetic program in memory and
+// times build_ast on its tokens.
+// usage: parse_bench [megabytes]
+//
+// The table-scanning parser that the recursive-descent one replaced is timed
+// by building this same file against the commit before it, whose build_ast
+// takes the same arguments:
+//   git worktree add /tmp/old <parser commit>^
+//   cp bench/parse_bench.c /tmp/old/bench/ && cp src/timer.[ch] /tmp/old/src/
+//   make -C /tmp/old BUILD_DIR=/tmp/old/build /tmp/old/build/parse_bench
+//   /tmp/old/build/parse_bench
+#include "lexer.h"
+#include "parser.h"
+#include "timer.h"
+
+int main(int argc, char** argv){
+    size_t target = (argc > 1 ? (size_t) atol(argv[1]) : 16) << 20;
+    size_t capacity = target + 4096;
+    char* src = (char*) malloc(capacity);
+
+    size_t size = snprintf(src, capacity, "main () {\n");
+    for (int n = 0; size + 1024 < target; ++n) {
+        size += snprintf(src + size, capacity - size,
+            "    int counter_%d = %d\n"
+            "    string label_%d = \"label %d\"\n"
+            "    while (counter_%d <= 1000 and counter_%d != 17 or false) {\n"
+            "        += counter_%d 1;\n"
+            "        %% counter_%d counter_%d 3;\n"
+            "        if (counter_%d == 0) {\n"
+            "            print(label_%d \" ==> \" counter_%d \"\\n\")\n"
+            "        }\n"
+            "    }\n",
+            n, n, n, n, n, n, n, n, n, n, n, n);
+    }
+    size += snprintf(src + size, capacity - size, "    return 0\n}\n");
+
+    Program prog = {0};
+    prog.source.data = src;
+    prog.source.size = size;
+    lex_buffer(&prog);
+
+    AST ast;
+    double start = now_seconds();
+    build_ast(&prog, &ast);
+    double elapsed = now_seconds() - start;
+
+    printf("build_ast: %d tokens, %d nodes in %.3f s -> %.1f Mtokens/s\n",
+           prog.token_count, ast.count, elapsed, prog.token_count / 1e6 / elapsed);
+
+    free_ast(&ast);
+    free_program(&prog);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+// Whole pipeline benchmark: generates synthetic programs from 1 KB up to a
+// maximum size and times each phase on them separately, lex_file, build_ast,
+// generate_mips_buffer and write_buffer_to_file, at -O0 and -O1. The
+// programs declare many variables and nest if and while six deep under long
+// and/or chains, with prints in every block.
+// Small sizes are repeated until a few megabytes went through and the mean
+// is reported. One CSV row per size and level, or a JSON array with --json.
+// usage: pipeline_bench [max megabytes] [--json]
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lexer.h"
+#include "parser.h"
+#include "code_gen.h"
+#include "timer.h"
+
+#define BLOCK_VARIABLES 8
+#define NESTING 6
+#define REPEAT_BYTES ((size_t) 4 << 20)
+
+typedef struct {
+    size_t source_bytes;
+    int tokens;
+    int nodes;
+    double lex, parse, codegen, write;
+    long asm_bytes;
+} Sample;
+
+// "v<block>_<i> <op> <constant>" terms joined alternately by and/or
+static int put_chain(FILE* fp, int block, int first, int terms){
+    static const char* ops[] = {"<", "!=", ">=", "==", "<=", ">"};
+    int written = 0;
+    for (int t = 0; t < terms; ++t) {
+        if (t) written += fprintf(fp, t % 2 ? " and " : " or ");
+        written += fprintf(fp, "v%d_%d %s %d", block, (first + t) % BLOCK_VARIABLES, ops[t % 6], t * 7 % 50);
+    }
+    return written;
+}
+
+// one block: fresh variables, a few prints, then if and while alternating
+// NESTING deep with the innermost print at the bottom
+static size_t put_block(FILE* fp, int block){
+    size_t written = 0;
+    // seeded from a value the loop at the top leaves behind, so that -O1
+    // cannot fold the blocks away
+    for (int i = 0; i < BLOCK_VARIABLES; ++i) {
+        written += fprintf(fp, "    int v%d_%d = 0\n    + v%d_%d seed %d;\n", block, i, block, i, (block + i) % 13);
+    }
+    written += fprintf(fp, "    string s%d = \"block %d\"\n", block, block);
+    written += fprintf(fp, "    print(s%d \" starts\\n\")\n", block);
+    written += fprintf(fp, "    print(\"v0 = \" v%d_0 \", v1 = \" v%d_1 \"\\n\")\n", block, block);
+
+    for (int depth = 0; depth < NESTING; ++depth) {
+        int indent = 4 * (depth + 1);
+        int counter = depth % BLOCK_VARIABLES;
+        if (depth % 2 == 0) {
+            written += fprintf(fp, "%*sif (", indent, "");
+            written += put_chain(fp, block, depth, 6);
+            written += fprintf(fp, ") {\n");
+        } else {
+            // the counter test is and-ed with the chain, so the loop always ends
+            written += fprintf(fp, "%*swhile (v%d_%d < %d and (", indent, "", block, counter, depth + 2);
+            written += put_chain(fp, block, depth + 1, 4);
+            written += fprintf(fp, ")) {\n%*s+= v%d_%d 1;\n", indent + 4, "", block, counter);
+        }
+        written += fprintf(fp, "%*s* v%d_%d v%d_%d 3;\n", indent + 4, "",
+                           block, (depth + 3) % BLOCK_VARIABLES, block, (depth + 5) % BLOCK_VARIABLES);
+    }
+    written += fprintf(fp, "%*sprint(s%d \" at depth %d: \" v%d_7 \"\\n\")\n",
+                       4 * (NESTING + 1), "", block, NESTING, block);
+    for (int depth = NESTING - 1; depth >= 0; --depth) {
+        written += fprintf(fp, "%*s}\n", 4 * (depth + 1), "");
+    }
+    written += fprintf(fp, "    print(s%d \" ends\\n\")\n", block);
+    return written;
+}
+
+static size_t write_program(FILE* fp, size_t target){
+    size_t written = fprintf(fp, "main () {\n    int seed = 0\n    while (seed < 3) {\n        += seed 1;\n    }\n");
+    for (int block = 0; written < target; ++block) written += put_block(fp, block);
+    written += fprintf(fp, "    return 0\n}\n");
+    fflush(fp);
+    return written;
+}
+
+// runs the pipeline once over fp, adding the phase times to sample
+static void run_once(FILE* fp, const char* output, int opt_level, Sample* sample){
+    CodegenOptions options = {opt_level, 0, 1, 1, 0};
+    Program prog;
+    AST ast;
+    CodeBuffer buffer;
+
+    rewind(fp);
+    double start = now_seconds();
+    lex_file(fp, &prog);
+    double lexed = now_seconds();
+    build_ast(&prog, &ast);
+    double parsed = now_seconds();
+    generate_mips_buffer(&ast, &buffer, &options);
+    double generated = now_seconds();
+    write_buffer_to_file(&buffer, output);
+    double written = now_seconds();
+
+    sample->lex += lexed - start;
+    sample->parse += parsed - lexed;
+    sample->codegen += generated - parsed;
+    sample->write += written - generated;
+    sample->tokens = prog.token_count;
+    sample->nodes = ast.count;
+
+    free_buffer(&buffer);
+    free_ast(&ast);
+    free_program(&prog);
+}
+
+int main(int argc, char** argv){
+    size_t max_megabytes = 10;
+    int json = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) json = 1;
+        else max_megabytes = (size_t) atol(argv[i]);
+    }
+
+    char source[] = "/tmp/pipeline_bench_XXXXXX";
+    char output[] = "/tmp/pipeline_bench_asm_XXXXXX";
+    int source_fd = mkstemp(source);
+    int output_fd = mkstemp(output);
+    FILE* fp = source_fd >= 0 ? fdopen(source_fd, "w+") : NULL;
+    if (!fp || output_fd < 0) {
+        fprintf(stderr, "Error: could not create temporary files\n");
+        return EXIT_FAILURE;
+    }
+    close(output_fd);
+
+    if (json) printf("[\n");
+    else printf("opt_level,source_bytes,tokens,nodes,lex_s,parse_s,codegen_s,write_s,asm_bytes,mb_per_s\n");
+
+    int first = 1;
+    for (size_t target = 1024; target <= max_megabytes << 20; target *= 10) {
+        if (ftruncate(fileno(fp), 0) != 0) {
+            perror("ftruncate");
+            return EXIT_FAILURE;
+        }
+        rewind(fp);
+        size_t bytes = write_program(fp, target);
+        int repeats = bytes < REPEAT_BYTES ? (int) (REPEAT_BYTES / bytes) : 1;
+
+        for (int opt_level = 0; opt_level <= 1; ++opt_level) {
+            Sample sample = {0};
+            sample.source_bytes = bytes;
+            for (int r = 0; r < repeats; ++r) run_once(fp, output, opt_level, &sample);
+            sample.lex /= repeats;
+            sample.parse /= repeats;
+            sample.codegen /= repeats;
+            sample.write /= repeats;
+
+            struct stat st;
+            sample.asm_bytes = stat(output, &st) == 0 ? (long) st.st_size : -1;
+            double total = sample.lex + sample.parse + sample.codegen + sample.write;
+            double rate = bytes / 1e6 / total;
+
+            if (json) {
+                printf("%s  {\"opt_level\": %d, \"source_bytes\": %zu, \"tokens\": %d, \"nodes\": %d, "
+                       "\"lex_s\": %.6f, \"parse_s\": %.6f, \"codegen_s\": %.6f, \"write_s\": %.6f, "
+                       "\"asm_bytes\": %ld, \"mb_per_s\": %.1f}",
+                       first ? "" : ",\n", opt_level, sample.source_bytes, sample.tokens, sample.nodes,
+                       sample.lex, sample.parse, sample.codegen, sample.write, sample.asm_bytes, rate);
+            } else {
+                printf("%d,%zu,%d,%d,%.6f,%.6f,%.6f,%.6f,%ld,%.1f\n",
+                       opt_level, sample.source_bytes, sample.tokens, sample.nodes,
+                       sample.lex, sample.parse, sample.codegen, sample.write, sample.asm_bytes, rate);
+            }
+            first = 0;
+        }
+    }
+    if (json) printf("\n]\n");
+
+    fclose(fp);
+    unlink(source);
+    unlink(output);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+// Microbenchmark for the lexer's scan kernels: each kernel walks a buffer made
+// of runs separated by a single stop byte, once with short runs (typical
+// indentation / identifiers) and once with long runs (comments, long strings).
+// usage: scan_bench [megabytes]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+#include "timer.h"
+
+enum { K_WHITESPACE, K_EOL, K_QUOTE, K_IDENT, K_DIGIT, K_COUNT };
+static const char* kernel_names[K_COUNT] = {"whitespace", "comment", "string", "identifier", "digits"};
+
+// fill buf with runs of [min_run, max_run] bytes from alphabet, each followed by stop
+static void fill(char* buf, size_t size, const char* alphabet, char stop, int min_run, int max_run){
+    size_t i = 0;
+    unsigned int seed = 12345;
+    int alphabet_len = strlen(alphabet);
+    while (i < size) {
+        seed = seed * 1103515245u + 12345u;
+        int run = min_run + (seed >> 16) % (max_run - min_run + 1);
+        for (int j = 0; j < run && i < size; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            buf[i++] = alphabet[(seed >> 16) % alphabet_len];
+        }
+        if (i < size) buf[i++] = stop;
+    }
+}
+
+static long walk(const ScanKernels* k, int kind, const char* p, const char* end){
+    int line = 0;
+    long runs = 0;
+    while (p < end) {
+        switch (kind) {
+            case K_WHITESPACE: p = k->skip_whitespace(p, end, &line); break;
+            case K_EOL: p = k->find_eol(p, end); break;
+            case K_QUOTE: p = k->find_quote(p, end, &line); break;
+            case K_IDENT: p = k->ident_run(p, end); break;
+            case K_DIGIT: p = k->digit_run(p, end); break;
+        }
+        ++p; // the stop byte
+        ++runs;
+    }
+    return runs * 1000003L + line;
+}
+
+int main(int argc, char** argv){
+    size_t size = (argc > 1 ? (size_t) atol(argv[1]) : 16) << 20;
+    char* buf = (char*) malloc(size);
+    const char* variants[] = {"scalar", "sse2", "avx2"};
+    int run_lengths[][2] = {{2, 12}, {48, 160}};
+
+    printf("%-10s %-6s %-7s %10s %8s\n", "kernel", "runs", "variant", "MB/s", "speedup");
+    for (int kind = 0; kind < K_COUNT; ++kind) {
+        for (int r = 0; r < 2; ++r) {
+            int lo = run_lengths[r][0], hi = run_lengths[r][1];
+            switch (kind) {
+                case K_WHITESPACE: fill(buf, size, "    \n\t ", 'x', lo, hi); break;
+                case K_EOL: fill(buf, size, "abc def ghi # () \"", '\n', lo, hi); break;
+                case K_QUOTE: fill(buf, size, "some text\nmore text ==> %", '"', lo, hi); break;
+                case K_IDENT: fill(buf, size, "abcdefghijklmnopqrstuvwxyzABCXYZ_0123456789", ' ', lo, hi); break;
+                case K_DIGIT: fill(buf, size, "0123456789", ';', lo, hi); break;
+            }
+            double scalar_rate = 0;
+            long expected = 0;
+            for (int v = 0; v < 3; ++v) {
+                const ScanKernels* k = scan_kernels_by_name(variants[v]);
+                if (!k) continue;
+                double start = now_seconds();
+                long result = walk(k, kind, buf, buf + size);
+                double rate = size / 1048576.0 / (now_seconds() - start);
+                if (v == 0) {
+                    scalar_rate = rate;
+                    expected = result;
+                } else if (result != expected) {
+                    fprintf(stderr, "Error: %s %s kernel disagrees with scalar\n", variants[v], kernel_names[kind]);
+                    return EXIT_FAILURE;
+                }
+                printf("%-10s %-6s %-7s %10.1f %7.2fx\n", kernel_names[kind], r == 0 ? "short" : "long",
+                       variants[v], rate, rate / scalar_rate);
+            }
+        }
+    }
+    free(buf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+// Strength reduction benchmark: compiles a loop full of * / % by constants at
+// -O1 with and without strength reduction and compares the cycles one
+// iteration of the loop body costs, estimated from the emitted assembly with
+// R3000 latencies (mult 12 cycles, div 35, everything else 1 per machine
+// instruction after pseudo instruction expansion).
+#include <unistd.h>
+#include "lexer.h"
+#include "parser.h"
+#include "code_gen.h"
+
+static const char* source =
+    "main () {\n"
+    "    int i = 0\n"
+    "    int sum = 0\n"
+    "    int t = 0\n"
+    "    while (i < 100000) {\n"
+    "        += i 1;\n"
+    "        % t i 3;\n"
+    "        += sum t;\n"
+    "        % t i 5;\n"
+    "        += sum t;\n"
+    "        / t i 10;\n"
+    "        += sum t;\n"
+    "        % t i 16;\n"
+    "        += sum t;\n"
+    "        / t i 8;\n"
+    "        += sum t;\n"
+    "        * t i 10;\n"
+    "        += sum t;\n"
+    "        * t i 7;\n"
+    "        += sum t;\n"
+    "        / t i 1000;\n"
+    "        += sum t;\n"
+    "    }\n"
+    "    print(sum \"\\n\")\n"
+    "    return 0\n"
+    "}\n";
+
+static int cycles_of(const char* mnemonic, const char* operands) {
+    if (strcmp(mnemonic, "div") == 0) return 35;
+    if (strcmp(mnemonic, "mult") == 0) return 12;
+    if (strcmp(mnemonic, "mul") == 0) return 13; // mult + mflo
+    if (strcmp(mnemonic, "la") == 0) return 2;   // lui + ori
+    if (strcmp(mnemonic, "li") == 0) {
+        long value = atol(operands + strcspn(operands, ",") + 1);
+        return value >= -32768 && value <= 65535 ? 1 : 2;
+    }
+    if (strcmp(mnemonic, "blt") == 0 || strcmp(mnemonic, "ble") == 0 ||
+        strcmp(mnemonic, "bgt") == 0 || strcmp(mnemonic, "bge") == 0) return 2; // slt + branch
+    return 1;
+}
+
+// cycles of the instructions between the loop's head label and the branch
+// back to it
+static int loop_body_cycles(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    char line[256];
+    char head[64] = "";
+    int cycles = 0, in_loop = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        size_t length = strlen(line);
+        if (line[length - 1] == ':') {
+            if (!in_loop && strcmp(line, "main:") != 0) {
+                snprintf(head, sizeof(head), "%.*s", (int) length - 1, line);
+                in_loop = 1;
+            }
+            continue;
+        }
+        if (!in_loop) continue;
+        char mnemonic[16];
+        int consumed;
+        if (sscanf(line, "%15s %n", mnemonic, &consumed) != 1) continue;
+        cycles += cycles_of(mnemonic, line + consumed);
+        const char* target = strrchr(line, ' ') + 1;
+        if (mnemonic[0] == 'b' || strcmp(mnemonic, "j") == 0) {
+            if (strcmp(target, head) == 0) {
+                fclose(fp);
+                return cycles;
+            }
+        }
+    }
+    fclose(fp);
+    fprintf(stderr, "strength_bench: no loop found in %s\n", path);
+    exit(EXIT_FAILURE);
+}
+
+static int compile(AST* ast, int strength_reduce) {
+    char output[] = "/tmp/strength_bench_XXXXXX";
+    int fd = mkstemp(output);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    CodegenOptions options = {1, 0, strength_reduce, 1, 0};
+    generate_mips_code(ast, output, &options);
+    int cycles = loop_body_cycles(output);
+    unlink(output);
+    return cycles;
+}
+
+int main(void){
+    int cycles[2];
+    for (int reduce = 0; reduce <= 1; ++reduce) {
+        // code generation rewrites the tree at -O1, so every run parses afresh
+        Program prog = {0};
+        prog.source.data = strdup(source);
+        prog.source.size = strlen(source);
+        lex_buffer(&prog);
+        AST ast;
+        build_ast(&prog, &ast);
+        cycles[reduce] = compile(&ast, reduce);
+        free_ast(&ast);
+        free_program(&prog);
+    }
+    printf("strength reduction: loop body %d -> %d cycles per iteration (%.1fx)\n",
+           cycles[0], cycles[1], (double) cycles[0] / cycles[1]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+// Symbol table benchmark: declares and looks up N variables (default 200k),
+// then does the same inside a stack of nested scopes.
+// usage: symtab_bench [variables]
+#include "symbol_table.h"
+#include "timer.h"
+
+int main(int argc, char** argv){
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+
+    StringPool pool;
+    init_string_pool(&pool);
+    int* names = (int*) malloc(sizeof(int) * n);
+    char name[32];
+    for (int i = 0; i < n; ++i) {
+        int length = snprintf(name, sizeof(name), "variable_%d", i);
+        names[i] = intern_string(&pool, name, length);
+    }
+
+    SymbolTable table;
+    init_symbol_table(&table);
+
+    double start = now_seconds();
+    for (int i = 0; i < n; ++i) {
+        add_symbol(&table, names[i], i, INT_TYPE, i);
+    }
+    double insert = now_seconds() - start;
+
+    long checksum = 0;
+    unsigned int seed = 1;
+    start = now_seconds();
+    for (int i = 0; i < n; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        checksum += find_symbol(&table, names[(seed >> 8) % n])->label;
+    }
+    double lookup = now_seconds() - start;
+    free_symbol_table(&table);
+
+    // every name declared once per scope, 100 names per scope, innermost shadowing outer
+    init_symbol_table(&table);
+    int per_scope = 100;
+    start = now_seconds();
+    for (int base = 0; base + per_scope <= n; base += per_scope) {
+        push_scope(&table);
+        for (int i = 0; i < per_scope; ++i) {
+            add_symbol(&table, names[(base / per_scope + i) % n], base + i, INT_TYPE, 0);
+        }
+        for (int i = 0; i < per_scope; ++i) {
+            checksum += find_symbol(&table, names[i])->label;
+        }
+    }
+    while (table.scope_depth > 1) pop_scope(&table);
+    double scoped = now_seconds() - start;
+    free_symbol_table(&table);
+
+    printf("symbol table: %d variables, insert %.1f ns/op, lookup %.1f ns/op, "
+           "%d nested scopes %.3f s (checksum %ld)\n",
+           n, insert * 1e9 / n, lookup * 1e9 / n, n / per_scope, scoped, checksum);
+
+    free(names);
+    free_string_pool(&pool);
+    return EXIT_SUCCESS;
+}
@@ -1,538 +1,104 @@
 .data
 newline: .asciiz "\n"
-L0: .word 0
-L1: .word 15
-L8: .asciiz "Is i==32? "
-L11: .asciiz "... YES!\n"
-L12: .word 1
-L13: .asciiz "/"
-L14: .asciiz " ==> "
-L15: .asciiz "*"
-L16: .asciiz " ==> "
-L17: .word 15
-L18: .word 0
-L19: .asciiz "%"
-L20: .asciiz " ==> "
-L21: .asciiz "%"
-L22: .asciiz " ==> "
-L23: .asciiz "%"
-L24: .asciiz " ==> "
-L25: .word 23523
-L26: .asciiz "Using bit-masking &: "
-L27: .asciiz "%"
-L28: .asciiz " ==> "
-L29: .asciiz "%"
-L30: .asciiz " ==> "
-L33: .asciiz "str"
-L34: .asciiz "str"
-L35: .asciiz "String compare-1 works\n"
-L38: .asciiz "st"
-L39: .asciiz "str"
-L40: .asciiz "String compare-2 works\n"
-L43: .asciiz "st"
-L44: .asciiz "str"
-L45: .asciiz "String compare-3 works\n"
-L48: .asciiz "str"
-L49: .asciiz "str"
-L50: .asciiz "String compare-4 works\n"
-L53: .asciiz "string"
-L54: .asciiz "str"
-L55: .asciiz "String compare-5 works\n"
-L58: .asciiz "str"
-L59: .asciiz "str"
-L60: .asciiz "WRONG\n"
+L3: .asciiz "Fizz"
+L5: .asciiz "Buzz"
+L7: .asciiz "Buzz\n"
 
 .text
 .align 2
 .globl main
 
-
 main:
-addi $sp, $sp, -4
+addi $sp, $sp, -16
 sw $ra, 0($sp)
+sw $s0, 4($sp)
+sw $s1, 8($sp)
+sw $s2, 12($sp)
 # function content
-
+li $s0, 1
+li $t0, 1431655766
+li $t3, 1717986919
+la $t4, L3
+la $t5, L5
+la $t6, newline
+la $t7, L7
+la $t8, newline
 # == while-conditional start ==
-L2:
-la $t1, L0
-lw $t0, 0($t1)
-la $t2, L1
-lw $t1, 0($t2)
-sle $v0, $t0, $t1
-beq $v0, $zero, L3
-L4:
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-li $t2, 1
-add $t1, $t1, $t2
-sw $t1, 0($t0)
-j L2
-# == while-conditional loop/end ==
-L3:
-# == print start ==
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-# == while-conditional start ==
-L5:
-la $t1, L0
-lw $t0, 0($t1)
-li $t1, 0
-sge $v0, $t0, $t1
-beq $v0, $zero, L6
-L7:
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-li $t2, 2
-sub $t1, $t1, $t2
-sw $t1, 0($t0)
-j L5
-# == while-conditional loop/end ==
-L6:
-la $t0, L0
-lw $t1, 0($t0)
-li $t2, 8
-li $t3, 24
-add $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $a0, L8
-li $v0, 4
-syscall
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-# == print end ==
-# == if-conditional start ==
-la $t1, L0
-lw $t0, 0($t1)
-li $t1, 32
-seq $v0, $t0, $t1
-beq $v0, $zero, L9
-L10:
-# == print start ==
-la $a0, L11
-li $v0, 4
-syscall
-# == print end ==
-# == if-conditional end ==
-L9:
-la $t0, L0
-lw $t1, 0($t0)
-la $t2, L1
-lw $t2, 0($t2)
-la $t3, L1
-lw $t3, 0($t3)
-add $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-la $t2, L1
-lw $t2, 0($t2)
-li $t3, 3
-add $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-la $t2, L1
-lw $t2, 0($t2)
-li $t3, 3
-sub $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-la $t2, L0
-lw $t2, 0($t2)
-li $t3, 3
-add $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-li $t2, 3
-add $t1, $t1, $t2
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L12
-lw $t1, 0($t0)
-la $t2, L0
-lw $t2, 0($t2)
-li $t3, 3
-div $t2, $t3
-mflo $t1
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L13
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L14
-li $v0, 4
-syscall
-la $t0, L12
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L0
-lw $t1, 0($t0)
-la $t2, L12
-lw $t2, 0($t2)
-li $t3, 3
-mul $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L12
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L15
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L16
-li $v0, 4
-syscall
-la $t0, L0
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L18
-lw $t1, 0($t0)
-la $t2, L17
-lw $t2, 0($t2)
-li $t3, 3
-div $t2, $t3
+L1:
+mult $s0, $t0
 mfhi $t1
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L17
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L19
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L20
-li $v0, 4
-syscall
-la $t0, L18
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L17
-lw $t1, 0($t0)
-li $t2, 1
-add $t1, $t1, $t2
-sw $t1, 0($t0)
-la $t0, L18
-lw $t1, 0($t0)
-la $t2, L17
-lw $t2, 0($t2)
-li $t3, 3
-div $t2, $t3
-mfhi $t1
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L17
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L21
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L22
-li $v0, 4
-syscall
-la $t0, L18
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L17
-lw $t1, 0($t0)
-li $t2, 1
+srl $t2, $t1, 31
 add $t1, $t1, $t2
-sw $t1, 0($t0)
-la $t0, L18
-lw $t1, 0($t0)
-la $t2, L17
-lw $t2, 0($t2)
-li $t3, 3
-div $t2, $t3
+sll $t2, $t1, 1
+add $t1, $t2, $t1
+sub $s1, $s0, $t1
+mult $s0, $t3
 mfhi $t1
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L17
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L23
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L24
-li $v0, 4
-syscall
-la $t0, L18
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L18
-lw $t1, 0($t0)
-la $t2, L25
-lw $t2, 0($t2)
-li $t3, 63
-and $t1, $t2, $t3
-sw $t1, 0($t0)
-# == print start ==
-la $a0, L26
-li $v0, 4
-syscall
-la $t0, L17
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L27
-li $v0, 4
-syscall
-li $a0, 63
-li $v0, 1
-syscall
-la $a0, L28
-li $v0, 4
-syscall
-la $t0, L18
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
-la $t0, L17
-lw $t1, 0($t0)
-li $t2, 1
+sra $t1, $t1, 1
+srl $t2, $t1, 31
 add $t1, $t1, $t2
-sw $t1, 0($t0)
-la $t0, L18
-lw $t1, 0($t0)
-la $t2, L17
-lw $t2, 0($t2)
-li $t3, 3
-div $t2, $t3
-mfhi $t1
-sw $t1, 0($t0)
-# == print start ==
-la $t0, L17
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, L29
-li $v0, 4
-syscall
-li $a0, 3
-li $v0, 1
-syscall
-la $a0, L30
-li $v0, 4
-syscall
-la $t0, L18
-lw $a0, 0($t0)
-li $v0, 1
-syscall
-la $a0, newline
-li $v0, 4
-syscall
-# == print end ==
+sll $t2, $t1, 2
+add $t1, $t2, $t1
+sub $s2, $s0, $t1
 # == if-conditional start ==
-la $a0, L33
-la $a1, L34
-jal strcmp
-seq $v0, $v0, $zero
-beq $v0, $zero, L31
-L32:
+bne $s1, $zero, L2
 # == print start ==
-la $a0, L35
+move $a0, $t4
 li $v0, 4
 syscall
 # == print end ==
-# == if-conditional end ==
-L31:
 # == if-conditional start ==
-la $a0, L38
-la $a1, L39
-jal strcmp
-sne $v0, $v0, $zero
-beq $v0, $zero, L36
-L37:
+bne $s2, $zero, L4
 # == print start ==
-la $a0, L40
+move $a0, $t5
 li $v0, 4
 syscall
 # == print end ==
 # == if-conditional end ==
-L36:
-# == if-conditional start ==
-la $a0, L43
-la $a1, L44
-jal strcmp
-slt $v0, $v0, $zero
-beq $v0, $zero, L41
-L42:
+L4:
 # == print start ==
-la $a0, L45
+move $a0, $t6
 li $v0, 4
 syscall
 # == print end ==
 # == if-conditional end ==
-L41:
+L2:
 # == if-conditional start ==
-la $a0, L48
-la $a1, L49
-jal strcmp
-sle $v0, $v0, $zero
-beq $v0, $zero, L46
-L47:
+beq $s1, $zero, L6
+bne $s2, $zero, L6
 # == print start ==
-la $a0, L50
+move $a0, $t7
 li $v0, 4
 syscall
 # == print end ==
 # == if-conditional end ==
-L46:
+L6:
 # == if-conditional start ==
-la $a0, L53
-la $a1, L54
-jal strcmp
-sgt $v0, $v0, $zero
-beq $v0, $zero, L51
-L52:
+beq $s1, $zero, L8
+beq $s2, $zero, L8
 # == print start ==
-la $a0, L55
-li $v0, 4
+move $a0, $s0
+li $v0, 1
 syscall
-# == print end ==
-# == if-conditional end ==
-L51:
-# == if-conditional start ==
-la $a0, L58
-la $a1, L59
-jal strcmp
-sne $v0, $v0, $zero
-beq $v0, $zero, L56
-L57:
-# == print start ==
-la $a0, L60
+move $a0, $t8
 li $v0, 4
 syscall
 # == print end ==
 # == if-conditional end ==
-L56:
+L8:
+addi $s0, $s0, 1
+slti $t1, $s0, 16
+bne $t1, $zero, L1
+# == while-conditional loop/end ==
 # returning here
 li $v0, 0
 # unloading function
 lw $ra, 0($sp)
-addi $sp, $sp, 4
+lw $s0, 4($sp)
+lw $s1, 8($sp)
+lw $s2, 12($sp)
+addi $sp, $sp, 16
 jr $ra
-
 # ====== START STRCMP ======
 strcmp:
 move $t0, $zero
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "compiler.h"
+#include "timer.h"
+
+// files [head, tail) of the batch still to do; the owner takes from the
+// tail, a thief takes the first half from the head
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} FileQueue;
+
+typedef struct Batch Batch;
+
+typedef struct {
+    Batch* batch;
+    int index;
+    pthread_t thread;
+    FileQueue queue;
+    // the source of the file being compiled, read into the same buffer
+    // every time so that small files cost no allocation or mapping
+    char* source;
+    size_t source_capacity;
+    int compiled;
+    int failed;
+    int stolen;
+    size_t source_bytes;
+    size_t asm_bytes;
+} Worker;
+
+struct Batch {
+    const char** inputs;
+    char** outputs;
+    const CodegenOptions* options;
+    Worker* workers;
+    int worker_count;
+};
+
+// outdir/<file name without .code>.asm
+static char* output_path(const char* input, const char* outdir) {
+    const char* name = strrchr(input, '/');
+    name = name ? name + 1 : input;
+    size_t length = strlen(name);
+    if (length > 5 && strcmp(name + length - 5, ".code") == 0) length -= 5;
+    size_t dir_length = strlen(outdir);
+    while (dir_length > 1 && outdir[dir_length - 1] == '/') --dir_length;
+
+    char* path = (char*) malloc(dir_length + length + 6);
+    if (!path) {
+        fprintf(stderr, "Error: Malloc Failed on compile_batch\n");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%.*s/%.*s.asm", (int) dir_length, outdir, (int) length, name);
+    return path;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+// reads all of fp into the worker's buffer, -1 on a read error
+static long read_source(Worker* worker, FILE* fp) {
+    struct stat st;
+    size_t want = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) ? (size_t) st.st_size + 1 : 1 << 16;
+    size_t size = 0;
+    for (;;) {
+        if (size + want > worker->source_capacity) {
+            size_t capacity = worker->source_capacity ? worker->source_capacity : 1 << 16;
+            while (capacity < size + want) capacity *= 2;
+            char* grown = (char*) realloc(worker->source, capacity);
+            if (!grown) return -1;
+            worker->source = grown;
+            worker->source_capacity = capacity;
+        }
+        size_t n = fread(worker->source + size, 1, worker->source_capacity - size, fp);
+        size += n;
+        if (n == 0) break;
+        want = 1;
+    }
+    return ferror(fp) ? -1 : (long) size;
+}
+
+static void compile_file(Worker* worker, int file) {
+    const Batch* batch = worker->batch;
+    const char* input = batch->inputs[file];
+    FILE* fp = fopen(input, "rb");
+    long size = fp ? read_source(worker, fp) : -1;
+    if (fp) fclose(fp);
+    if (size < 0) {
+        fprintf(stderr, "%s: could not read the file\n", input);
+        ++worker->failed;
+        return;
+    }
+    worker->source_bytes += size;
+
+    CompileOutput output;
+    Diagnostics diagnostics;
+    if (compile(worker->source, size, batch->options, &output, &diagnostics) != 0) {
+        fprintf(stderr, "%s: %s", input, diagnostics.message ? diagnostics.message : "out of memory\n");
+        free_diagnostics(&diagnostics);
+        ++worker->failed;
+        return;
+    }
+
+    FILE* out = fopen(batch->outputs[file], "w");
+    int written = out && fwrite(output.text, 1, output.length, out) == output.length;
+    if (out && fclose(out) != 0) written = 0;
+    if (written) {
+        worker->asm_bytes += output.length;
+        ++worker->compiled;
+    } else {
+        fprintf(stderr, "%s: could not write %s\n", input, batch->outputs[file]);
+        ++worker->failed;
+    }
+    free_compile_output(&output);
+}
+
+// the next file of the worker's own queue, -1 once it is empty
+static int take_own(Worker* worker) {
+    FileQueue* queue = &worker->queue;
+    pthread_mutex_lock(&queue->lock);
+    int file = queue->head < queue->tail ? --queue->tail : -1;
+    pthread_mutex_unlock(&queue->lock);
+    return file;
+}
+
+// moves the first half of another worker's remaining files into this
+// worker's (empty) queue; 0 when every queue is empty
+static int steal(Worker* worker) {
+    Batch* batch = worker->batch;
+    for (int k = 1; k < batch->worker_count; ++k) {
+        FileQueue* victim = &batch->workers[(worker->index + k) % batch->worker_count].queue;
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->tail - victim->head;
+        int head = victim->head;
+        int taken = (remaining + 1) / 2;
+        victim->head += taken;
+        pthread_mutex_unlock(&victim->lock);
+        if (taken == 0) continue;
+
+        pthread_mutex_lock(&worker->queue.lock);
+        worker->queue.head = head;
+        worker->queue.tail = head + taken;
+        pthread_mutex_unlock(&worker->queue.lock);
+        worker->stolen += taken;
+        return 1;
+    }
+    return 0;
+}
+
+static void* run_worker(void* arg) {
+    Worker* worker = (Worker*) arg;
+    for (;;) {
+        int file = take_own(worker);
+        if (file < 0) {
+            if (!steal(worker)) break;
+            continue;
+        }
+        compile_file(worker, file);
+    }
+    return NULL;
+}
+
+int compile_batch(const char** inputs, int count, const char* outdir, int threads, const CodegenOptions* options) {
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+    if (mkdir(outdir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: could not create %s\n", outdir);
+        exit(EXIT_FAILURE);
+    }
+
+    Batch batch = {inputs, NULL, options, NULL, threads};
+    batch.outputs = (char**) malloc(sizeof(char*) * (count + 1));
+    char** sorted = (char**) malloc(sizeof(char*) * (count + 1));
+    batch.workers = (Worker*) calloc(threads, sizeof(Worker));
+    if (!batch.outputs || !sorted || !batch.workers) {
+        fprintf(stderr, "Error: Malloc Failed on compile_batch\n");
+        exit(EXIT_FAILURE);
+    }
+    // two inputs of the same name would write the same file
+    for (int i = 0; i < count; ++i) sorted[i] = batch.outputs[i] = output_path(inputs[i], outdir);
+    qsort(sorted, count, sizeof(char*), compare_paths);
+    for (int i = 1; i < count; ++i) {
+        if (strcmp(sorted[i - 1], sorted[i]) == 0) {
+            fprintf(stderr, "Error: more than one input would be compiled to %s\n", sorted[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(sorted);
+
+    // contiguous shares to begin with, stealing evens out the rest
+    for (int w = 0; w < threads; ++w) {
+        Worker* worker = &batch.workers[w];
+        worker->batch = &batch;
+        worker->index = w;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->queue.head = (int) ((long long) count * w / threads);
+        worker->queue.tail = (int) ((long long) count * (w + 1) / threads);
+    }
+
+    double start = now_seconds();
+    for (int w = 1; w < threads; ++w) {
+        if (pthread_create(&batch.workers[w].thread, NULL, run_worker, &batch.workers[w]) != 0) {
+            fprintf(stderr, "Error: could not start worker thread %d\n", w);
+            exit(EXIT_FAILURE);
+        }
+    }
+    run_worker(&batch.workers[0]);
+    for (int w = 1; w < threads; ++w) pthread_join(batch.workers[w].thread, NULL);
+    double elapsed = now_seconds() - start;
+
+    int failed = 0;
+    size_t source_bytes = 0, asm_bytes = 0;
+    for (int w = 0; w < threads; ++w) {
+        failed += batch.workers[w].failed;
+        source_bytes += batch.workers[w].source_bytes;
+        asm_bytes += batch.workers[w].asm_bytes;
+    }
+    fprintf(stderr, "batch: %d files, %d failed, %.1f MB of source -> %.1f MB of assembly in %.3f s on %d threads "
+            "(%.0f files/s, %.1f MB/s)\n", count, failed, source_bytes / 1e6, asm_bytes / 1e6, elapsed, threads,
+            elapsed > 0 ? count / elapsed : 0.0, elapsed > 0 ? source_bytes / 1e6 / elapsed : 0.0);
+    for (int w = 0; w < threads; ++w) {
+        const Worker* worker = &batch.workers[w];
+        fprintf(stderr, "  thread %d: %d compiled, %d failed, %d stolen\n",
+                w, worker->compiled, worker->failed, worker->stolen);
+        pthread_mutex_destroy(&batch.workers[w].queue.lock);
+        free(worker->source);
+    }
+
+    for (int i = 0; i < count; ++i) free(batch.outputs[i]);
+    free(batch.outputs);
+    free(batch.workers);
+    return failed;
+}
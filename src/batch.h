@@ -0,0 +1,14 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "code_gen.h"
+
+// Compiles count files on threads workers, each into outdir/<name>.asm
+// (<name> is the input's file name without its .code extension). Files are
+// dealt out to the workers up front and a worker that runs out steals from
+// the others. Errors are printed per file as "<input>: <message>", a
+// summary with the throughput goes to stderr at the end. Returns the number
+// of files that failed.
+int compile_batch(const char** inputs, int count, const char* outdir, int threads, const CodegenOptions* options);
+
+#endif
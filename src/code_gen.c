@@ -2,74 +2,167 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "lexer.h"
 #include "parser.h"
 #include "code_gen.h"
 #include "symbol_table.h"
+#include "peephole.h"
+#include "const_fold.h"
+#include "print_coalesce.h"
+#include "runtime.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
 
 #define INITIAL_BUFFER_SIZE 1024
-
-void init_buffer(CodeBuffer* buffer) {
-    buffer->body_capacity = buffer->data_capacity = buffer->util_capacity= INITIAL_BUFFER_SIZE;
-    buffer->body_size = buffer->data_size = buffer->util_size = 0;
+// most instructions an unrolled loop may take, peeled copies included
+#define UNROLL_MAX_INSTRUCTIONS 256
+// longest string, in words, whose equality test is inlined
+#define STRING_COMPARE_WORDS 8
+
+static const char* register_names[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
+
+// indexed by -label - 2
+static const char* named_labels[] = {"main", "newline", "strcmp", "print_string", "print_int", "print_flush"};
+
+static const char* comment_text[] = {
+    [COMMENT_PRINT_START] = "# == print start ==",
+    [COMMENT_PRINT_END] = "# == print end ==",
+    [COMMENT_IF_START] = "# == if-conditional start ==",
+    [COMMENT_IF_END] = "# == if-conditional end ==",
+    [COMMENT_WHILE_START] = "# == while-conditional start ==",
+    [COMMENT_WHILE_END] = "# == while-conditional loop/end ==",
+    [COMMENT_FOR_START] = "# == for-loop start ==",
+    [COMMENT_FOR_END] = "# == for-loop end ==",
+    [COMMENT_FUNCTION] = "# function content",
+    [COMMENT_RETURN] = "# returning here",
+    [COMMENT_UNLOAD] = "# unloading function",
+};
+
+static const char* mnemonics[] = {
+    [OP_LI] = "li", [OP_LA] = "la", [OP_LW] = "lw", [OP_SW] = "sw", [OP_MOVE] = "move",
+    [OP_ADD] = "add", [OP_SUB] = "sub", [OP_ADDU] = "addu", [OP_SUBU] = "subu", [OP_MUL] = "mul", [OP_AND] = "and", [OP_OR] = "or",
+    [OP_ADDI] = "addi", [OP_ADDIU] = "addiu", [OP_ANDI] = "andi", [OP_ORI] = "ori",
+    [OP_SLL] = "sll", [OP_SRL] = "srl", [OP_SRA] = "sra", [OP_SLTI] = "slti",
+    [OP_DIV] = "div", [OP_MULT] = "mult", [OP_MFLO] = "mflo", [OP_MFHI] = "mfhi",
+    [OP_BEQ] = "beq", [OP_BNE] = "bne", [OP_BLT] = "blt", [OP_BLE] = "ble",
+    [OP_BGT] = "bgt", [OP_BGE] = "bge",
+    [OP_J] = "j", [OP_JAL] = "jal", [OP_JR] = "jr", [OP_SYSCALL] = "syscall",
+};
+
+void init_buffer(CodeBuffer* buffer, StringPool* strings) {
+    buffer->body_capacity = buffer->data_capacity = buffer->util_capacity = INITIAL_BUFFER_SIZE;
+    buffer->body_count = buffer->data_count = buffer->util_size = 0;
     buffer->label_counter = 0;
+    buffer->alloc = NULL;
+    buffer->loop_depth = 0;
+    buffer->strength_reduce = 0;
+    buffer->opt_level = 0;
+    buffer->unroll = 1;
+    buffer->induction_reg = NULL;
+    buffer->literals = (LiteralLayout){NULL, NULL, NULL, 0};
+    buffer->literal_label = NULL;
+    buffer->literal_aligned = NULL;
+    buffer->prints = 0;
+    buffer->line = 0;
+    buffer->line_comments = 0;
+    buffer->symbol_count = 0;
+    buffer->free_induction_regs = INDUCTION_REGS;
+
+    buffer->body = (Instr*)counted_malloc(sizeof(Instr)*buffer->body_capacity);
+    buffer->data = (Instr*)counted_malloc(sizeof(Instr)*buffer->data_capacity);
+    buffer->util = (char*)counted_malloc(sizeof(char)*buffer->util_capacity);
+    if (!buffer->body || !buffer->data || !buffer->util) {
+        compile_error("Error: Malloc Failed on init_buffer\n");
+    }
 
-    buffer->body = (char*)malloc(sizeof(char)*buffer->body_capacity);
-    buffer->body[0] = '\0';
-
-    buffer->data = (char*)malloc(sizeof(char)*buffer->data_capacity);
-    buffer->data[0] = '\0';
-
-    buffer->util = (char*)malloc(sizeof(char)*buffer->util_capacity);
-    buffer->util[0] = '\0';
+    buffer->strings = strings;
+    buffer->newline_string = intern_string(strings, "\"\\n\"", 4);
 }
 
-// segment 0 is body, 1 is data, 2 is util
-void append_to_buffer(CodeBuffer* buf, int segment, const char* format, ...) {
-    char** append_buf = &buf->body;
-    int* capacity = &buf->body_capacity;
-    int* size = &buf->body_size;
-    if (segment == 1){
-        append_buf = &buf->data;
-        capacity = &buf->data_capacity;
-        size = &buf->data_size;
-    }else if (segment == 2){
-        append_buf = &buf->util;
-        capacity = &buf->util_capacity;
-        size = &buf->util_size;
+static Instr* grow_segment(Instr** segment, int* count, int* capacity) {
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *segment = (Instr*)counted_realloc(*segment, sizeof(Instr) * (*capacity));
+        if (!*segment) {
+            compile_error("Error: Realloc Failed on emit\n");
+        }
     }
+    return &(*segment)[(*count)++];
+}
 
-    va_list args;
-    va_start(args, format);
+void emit(CodeBuffer* buffer, Opcode op, int rd, int rs, int rt, int imm, int label) {
+    Instr* instr = grow_segment(&buffer->body, &buffer->body_count, &buffer->body_capacity);
+    instr->op = op;
+    instr->rd = rd;
+    instr->rs = rs;
+    instr->rt = rt;
+    instr->imm = imm;
+    instr->label = label;
+    instr->line = buffer->line;
+}
 
-    int remaining = *capacity - *size;
-    char temp[1024];
-    int written = vsnprintf(temp, sizeof(temp), format, args);
+void emit_data(CodeBuffer* buffer, Opcode op, int label, int imm) {
+    Instr* instr = grow_segment(&buffer->data, &buffer->data_count, &buffer->data_capacity);
+    instr->op = op;
+    instr->rd = instr->rs = instr->rt = 0;
+    instr->imm = imm;
+    instr->label = label;
+    instr->line = 0;
+}
 
-    if (written >= remaining) {
-        *capacity *= 2;
-        *append_buf = (char*)realloc(*append_buf, sizeof(char) * (*capacity));
+static void append_util(CodeBuffer* buffer, const char* text, size_t length) {
+    while (buffer->util_size + length + 1 > (size_t) buffer->util_capacity) {
+        buffer->util_capacity *= 2;
+        buffer->util = (char*)counted_realloc(buffer->util, buffer->util_capacity);
+        if (!buffer->util) {
+            compile_error("Error: Realloc Failed on append_util\n");
+        }
     }
+    memcpy(buffer->util + buffer->util_size, text, length);
+    buffer->util_size += length;
+    buffer->util[buffer->util_size] = '\0';
+}
 
-    // append to end of buffer
-    strncpy(*append_buf + *size, temp, written);
-    *size += written;
-    (*append_buf)[*size] = '\0';
-
-    va_end(args);
+// Copies the runtime routines the code calls after it, each once and in a
+// fixed order; the ones nothing calls are left out.
+static void append_runtime(CodeBuffer* buffer) {
+    const char* routines[] = {runtime_strcmp, runtime_print};
+    int used[2] = {0, 0};
+    for (int i = 0; i < buffer->body_count; ++i) {
+        const Instr* in = &buffer->body[i];
+        if (in->op != OP_JAL) continue;
+        if (in->label == LABEL_STRCMP) used[0] = 1;
+        if (in->label == LABEL_PRINT_STRING || in->label == LABEL_PRINT_INT || in->label == LABEL_PRINT_FLUSH) used[1] = 1;
+    }
+    for (int r = 0; r < 2; ++r) {
+        if (used[r]) append_util(buffer, routines[r], strlen(routines[r]));
+    }
 }
 
 void free_buffer(CodeBuffer* buffer) {
-    free(buffer->data);
-    free(buffer->body);
-    free(buffer->util);
+    counted_free(buffer->data);
+    counted_free(buffer->body);
+    counted_free(buffer->util);
+    counted_free(buffer->induction_reg);
+    buffer->induction_reg = NULL;
+    free_literal_layout(&buffer->literals);
+    counted_free(buffer->literal_label);
+    buffer->literal_label = NULL;
+    counted_free(buffer->literal_aligned);
+    buffer->literal_aligned = NULL;
 
     buffer->body = NULL;
-    buffer->body_size = 0;
+    buffer->body_count = 0;
     buffer->body_capacity = 0;
-    
+
     buffer->data = NULL;
-    buffer->data_size = 0;
+    buffer->data_count = 0;
     buffer->data_capacity = 0;
 
     buffer->util = NULL;
@@ -79,586 +172,1496 @@ void free_buffer(CodeBuffer* buffer) {
     buffer->label_counter = 0;
 }
 
-void write_buffer_to_file(CodeBuffer* buffer, const char* filename) {
+// ---- serializer ----
+// Text is produced once, here, by copying mnemonics and register names and
+// converting integers by hand. Every record reserves its worst case up front
+// so the put_* helpers never need to check for room.
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextOut;
+
+static char* reserve_text(TextOut* out, size_t length) {
+    if (out->size + length > out->capacity) {
+        while (out->size + length > out->capacity) out->capacity *= 2;
+        out->data = (char*)counted_realloc(out->data, out->capacity);
+        if (!out->data) {
+            compile_error("Error: Realloc Failed on write_buffer_to_file\n");
+        }
+    }
+    return out->data + out->size;
+}
+
+static char* put_str(char* p, const char* s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char* put_int(char* p, int value) {
+    char digits[12];
+    int n = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned) value : (unsigned) value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *p++ = '-';
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+static char* put_label(char* p, int label) {
+    if (label < 0) return put_str(p, named_labels[-label - 2]);
+    *p++ = 'L';
+    return put_int(p, label);
+}
+
+static char* put_reg(char* p, int reg) {
+    return put_str(p, register_names[reg]);
+}
+
+static char* put_sep(char* p) {
+    *p++ = ',';
+    *p++ = ' ';
+    return p;
+}
+
+// longest line an instruction can produce, string literals aside
+#define MAX_INSTR_TEXT 96
+
+static char* put_instr(char* p, const Instr* in, const StringPool* strings) {
+    switch (in->op) {
+        case OP_LABEL:
+            p = put_label(p, in->label);
+            *p++ = ':';
+            break;
+        case OP_COMMENT:
+            p = put_str(p, comment_text[in->imm]);
+            break;
+        case OP_ASCIIZ:
+            p = put_label(p, in->label);
+            p = put_str(p, ": .asciiz ");
+            memcpy(p, pool_string(strings, in->imm), pool_length(strings, in->imm));
+            p += pool_length(strings, in->imm);
+            break;
+        case OP_WORD:
+            p = put_label(p, in->label);
+            p = put_str(p, ": .word ");
+            p = put_int(p, in->imm);
+            break;
+        case OP_ALIGN:
+            p = put_str(p, ".align ");
+            p = put_int(p, in->imm);
+            break;
+        default:
+            p = put_str(p, mnemonics[in->op]);
+            *p++ = ' ';
+            switch (in->op) {
+                case OP_LI:
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_int(p, in->imm);
+                    break;
+                case OP_LA:
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_label(p, in->label);
+                    if (in->imm) {
+                        *p++ = '+';
+                        p = put_int(p, in->imm);
+                    }
+                    break;
+                case OP_LW:
+                case OP_SW:
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_int(p, in->imm);
+                    *p++ = '(';
+                    p = put_reg(p, in->rs);
+                    *p++ = ')';
+                    break;
+                case OP_MOVE:
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_reg(p, in->rs);
+                    break;
+                case OP_ADDI:
+                case OP_ADDIU:
+                case OP_ANDI:
+                case OP_ORI:
+                case OP_SLL:
+                case OP_SRL:
+                case OP_SRA:
+                case OP_SLTI:
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_sep(put_reg(p, in->rs));
+                    p = put_int(p, in->imm);
+                    break;
+                case OP_DIV:
+                case OP_MULT:
+                    p = put_sep(put_reg(p, in->rs));
+                    p = put_reg(p, in->rt);
+                    break;
+                case OP_MFLO:
+                case OP_MFHI:
+                    p = put_reg(p, in->rd);
+                    break;
+                case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BLE: case OP_BGT: case OP_BGE:
+                    p = put_sep(put_reg(p, in->rs));
+                    p = put_sep(put_reg(p, in->rt));
+                    p = put_label(p, in->label);
+                    break;
+                case OP_J:
+                case OP_JAL:
+                    p = put_label(p, in->label);
+                    break;
+                case OP_JR:
+                    p = put_reg(p, in->rs);
+                    break;
+                case OP_SYSCALL:
+                    --p; // no operands, drop the space
+                    break;
+                default: // three register arithmetic
+                    p = put_sep(put_reg(p, in->rd));
+                    p = put_sep(put_reg(p, in->rs));
+                    p = put_reg(p, in->rt);
+                    break;
+            }
+    }
+    *p++ = '\n';
+    return p;
+}
+
+// with line_comments, an instruction whose source line differs from the
+// previous one's is preceded by "# .loc <line>"
+static void put_segment(TextOut* out, const Instr* instrs, int count, const StringPool* strings, int line_comments) {
+    int line = 0;
+    for (int i = 0; i < count; ++i) {
+        if (instrs[i].op == OP_NOP) continue;
+        if (line_comments && instrs[i].line != line && instrs[i].op != OP_LABEL && instrs[i].op != OP_COMMENT) {
+            line = instrs[i].line;
+            char* p = put_str(reserve_text(out, 24), "# .loc ");
+            p = put_int(p, line);
+            *p++ = '\n';
+            out->size = p - out->data;
+        }
+        size_t room = MAX_INSTR_TEXT;
+        if (instrs[i].op == OP_ASCIIZ) room += pool_length(strings, instrs[i].imm);
+        char* p = reserve_text(out, room);
+        out->size = put_instr(p, &instrs[i], strings) - out->data;
+    }
+}
+
+char* render_buffer(const CodeBuffer* buffer, size_t* length) {
+    TextOut out = {NULL, 0, 0};
+    out.capacity = (size_t)(buffer->body_count + buffer->data_count) * 24 + buffer->util_size + 256;
+    out.data = (char*)counted_malloc(out.capacity);
+    if (!out.data) {
+        compile_error("Error: Malloc Failed on render_buffer\n");
+    }
+
+    // text segment header goes right before the body so that the main
+    // function directly follows it
+    out.size = put_str(reserve_text(&out, 8), ".data\n") - out.data;
+    put_segment(&out, buffer->data, buffer->data_count, buffer->strings, 0);
+    out.size = put_str(reserve_text(&out, 40), "\n.text\n.align 2\n.globl main\n\n") - out.data;
+    put_segment(&out, buffer->body, buffer->body_count, buffer->strings, buffer->line_comments);
+    // the runtime routines belong to no line
+    if (buffer->line_comments) out.size = put_str(reserve_text(&out, 16), "# .loc 0\n") - out.data;
+
+    char* p = reserve_text(&out, buffer->util_size + 1);
+    memcpy(p, buffer->util, buffer->util_size);
+    p[buffer->util_size] = '\0';
+    out.size += buffer->util_size;
+    *length = out.size;
+    return out.data;
+}
+
+// returns the bytes written
+size_t write_buffer_to_file(CodeBuffer* buffer, const char* filename) {
     FILE* file = fopen(filename, "w");
     if (!file) {
-        fprintf(stderr, "Error opening output file\n");
-        exit(EXIT_FAILURE);
+        compile_error("Error opening output file\n");
     }
-    fwrite(buffer->data, 1, buffer->data_size, file);
-    fwrite(buffer->body, 1, buffer->body_size, file);
-    fwrite(buffer->util, 1, buffer->util_size, file);
+    size_t length;
+    char* text = render_buffer(buffer, &length);
+    fwrite(text, 1, length, file);
     fclose(file);
+    counted_free(text);
+    return length;
 }
 
-// entry point of code generation
-void generate_mips_code(AST* ast, const char* output_filename) {
-    if (!ast || !ast->root) {
-        fprintf(stderr, "Error: parse tree is empty.\n");
-        return;
+static int prints_anything(const AST* ast, int node) {
+    if (ast->kind[node] == NODE_PRINT && ast->first_child[node] != NO_NODE) return 1;
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        if (prints_anything(ast, child)) return 1;
     }
+    return 0;
+}
 
-    if (ast->root->children_count > 0 && ast->root->children[0].token_data->type != MAIN){
-        fprintf(stderr, "Error: main function not found.\n");
-        return;
+// Peephole can delete every instruction naming a variable's register, say
+// all the defs of one whose uses folding replaced with its value. The
+// prologue and epilogues then stop saving that register and the frame loses
+// its word: the saves left move down, and so do the $fp save and the spill
+// slots addressed from $fp.
+static void trim_frame(CodeBuffer* buffer, RegAllocation* alloc) {
+    unsigned used = 0;
+    int in_frame = 0;
+    for (int i = 0; i < buffer->body_count; ++i) {
+        const Instr* in = &buffer->body[i];
+        if (in->op == OP_LABEL && in->label == LABEL_MAIN) in_frame = 1;
+        else if (in->op == OP_COMMENT && in->imm == COMMENT_UNLOAD) in_frame = 1;
+        else if (in->op == OP_COMMENT && in->imm == COMMENT_FUNCTION) in_frame = 0;
+        else if (in->op == OP_JR && in_frame) in_frame = 0;
+        else if (!in_frame && in->op != OP_LABEL && in->op != OP_COMMENT && in->op != OP_NOP) {
+            used |= 1u << in->rd | 1u << in->rs | 1u << in->rt;
+        }
     }
+    unsigned dropped = alloc->saved_regs & ~used;
+    if (!dropped) return;
+
+    int shift = 4 * __builtin_popcount(dropped);
+    alloc->saved_regs &= ~dropped;
+    alloc->frame_size -= shift;
+    if (alloc->fp_offset >= 0) alloc->fp_offset -= shift;
+
+    int offset = 4;
+    in_frame = 0;
+    for (int i = 0; i < buffer->body_count; ++i) {
+        Instr* in = &buffer->body[i];
+        if ((in->op == OP_LABEL && in->label == LABEL_MAIN) || (in->op == OP_COMMENT && in->imm == COMMENT_UNLOAD)) {
+            in_frame = 1;
+            offset = 4;
+        } else if ((in->op == OP_COMMENT && in->imm == COMMENT_FUNCTION) || (in->op == OP_JR && in_frame)) {
+            in_frame = 0;
+        } else if (!in_frame) {
+            if ((in->op == OP_LW || in->op == OP_SW) && in->rs == REG_FP) in->imm -= shift;
+        } else if (in->op == OP_ADDI && in->rd == REG_SP) {
+            in->imm = in->imm < 0 ? -alloc->frame_size : alloc->frame_size;
+        } else if ((in->op == OP_LW || in->op == OP_SW) && in->rs == REG_SP && in->rd == REG_FP) {
+            in->imm = alloc->fp_offset;
+        } else if ((in->op == OP_LW || in->op == OP_SW) && in->rs == REG_SP && in->rd != REG_RA) {
+            if (dropped & (1u << in->rd)) {
+                in->op = OP_NOP;
+            } else {
+                in->imm = offset;
+                offset += 4;
+            }
+        }
+    }
+}
+
+// generates the whole program into buffer, runtime routines included
+void generate_mips_buffer(AST* ast, CodeBuffer* out, const CodegenOptions* options) {
+    static const CodegenOptions defaults = {0, 0, 1, 1, 0};
+    if (!options) options = &defaults;
+
+    // Note: as of now the parser only accepts a "main" function
+    int main_node = ast->first_child[ast->root];
 
     CodeBuffer buffer;
-    init_buffer(&buffer);
+    init_buffer(&buffer, &ast->prog->strings);
+    buffer.line_comments = options->line_comments;
 
     SymbolTable table;
     init_symbol_table(&table);
 
-    // Starting mips content
-    // text segment should go in body buffer so that the main function directly follows it
-    append_to_buffer(&buffer, 0, "\n.text\n");
-    append_to_buffer(&buffer, 0, ".align 2\n");
-    append_to_buffer(&buffer, 0, ".globl main\n\n");
-    append_to_buffer(&buffer, 1, ".data\n");
-    append_to_buffer(&buffer, 1, "newline: .asciiz \"\\n\"\n");
+    RegAllocation alloc = {0};
+    if (options->opt_level >= 1) {
+        SymbolTable names;
+        init_symbol_table(&names);
+        check_names(ast, main_node, &names);
+        free_symbol_table(&names);
+        fold_constants(ast, main_node);
+        coalesce_prints(ast, main_node);
+        allocate_registers(ast, main_node, &alloc);
+        buffer.alloc = &alloc;
+        buffer.strength_reduce = options->strength_reduce;
+        buffer.opt_level = options->opt_level;
+        buffer.unroll = options->unroll;
+    }
 
-    // start generating code from the root
-    // Note: as of now we only support having a "main" function
-    generate_code(&ast->root->children[0], &buffer, &table);
+    // literals are laid out once folding has dropped the dead ones
+    layout_literals(ast, &buffer.literals);
+    buffer.literal_label = (int*) counted_malloc(sizeof(int) * (buffer.literals.count + 1));
+    buffer.literal_aligned = (unsigned char*) counted_calloc(buffer.literals.count + 1, 1);
+    if (!buffer.literal_label || !buffer.literal_aligned) {
+        compile_error("Error: Malloc Failed on generate_mips_buffer\n");
+    }
+    for (int id = 0; id < buffer.literals.count; ++id) buffer.literal_label[id] = NO_LABEL;
 
-    FILE* file = fopen("util/strcmp.asm", "r");
-    if (!file) {
-        fprintf(stderr, "Error opening util/strcmp.asm file\n");
-        exit(EXIT_FAILURE);
+    // a program that never prints has no buffer to flush
+    buffer.prints = prints_anything(ast, main_node);
+
+    // start generating code from the root
+    generate_code(ast, main_node, &buffer, &table);
+
+    // the literals that were used, in pool order; the ones compared a word
+    // at a time start on a word and are zero padded to the next one
+    for (int id = 0; id < buffer.literals.count; ++id) {
+        if (buffer.literal_label[id] == NO_LABEL) continue;
+        if (buffer.literal_aligned[id]) emit_data(&buffer, OP_ALIGN, NO_LABEL, 2);
+        emit_data(&buffer, OP_ASCIIZ, buffer.literal_label[id], id);
+        if (buffer.literal_aligned[id]) emit_data(&buffer, OP_ALIGN, NO_LABEL, 2);
     }
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line,"\n")] = '\0';
-        append_to_buffer(&buffer, 2, "%s\n", line);
+
+    if (options->opt_level >= 1) {
+        PeepholeStats stats;
+        peephole_optimize(&buffer, &stats);
+        trim_frame(&buffer, &alloc);
+        if (options->peephole_stats) print_peephole_stats(&stats, stderr);
     }
-    fclose(file);
 
-    // write code from buffer to asm output file
-    write_buffer_to_file(&buffer, output_filename);
-    free_buffer(&buffer);
+    append_runtime(&buffer);
+
+    buffer.symbol_count = table.declared;
     free_symbol_table(&table);
+    free_allocation(&alloc);
+    buffer.alloc = NULL;
+    *out = buffer;
 }
 
-void handle_print(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table){
-    if (!(node->children_count == 1 && node->children[0].token_data->type == OPEN_PAREN) ||
-        !(node->children[0].children_count >=1)){
+// entry point of code generation
+void generate_mips_code(AST* ast, const char* output_filename, const CodegenOptions* options) {
+    if (!ast || ast->root == NO_NODE) {
+        fprintf(stderr, "Error: parse tree is empty.\n");
         return;
     }
 
-    append_to_buffer(buffer, 0, "# == print start ==\n");
-    struct TokenNode* open_paren = &node->children[0];
-    // exclude the closing parenthesis child at the end
-    for(int i=0; i < (open_paren->children_count-1); ++i){
-        TokenType t = open_paren->children[i].token_data->type;
-        if (t == STRING_LITERAL){
-            if (strcmp(open_paren->children[i].token_data->data, "\"\\n\"") == 0){
-                // reuse the same newline asciiz label in data section so that
-                // a ton of newlines aren't created
-                // TODO: might want to remove once/if strings become mutable
-                append_to_buffer(buffer, 0, "la $a0, newline\n");
-            }else{
-                char* label = generate_label(buffer);
-                append_to_buffer(buffer, 1, "%s: .asciiz %s\n", label, open_paren->children[i].token_data->data);
-                append_to_buffer(buffer, 0, "la $a0, %s\n", label);
-                free(label);
-            }
-            append_to_buffer(buffer, 0, "li $v0, 4\n");
-            append_to_buffer(buffer, 0, "syscall\n");
-        }else if (t == INT_LITERAL){
-            append_to_buffer(buffer, 0, "li $a0, %s\n", open_paren->children[i].token_data->data);
-            append_to_buffer(buffer, 0, "li $v0, 1\n");
-            append_to_buffer(buffer, 0, "syscall\n");
-        }else if (t == IDENTIFIER){
-            // find the string in symbol table, retrieve what the label is from data segment
-            const char* data = open_paren->children[i].token_data->data;
-            Symbol* sym = find_symbol(table, data);
-            if (!sym) return;
-            if (sym->type == STRING_TYPE){
-                append_to_buffer(buffer, 0, "la $a0, %s\n", sym->label);
-                append_to_buffer(buffer, 0, "li $v0, 4\n");
-                append_to_buffer(buffer, 0, "syscall\n");
-            }else if (sym->type == INT_TYPE){
-                append_to_buffer(buffer, 0, "la $t0, %s\n", sym->label);
-                append_to_buffer(buffer, 0, "lw $a0, 0($t0)\n");
-                append_to_buffer(buffer, 0, "li $v0, 1\n");
-                append_to_buffer(buffer, 0, "syscall\n");
-            }
-        }
-    }
-    append_to_buffer(buffer, 0, "# == print end ==\n");
+    CodeBuffer buffer;
+    generate_mips_buffer(ast, &buffer, options);
+
+    // write code from buffer to asm output file
+    write_buffer_to_file(&buffer, output_filename);
+    free_buffer(&buffer);
 }
 
-void handle_variable_declaration(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, TokenType type) {
-    // children should be: identifier, =, literal
+static void semantic_error(const AST* ast, int node, const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    compile_error("Error on line %d: %s\n", ast_token(ast, node)->line, message);
+}
 
-    // Error in syntax checks:
-    if (node->children_count != 3) {
-        fprintf(stderr, "Invalid variable declaration at line: %d\n", node->children[0].token_data->line);
-        exit(EXIT_FAILURE);
+static Symbol* lookup_variable(const AST* ast, int node, SymbolTable* table) {
+    Symbol* sym = find_symbol(table, ast->value[node]);
+    if (!sym) {
+        semantic_error(ast, node, "undefined variable '%s'", pool_string(&ast->prog->strings, ast->value[node]));
     }
-    if (node->children[0].token_data->type != IDENTIFIER) {
-        fprintf(stderr, "Expecting IDENTIFIER at line: %d\n", node->children[0].token_data->line);
-        exit(EXIT_FAILURE);
+    return sym;
+}
+
+static Symbol* lookup_int_variable(const AST* ast, int node, SymbolTable* table) {
+    Symbol* sym = lookup_variable(ast, node, table);
+    if (sym->type != INT_TYPE) {
+        semantic_error(ast, node, "'%s' must be an integer", pool_string(&ast->prog->strings, ast->value[node]));
     }
-    if (node->children[1].token_data->type != EQUAL) {
-        fprintf(stderr, "Expecting EQUAL at line: %d\n", node->children[1].token_data->line);
-        exit(EXIT_FAILURE);
+    return sym;
+}
+
+// puts a new .asciiz for a string literal node in the data segment, returns its label
+// la reg, <the string with this pool id>
+static void emit_string_address(CodeBuffer* buffer, int reg, int id) {
+    int host = buffer->literals.host[id];
+    if (buffer->literal_label[host] == NO_LABEL) {
+        buffer->literal_label[host] = host == buffer->newline_string ? LABEL_NEWLINE : generate_label(buffer);
     }
+    emit(buffer, OP_LA, reg, 0, 0, buffer->literals.offset[id], buffer->literal_label[host]);
+}
 
-    // Type specific portion of function
-    if ((type == STRING_TYPE && node->children[2].token_data->type != STRING_LITERAL) ||
-        (type == INT_TYPE && node->children[2].token_data->type != INT_LITERAL)) {
-        fprintf(stderr, "Expecting valid LITERAL for variable declaration at line: %d\n", node->children[2].token_data->line);
-        exit(EXIT_FAILURE);
+// integer result of an arithmetic operator into dest
+static void emit_arithmetic(TokenType op, int dest, int left, int right, CodeBuffer* buffer) {
+    switch (op) {
+        case PLUS: emit(buffer, OP_ADD, dest, left, right, 0, NO_LABEL); break;
+        case MINUS: emit(buffer, OP_SUB, dest, left, right, 0, NO_LABEL); break;
+        case STAR: emit(buffer, OP_MUL, dest, left, right, 0, NO_LABEL); break; // use pseudo for 32 bit maximum result
+        case SLASH:
+            emit(buffer, OP_DIV, 0, left, right, 0, NO_LABEL);
+            emit(buffer, OP_MFLO, dest, 0, 0, 0, NO_LABEL); // we will just max it to lower 32 bits of division
+            break;
+        case MODULO:
+            emit(buffer, OP_DIV, 0, left, right, 0, NO_LABEL);
+            emit(buffer, OP_MFHI, dest, 0, 0, 0, NO_LABEL);
+            break;
+        case BIT_AND: emit(buffer, OP_AND, dest, left, right, 0, NO_LABEL); break;
+        case BIT_OR: emit(buffer, OP_OR, dest, left, right, 0, NO_LABEL); break;
+        default:
+            compile_error("Unsupported arithmetic operation '%s'\n", token_type_to_string[op]);
     }
+}
+
+// ---- strength reduction ----
+// * / % by a constant, without mul or div where a cheaper sequence exists.
+// div takes tens of cycles and mult a dozen on the classic MIPS pipelines,
+// shifts and adds take one.
 
-    // Create a new label for the variable just in case the variable name is an assembly instruction
-    const char* var_name = node->children[0].token_data->data;
-    char* var_label = generate_label(buffer);
-    const char* value = node->children[2].token_data->data;
+// largest k with 2^k dividing value, for value a power of two; -1 otherwise
+static int log2_exact(unsigned value) {
+    if (value == 0 || (value & (value - 1))) return -1;
+    return __builtin_ctz(value);
+}
 
-    if (type == STRING_TYPE) {
-        add_symbol(table, var_name, var_label, STRING_TYPE, value);
-        append_to_buffer(buffer, 1, "%s: .asciiz %s\n", var_label, value);
-    } else if (type == INT_TYPE) {
-        add_symbol(table, var_name, var_label, INT_TYPE, value);
-        append_to_buffer(buffer, 1, "%s: .word %s\n", var_label, value);
+// Multiplier and shift for signed division by d, |d| >= 2, from Hacker's
+// Delight 10-1: n / d is the high word of magic * n, plus n when d > 0 and
+// the magic is negative (minus n for the opposite signs), shifted right by
+// shift and rounded towards zero by adding its sign bit.
+static int signed_magic(int d, int* shift) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned) d : (unsigned) d;
+    unsigned t = two31 + ((unsigned) d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    int p = 31;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    do {
+        ++p;
+        q1 *= 2; r1 *= 2;
+        if (r1 >= anc) { ++q1; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if (r2 >= ad) { ++q2; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *shift = p - 32;
+    int magic = (int) (q2 + 1);
+    return d < 0 ? -magic : magic;
+}
+
+// dest = src * c; scratch may be clobbered, dest may be src. Wraps around
+// with addu/subu the way mul does instead of trapping on overflow.
+static void emit_multiply_constant(CodeBuffer* buffer, int dest, int src, int c, int scratch) {
+    unsigned ac = c < 0 ? 0u - (unsigned) c : (unsigned) c;
+    int low = ac ? __builtin_ctz(ac) : 0;
+    int high = ac ? 31 - __builtin_clz(ac) : 0;
+    unsigned rest = ac - (1u << high);
+    if (ac == 0) {
+        emit(buffer, OP_MOVE, dest, REG_ZERO, 0, 0, NO_LABEL);
+        return;
+    } else if (rest == 0) {
+        // 2^a
+        if (high) emit(buffer, OP_SLL, dest, src, 0, high, NO_LABEL);
+        else if (dest != src) emit(buffer, OP_MOVE, dest, src, 0, 0, NO_LABEL);
+    } else if (log2_exact(rest) >= 0) {
+        // 2^a + 2^b
+        emit(buffer, OP_SLL, scratch, src, 0, high, NO_LABEL);
+        if (low) {
+            emit(buffer, OP_SLL, dest, src, 0, low, NO_LABEL);
+            emit(buffer, OP_ADDU, dest, scratch, dest, 0, NO_LABEL);
+        } else {
+            emit(buffer, OP_ADDU, dest, scratch, src, 0, NO_LABEL);
+        }
+    } else if (high < 31 && log2_exact(ac + (1u << low)) >= 0) {
+        // 2^a - 2^b
+        emit(buffer, OP_SLL, scratch, src, 0, high + 1, NO_LABEL);
+        if (low) {
+            emit(buffer, OP_SLL, dest, src, 0, low, NO_LABEL);
+            emit(buffer, OP_SUBU, dest, scratch, dest, 0, NO_LABEL);
+        } else {
+            emit(buffer, OP_SUBU, dest, scratch, src, 0, NO_LABEL);
+        }
     } else {
-        free(var_label);
-        fprintf(stderr, "Unknown type at line: %d\n", node->children[0].token_data->line);
-        exit(EXIT_FAILURE);
+        emit(buffer, OP_LI, scratch, 0, 0, c, NO_LABEL);
+        emit(buffer, OP_MUL, dest, src, scratch, 0, NO_LABEL);
+        return;
     }
-    free(var_label);
+    if (c < 0) emit(buffer, OP_SUBU, dest, REG_ZERO, dest, 0, NO_LABEL);
 }
 
-void evaluate_condition(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, char* false_label, char* start_body_label) {
-    if (node->token_data->type != OPEN_PAREN || node->children_count < 4) {
-        if (!(node->children_count == 2 && (node->children[0].token_data->type == TRUE 
-            || node->children[0].token_data->type == FALSE))){
-            fprintf(stderr, "No condition found in 'if' statement on line %d\n", node->token_data->line);
-            exit(EXIT_FAILURE);
+// dest = src / d rounded towards zero; d is neither 0 nor INT_MIN, dest may
+// be src or scratch1
+static void emit_divide_constant(CodeBuffer* buffer, int dest, int src, int d, int scratch1, int scratch2) {
+    unsigned ad = d < 0 ? 0u - (unsigned) d : (unsigned) d;
+    int k = log2_exact(ad);
+    if (k == 0) {
+        if (d < 0) emit(buffer, OP_SUBU, dest, REG_ZERO, src, 0, NO_LABEL);
+        else if (dest != src) emit(buffer, OP_MOVE, dest, src, 0, 0, NO_LABEL);
+        return;
+    }
+    if (k > 0) {
+        // an arithmetic shift rounds down, so negative values get 2^k - 1 added first
+        if (k == 1) {
+            emit(buffer, OP_SRL, scratch1, src, 0, 31, NO_LABEL);
+        } else {
+            emit(buffer, OP_SRA, scratch1, src, 0, 31, NO_LABEL);
+            emit(buffer, OP_SRL, scratch1, scratch1, 0, 32 - k, NO_LABEL);
         }
+        emit(buffer, OP_ADD, scratch1, src, scratch1, 0, NO_LABEL);
+        emit(buffer, OP_SRA, dest, scratch1, 0, k, NO_LABEL);
+        if (d < 0) emit(buffer, OP_SUBU, dest, REG_ZERO, dest, 0, NO_LABEL);
+        return;
     }
+    int shift;
+    int magic = signed_magic(d, &shift);
+    emit(buffer, OP_LI, scratch1, 0, 0, magic, NO_LABEL);
+    emit(buffer, OP_MULT, 0, src, scratch1, 0, NO_LABEL);
+    emit(buffer, OP_MFHI, scratch1, 0, 0, 0, NO_LABEL);
+    if (d > 0 && magic < 0) emit(buffer, OP_ADD, scratch1, scratch1, src, 0, NO_LABEL);
+    if (d < 0 && magic > 0) emit(buffer, OP_SUB, scratch1, scratch1, src, 0, NO_LABEL);
+    if (shift) emit(buffer, OP_SRA, scratch1, scratch1, 0, shift, NO_LABEL);
+    emit(buffer, OP_SRL, scratch2, scratch1, 0, 31, NO_LABEL);
+    emit(buffer, OP_ADD, dest, scratch1, scratch2, 0, NO_LABEL);
+}
 
-    struct TokenNode* condition = node->children;
-    int num_comps = node->children_count;
-
-    // handle an isolated true or false in condition
-    if (num_comps == 2 && (condition[0].token_data->type == TRUE || condition[0].token_data->type == FALSE)) {
-        if (condition[0].token_data->type == TRUE) {
-            append_to_buffer(buffer, 0, "# Condition is TRUE, always proceed\n");
-        } else if (condition[0].token_data->type == FALSE) {
-            append_to_buffer(buffer, 0, "# Condition is FALSE, always branch\n");
-            append_to_buffer(buffer, 0, "j %s\n\n", false_label);
-        }
+// dest = src % d with the sign of src; d is neither 0 nor INT_MIN, dest may be src
+static void emit_modulo_constant(CodeBuffer* buffer, int dest, int src, int d, int scratch1, int scratch2) {
+    unsigned ad = d < 0 ? 0u - (unsigned) d : (unsigned) d;
+    int k = log2_exact(ad);
+    if (k == 0) {
+        emit(buffer, OP_MOVE, dest, REG_ZERO, 0, 0, NO_LABEL);
         return;
     }
-    
-    int string_cmp = 0;
-    int i = 0;
-    int last_logic_AND = 1;
-
-    // go through all comparisons in the conditional (...), joined together by 'and's and 'or's
-    // no precedence, just evaluates left to right with short circuit
-    // Though note that OR's require checking every outcome
-    while (i < num_comps - 1) {
-        struct TokenNode* left = &condition[i];
-        struct TokenNode* comparator = NULL;
-        struct TokenNode* right = NULL;
-        if (left->token_data->type == TRUE || left->token_data->type == FALSE){
-            generate_operand_code(left, buffer, table, &string_cmp, 0);
-        }else if (i + 2 < num_comps - 1){
-            comparator = &condition[i + 1];
-            right = &condition[i + 2];
-            generate_operand_code(left, buffer, table, &string_cmp, 0);
-            generate_operand_code(right, buffer, table, &string_cmp, 1);
-            generate_comparator_code(comparator->token_data->type, buffer, string_cmp);
-            printf("Comparing %s and %s, with %s\n", left->token_data->data, right->token_data->data, comparator->token_data->data);
-        }else{
-            fprintf(stderr, "Missing comparator and operand two in condition on line %d\n", node->token_data->line);
-            exit(EXIT_FAILURE);
+    if (k > 0) {
+        // bias negative values by 2^k - 1, mask, and take the bias back off
+        if (k == 1) {
+            emit(buffer, OP_SRL, scratch1, src, 0, 31, NO_LABEL);
+        } else {
+            emit(buffer, OP_SRA, scratch1, src, 0, 31, NO_LABEL);
+            emit(buffer, OP_SRL, scratch1, scratch1, 0, 32 - k, NO_LABEL);
+        }
+        emit(buffer, OP_ADD, scratch2, src, scratch1, 0, NO_LABEL);
+        if (k <= 16) {
+            emit(buffer, OP_ANDI, scratch2, scratch2, 0, (int) ad - 1, NO_LABEL);
+        } else {
+            emit(buffer, OP_SLL, scratch2, scratch2, 0, 32 - k, NO_LABEL);
+            emit(buffer, OP_SRL, scratch2, scratch2, 0, 32 - k, NO_LABEL);
         }
+        emit(buffer, OP_SUB, dest, scratch2, scratch1, 0, NO_LABEL);
+        return;
+    }
+    // n - (n / d) * d
+    emit_divide_constant(buffer, scratch1, src, d, scratch1, scratch2);
+    emit_multiply_constant(buffer, scratch1, scratch1, d, scratch2);
+    emit(buffer, OP_SUB, dest, src, scratch1, 0, NO_LABEL);
+}
 
-        // handle AND, OR, conjunctions
-        // if (x != y and i == k)
-        int increment = comparator == NULL ? 1 : 3;
-        if (i + increment < num_comps - 1) {
-            struct TokenNode* op = &condition[i + increment];
-            if (op->token_data->type == LOGIC_AND) {
-                append_to_buffer(buffer, 0, "beq $v0, $zero, %s\n", false_label);
-                last_logic_AND = 1;
-            } else if (op->token_data->type == LOGIC_OR) {
-                append_to_buffer(buffer, 0, "bne $v0, $zero, %s\n", start_body_label);
-                last_logic_AND = 0;
+// Matches an arithmetic node with a constant operand it can strength reduce,
+// returning the constant and the other operand.
+static int constant_operand(const AST* ast, int node, int* operand, int* constant) {
+    TokenType op = ast->op[node];
+    int left = ast_child(ast, node, 0);
+    int right = ast_child(ast, node, 1);
+    if (op != STAR && op != SLASH && op != MODULO) return 0;
+    if (ast->kind[right] == NODE_INT) {
+        *operand = left;
+        *constant = ast->value[right];
+    } else if (op == STAR && ast->kind[left] == NODE_INT) {
+        *operand = right;
+        *constant = ast->value[left];
+    } else {
+        return 0;
+    }
+    // leave the undefined divisions to the hardware
+    return op == STAR || (*constant != 0 && *constant != INT_MIN);
+}
+
+static void emit_constant_arithmetic(TokenType op, int dest, int src, int constant, int scratch1, int scratch2, CodeBuffer* buffer) {
+    switch (op) {
+        case STAR: emit_multiply_constant(buffer, dest, src, constant, scratch1); break;
+        case SLASH: emit_divide_constant(buffer, dest, src, constant, scratch1, scratch2); break;
+        default: emit_modulo_constant(buffer, dest, src, constant, scratch1, scratch2); break;
+    }
+}
+
+// a variable or constant that can be used where it is, without evaluating it
+// into a temporary first
+static int in_place_register(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    if (ast->kind[node] == NODE_INT && ast->value[node] == 0) return REG_ZERO;
+    if (buffer->induction_reg && buffer->induction_reg[node]) return buffer->induction_reg[node];
+    if (ast->kind[node] == NODE_VAR) {
+        Symbol* sym = lookup_int_variable(ast, node, table);
+        if (sym->reg) return sym->reg;
+    }
+    return -1;
+}
+
+// Evaluates an integer expression into dest, using $t<reg> and the registers
+// above it for intermediate results. Once $t7 is reached the left operand
+// waits on the stack and $t8 carries the right one.
+void generate_expression_to(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int dest, int reg) {
+    if (buffer->induction_reg && buffer->induction_reg[node]) {
+        emit(buffer, OP_MOVE, dest, buffer->induction_reg[node], 0, 0, NO_LABEL);
+        return;
+    }
+    switch (ast->kind[node]) {
+        case NODE_INT:
+            emit(buffer, OP_LI, dest, 0, 0, ast->value[node], NO_LABEL);
+            break;
+        case NODE_VAR: {
+            Symbol* sym = lookup_int_variable(ast, node, table);
+            if (sym->reg) {
+                emit(buffer, OP_MOVE, dest, sym->reg, 0, 0, NO_LABEL);
+            } else if (sym->frame_offset >= 0) {
+                emit(buffer, OP_LW, dest, REG_FP, 0, sym->frame_offset, NO_LABEL);
+            } else {
+                emit(buffer, OP_LA, dest, 0, 0, 0, sym->label);
+                emit(buffer, OP_LW, dest, dest, 0, 0, NO_LABEL);
             }
-        } else {
-            if (last_logic_AND) {
-                append_to_buffer(buffer, 0, "beq $v0, $zero, %s\n", false_label);
-            }else{
-                append_to_buffer(buffer, 0, "bne $v0, $zero, %s\n", start_body_label);
+            break;
+        }
+        case NODE_BINOP: {
+            int left = ast_child(ast, node, 0);
+            int right = ast_child(ast, node, 1);
+            int operand, constant;
+            if (buffer->strength_reduce && constant_operand(ast, node, &operand, &constant)) {
+                // the constant needs no register, past $t7 the scratch is $t8/$t9
+                int src = generate_operand(ast, operand, buffer, table, reg);
+                int scratch1 = reg + 1 <= MAX_EXPRESSION_REG ? REG_T(reg + 1) : REG_T8;
+                int scratch2 = reg + 2 <= MAX_EXPRESSION_REG ? REG_T(reg + 2) : REG_T9;
+                emit_constant_arithmetic(ast->op[node], dest, src, constant, scratch1, scratch2, buffer);
+            } else if (reg < MAX_EXPRESSION_REG) {
+                int left_reg = generate_operand(ast, left, buffer, table, reg);
+                int right_reg = generate_operand(ast, right, buffer, table, reg + 1);
+                emit_arithmetic(ast->op[node], dest, left_reg, right_reg, buffer);
+            } else if (in_place_register(ast, left, buffer, table) >= 0) {
+                // nothing of the left operand to keep safe while the right one is evaluated
+                int right_reg = generate_operand(ast, right, buffer, table, reg);
+                emit_arithmetic(ast->op[node], dest, in_place_register(ast, left, buffer, table), right_reg, buffer);
+            } else {
+                int temp = REG_T(reg);
+                generate_expression(ast, left, buffer, table, reg);
+                emit(buffer, OP_ADDI, REG_SP, REG_SP, 0, -4, NO_LABEL);
+                emit(buffer, OP_SW, temp, REG_SP, 0, 0, NO_LABEL);
+                int right_reg = generate_operand(ast, right, buffer, table, reg);
+                emit(buffer, OP_MOVE, REG_T8, right_reg, 0, 0, NO_LABEL);
+                emit(buffer, OP_LW, temp, REG_SP, 0, 0, NO_LABEL);
+                emit(buffer, OP_ADDI, REG_SP, REG_SP, 0, 4, NO_LABEL);
+                emit_arithmetic(ast->op[node], dest, temp, REG_T8, buffer);
             }
             break;
         }
-        i += (increment + 1);
+        default:
+            semantic_error(ast, node, "expected an integer expression");
+    }
+}
+
+void generate_expression(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int reg) {
+    generate_expression_to(ast, node, buffer, table, REG_T(reg), reg);
+}
+
+// Returns the register holding the value of an integer expression: the
+// variable's own register when it has one, $zero for 0, otherwise $t<reg>
+// after evaluating the expression into it.
+int generate_operand(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int reg) {
+    int in_place = in_place_register(ast, node, buffer, table);
+    if (in_place >= 0) return in_place;
+    generate_expression(ast, node, buffer, table, reg);
+    return REG_T(reg);
+}
+
+// a string operand of a comparison is a string variable or literal
+static int is_string_operand(const AST* ast, int node, SymbolTable* table) {
+    if (ast->kind[node] == NODE_STRING) return 1;
+    if (ast->kind[node] == NODE_VAR) return lookup_variable(ast, node, table)->type == STRING_TYPE;
+    return 0;
+}
+
+// pool id of the literal a string operand stands for
+static int string_operand_id(const AST* ast, int node, SymbolTable* table) {
+    return ast->kind[node] == NODE_STRING ? ast->value[node] : lookup_variable(ast, node, table)->value;
+}
+
+// Lays the hosts of two literals out in whole words when both start on a
+// word boundary of their host. Returns whether they do.
+static int align_literals(CodeBuffer* buffer, int a, int b) {
+    const LiteralLayout* literals = &buffer->literals;
+    if (literals->offset[a] % 4 || literals->offset[b] % 4) return 0;
+    buffer->literal_aligned[literals->host[a]] = buffer->literal_aligned[literals->host[b]] = 1;
+    return 1;
+}
+
+// Equality of two literals whose lengths are known: different lengths, or
+// the very same bytes, decide it at compile time, short ones are compared
+// inline a word at a time. Control reaches label when the strings are equal
+// as jump_if_equal says. Returns 0 to leave the test to strcmp.
+static int emit_string_equality(CodeBuffer* buffer, int a, int b, int jump_if_equal, int label) {
+    const LiteralLayout* literals = &buffer->literals;
+    int length = literals->length[a];
+    if (length < 0 || literals->length[b] < 0) return 0;
+    int same = literals->host[a] == literals->host[b] && literals->offset[a] == literals->offset[b];
+    if (same || length != literals->length[b]) {
+        if (same == jump_if_equal) emit(buffer, OP_J, 0, 0, 0, 0, label);
+        return 1;
+    }
+
+    // the word holding the terminator is zero padded, so it compares whole
+    int words = length / 4 + 1;
+    if (words > STRING_COMPARE_WORDS || !align_literals(buffer, a, b)) return 0;
+    emit_string_address(buffer, REG_A0, a);
+    emit_string_address(buffer, REG_A1, b);
+    int differ = jump_if_equal ? generate_label(buffer) : label;
+    for (int k = 0; k < words; ++k) {
+        emit(buffer, OP_LW, REG_T8, REG_A0, 0, 4 * k, NO_LABEL);
+        emit(buffer, OP_LW, REG_T9, REG_A1, 0, 4 * k, NO_LABEL);
+        emit(buffer, OP_BNE, 0, REG_T8, REG_T9, 0, differ);
     }
-    // if we ended on or, and it fails, we should jump over the body
-    if (!last_logic_AND){
-        append_to_buffer(buffer, 0, "j %s\n", false_label);
+    if (jump_if_equal) {
+        emit(buffer, OP_J, 0, 0, 0, 0, label);
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, differ);
     }
+    return 1;
 }
 
-void generate_operand_code(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, int* string_cmp, int is_right) {
-    if (node->token_data->type == TRUE) {
-        append_to_buffer(buffer, 0, "li $v0, 1\n");
-    } else if (node->token_data->type == FALSE) {
-        append_to_buffer(buffer, 0, "li $v0, 0\n");
-    } else if (node->token_data->type == IDENTIFIER) {
-        Symbol* sym = find_symbol(table, node->token_data->data);
-        if (!sym) {
-            fprintf(stderr, "Undefined variable '%s' in condition.\n", node->token_data->data);
-            exit(EXIT_FAILURE);
+static Opcode branch_opcode(TokenType comparator, int jump_if) {
+    switch (comparator) {
+        case EQUAL_EQUAL: return jump_if ? OP_BEQ : OP_BNE;
+        case BANG_EQUAL: return jump_if ? OP_BNE : OP_BEQ;
+        case LESS: return jump_if ? OP_BLT : OP_BGE;
+        case LESS_EQUAL: return jump_if ? OP_BLE : OP_BGT;
+        case GREATER: return jump_if ? OP_BGT : OP_BLE;
+        case GREATER_EQUAL: return jump_if ? OP_BGE : OP_BLT;
+        default:
+            compile_error("Unsupported comparator '%s' in condition.\n", token_type_to_string[comparator]);
+    }
+}
+
+// Jumping code for a condition: control reaches label when the condition
+// evaluates to jump_if and falls through otherwise. and/or short circuit, and
+// no truth value is ever materialized in a register.
+void generate_branch(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int label, int jump_if) {
+    if (ast->kind[node] == NODE_BOOL) {
+        if (ast->value[node] == jump_if) {
+            emit(buffer, OP_J, 0, 0, 0, 0, label);
         }
-        if (sym->type == INT_TYPE) {
-            append_to_buffer(buffer, 0, "la $t%d, %s\n", is_right ? 2 : 1, sym->label);
-            append_to_buffer(buffer, 0, "lw $t%d, 0($t%d)\n", is_right ? 1 : 0, is_right ? 2 : 1);
-        } else if (sym->type == STRING_TYPE) {
-            *string_cmp = 1;
-            append_to_buffer(buffer, 0, "la $a%d, %s\n", is_right ? 1 : 0, sym->label);
+        return;
+    }
+
+    if (ast->kind[node] == NODE_BINOP && (ast->op[node] == LOGIC_AND || ast->op[node] == LOGIC_OR)) {
+        int left = ast_child(ast, node, 0);
+        int right = ast_child(ast, node, 1);
+        // "a and b" jumps on false as soon as a is false, "a or b" jumps on
+        // true as soon as a is true; otherwise b decides
+        int short_circuit = ast->op[node] == LOGIC_OR;
+        if (jump_if == short_circuit) {
+            generate_branch(ast, left, buffer, table, label, jump_if);
+            generate_branch(ast, right, buffer, table, label, jump_if);
         } else {
-            fprintf(stderr, "Unsupported variable type '%s' in condition.\n", node->token_data->data);
-            exit(EXIT_FAILURE);
+            int skip = generate_label(buffer);
+            generate_branch(ast, left, buffer, table, skip, short_circuit);
+            generate_branch(ast, right, buffer, table, label, jump_if);
+            emit(buffer, OP_LABEL, 0, 0, 0, 0, skip);
+        }
+        return;
+    }
+
+    if (!is_condition_node(ast, node)) {
+        // a plain integer expression is true when it is not zero
+        int value = generate_operand(ast, node, buffer, table, 0);
+        emit(buffer, jump_if ? OP_BNE : OP_BEQ, 0, value, REG_ZERO, 0, label);
+        return;
+    }
+
+    int left = ast_child(ast, node, 0);
+    int right = ast_child(ast, node, 1);
+    int left_string = is_string_operand(ast, left, table);
+    int right_string = is_string_operand(ast, right, table);
+    if (left_string != right_string) {
+        semantic_error(ast, node, "cannot compare a string with an integer");
+    }
+    Opcode branch = branch_opcode(ast->op[node], jump_if);
+    if (left_string) {
+        int left_id = string_operand_id(ast, left, table);
+        int right_id = string_operand_id(ast, right, table);
+        TokenType op = ast->op[node];
+        if ((op == EQUAL_EQUAL || op == BANG_EQUAL)
+            && emit_string_equality(buffer, left_id, right_id, op == EQUAL_EQUAL ? jump_if : !jump_if, label)) {
+            return;
         }
-    } else if (node->token_data->type == INT_LITERAL) {
-        append_to_buffer(buffer, 0, "li $t%d, %s\n", is_right ? 1 : 0, node->token_data->data);
-    } else if (node->token_data->type == STRING_LITERAL) {
-        *string_cmp = 1;
-        char* label = generate_label(buffer);
-        append_to_buffer(buffer, 1, "%s: .asciiz %s\n", label, node->token_data->data);
-        append_to_buffer(buffer, 0, "la $a%d, %s\n", is_right ? 1 : 0, label);
-        free(label);
+        // strcmp takes a word at a time when both are aligned
+        align_literals(buffer, left_id, right_id);
+        emit_string_address(buffer, REG_A0, left_id);
+        emit_string_address(buffer, REG_A1, right_id);
+        emit(buffer, OP_JAL, 0, 0, 0, 0, LABEL_STRCMP);
+        emit(buffer, branch, 0, REG_V0, REG_ZERO, 0, label);
     } else {
-        fprintf(stderr, "Unsupported operand type in condition.\n");
-        exit(EXIT_FAILURE);
+        int left_reg = generate_operand(ast, left, buffer, table, 0);
+        int right_reg = generate_operand(ast, right, buffer, table, 1);
+        emit(buffer, branch, 0, left_reg, right_reg, 0, label);
     }
 }
 
-void generate_comparator_code(TokenType comparator_type, CodeBuffer* buffer, int string_cmp) {
-    if (string_cmp) {
-        append_to_buffer(buffer, 0, "jal strcmp\n");
+// ---- name checks ----
+// The errors generation gives for the names a statement uses, without
+// generating it. -O1 runs them over the whole tree before folding drops dead
+// code, so that the optimization level doesn't change what compiles.
+
+static void check_value(const AST* ast, int node, SymbolTable* table) {
+    if (ast->kind[node] == NODE_VAR) {
+        lookup_int_variable(ast, node, table);
+    } else if (ast->kind[node] == NODE_BINOP) {
+        check_value(ast, ast_child(ast, node, 0), table);
+        check_value(ast, ast_child(ast, node, 1), table);
     }
-    switch (comparator_type) {
-        case EQUAL_EQUAL:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "seq $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "seq $v0, $t0, $t1\n"); // $t0 = ($t0 == $t1)
-            }
-            break;
-        case BANG_EQUAL:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "sne $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "sne $v0, $t0, $t1\n"); // $t0 = ($t0 != $t1)
-            }
-            break;
-        case GREATER:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "sgt $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "sgt $v0, $t0, $t1\n"); // $t0 = ($t0 > $t1)
+}
+
+static void check_condition(const AST* ast, int node, SymbolTable* table) {
+    if (ast->kind[node] == NODE_BOOL) return;
+    if (!is_condition_node(ast, node)) {
+        check_value(ast, node, table);
+        return;
+    }
+    int left = ast_child(ast, node, 0);
+    int right = ast_child(ast, node, 1);
+    if (ast->op[node] == LOGIC_AND || ast->op[node] == LOGIC_OR) {
+        check_condition(ast, left, table);
+        check_condition(ast, right, table);
+        return;
+    }
+    int left_string = is_string_operand(ast, left, table);
+    if (left_string != is_string_operand(ast, right, table)) {
+        semantic_error(ast, node, "cannot compare a string with an integer");
+    }
+    if (!left_string) {
+        check_value(ast, left, table);
+        check_value(ast, right, table);
+    }
+}
+
+void check_names(const AST* ast, int node, SymbolTable* table) {
+    switch (ast->kind[node]) {
+        case NODE_FUNCTION:
+            // the function's statements share its scope, as in handle_function
+            for (int stmt = ast->first_child[ast->first_child[node]]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]) {
+                check_names(ast, stmt, table);
             }
-            break;
-        case GREATER_EQUAL:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "sge $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "sge $v0, $t0, $t1\n"); // $t0 = ($t0 >= $t1)
+            return;
+        case NODE_BLOCK:
+            push_scope(table);
+            for (int stmt = ast->first_child[node]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]) {
+                check_names(ast, stmt, table);
             }
-            break;
-        case LESS:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "slt $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "slt $v0, $t0, $t1\n"); // $t0 = ($t0 < $t1)
+            pop_scope(table);
+            return;
+        case NODE_VAR_DECL:
+            if (!add_symbol(table, ast->value[node], NO_LABEL, ast->op[node], ast->value[ast->first_child[node]])) {
+                semantic_error(ast, node, "symbol '%s' already declared", pool_string(&ast->prog->strings, ast->value[node]));
             }
-            break;
-        case LESS_EQUAL:
-            if (string_cmp){
-                append_to_buffer(buffer, 0, "sle $v0, $v0, $zero\n");
-            }else{
-                append_to_buffer(buffer, 0, "sle $v0, $t0, $t1\n"); // $t0 = ($t0 <= $t1)
+            return;
+        case NODE_ASSIGN:
+            lookup_int_variable(ast, node, table);
+            check_value(ast, ast->first_child[node], table);
+            return;
+        case NODE_PRINT:
+            for (int item = ast->first_child[node]; item != NO_NODE; item = ast->next_sibling[item]) {
+                if (ast->kind[item] == NODE_VAR) lookup_variable(ast, item, table);
+                else check_value(ast, item, table);
             }
-            break;
+            return;
+        case NODE_RETURN:
+            check_value(ast, ast->first_child[node], table);
+            return;
+        case NODE_IF:
+        case NODE_WHILE:
+            check_condition(ast, ast_child(ast, node, 0), table);
+            check_names(ast, ast_child(ast, node, 1), table);
+            return;
+        case NODE_FOR:
+            push_scope(table);
+            check_names(ast, ast_child(ast, node, 0), table);
+            check_condition(ast, ast_child(ast, node, 1), table);
+            check_names(ast, ast_child(ast, node, 3), table);
+            check_names(ast, ast_child(ast, node, 2), table);
+            pop_scope(table);
+            return;
         default:
-            fprintf(stderr, "Unsupported comparator '%s' in condition.\n", token_type_to_string[comparator_type]);
-            exit(EXIT_FAILURE);
+            return;
     }
 }
 
-void handle_if_statement(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table) {
-    if (node->children_count < 2 || node->children[0].token_data->type != OPEN_PAREN ||
-        node->children[1].token_data->type != OPEN_BRACE || node->children[1].children_count == 1) return;
+// Prints go through the buffered output routines of util/print.asm, the
+// buffer is written out when it fills up and at the return.
+void handle_print(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table){
+    if (ast->first_child[node] == NO_NODE) return;
+
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_PRINT_START, NO_LABEL);
+    for (int item = ast->first_child[node]; item != NO_NODE; item = ast->next_sibling[item]){
+        int label = LABEL_PRINT_INT;
+        switch (ast->kind[item]) {
+            case NODE_STRING:
+                emit_string_address(buffer, REG_A0, ast->value[item]);
+                label = LABEL_PRINT_STRING;
+                break;
+            case NODE_INT:
+                emit(buffer, OP_LI, REG_A0, 0, 0, ast->value[item], NO_LABEL);
+                break;
+            case NODE_VAR: {
+                // find the string in symbol table, retrieve what the label is from data segment
+                Symbol* sym = lookup_variable(ast, item, table);
+                if (sym->type == STRING_TYPE){
+                    emit_string_address(buffer, REG_A0, sym->value);
+                    label = LABEL_PRINT_STRING;
+                }else{
+                    generate_expression_to(ast, item, buffer, table, REG_A0, 0);
+                }
+                break;
+            }
+            default:
+                generate_expression_to(ast, item, buffer, table, REG_A0, 0);
+                break;
+        }
+        emit(buffer, OP_JAL, 0, 0, 0, 0, label);
+    }
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_PRINT_END, NO_LABEL);
+}
+
+void handle_variable_declaration(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    TokenType type = ast->op[node];
+    int literal = ast->first_child[node];
+
+    int reg = 0;
+    int frame_offset = -1;
+    int unused = 0;
+    if (buffer->alloc && type == INT_TYPE) {
+        reg = buffer->alloc->reg[node];
+        frame_offset = buffer->alloc->frame_offset[node];
+        // nothing reads or assigns it once folded, so it is not stored anywhere
+        unused = !reg && frame_offset < 0;
+    }
 
-    append_to_buffer(buffer, 0, "# == if-conditional start ==\n");
+    // Create a new label for the variable just in case the variable name is an assembly instruction.
+    // Strings can't be assigned, so a string variable is just its literal's address.
+    int var_label = type == STRING_TYPE || reg || frame_offset >= 0 || unused ? NO_LABEL : generate_label(buffer);
 
-    // list of condition
-    char* false_label = generate_label(buffer);
-    char* start_body_label = generate_label(buffer);
-    evaluate_condition(&node->children[0], buffer, table, false_label, start_body_label);
+    // int symbols remember their initial value, string symbols the literal's pool id
+    Symbol* sym = add_symbol(table, ast->value[node], var_label, type, ast->value[literal]);
+    if (!sym) {
+        semantic_error(ast, node, "symbol '%s' already declared", pool_string(&ast->prog->strings, ast->value[node]));
+    }
+    sym->reg = reg;
+    sym->frame_offset = frame_offset;
+    if (unused) return;
+
+    int value = ast->value[literal];
+    if (reg) {
+        emit(buffer, OP_LI, reg, 0, 0, value, NO_LABEL);
+        return;
+    }
+    if (frame_offset >= 0) {
+        int source = generate_operand(ast, literal, buffer, table, 0);
+        emit(buffer, OP_SW, source, REG_FP, 0, frame_offset, NO_LABEL);
+        return;
+    }
+
+    if (type == STRING_TYPE) return;
+    emit_data(buffer, OP_WORD, var_label, value);
+    // the .word only initializes the first time round a loop
+    if (buffer->loop_depth > 0) {
+        int source = generate_operand(ast, literal, buffer, table, 0);
+        emit(buffer, OP_LA, REG_T(1), 0, 0, 0, var_label);
+        emit(buffer, OP_SW, source, REG_T(1), 0, 0, NO_LABEL);
+    }
+}
+
+// x = <integer expression>, which is what the prefix operations parse into
+void handle_assignment(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    Symbol* sym = lookup_int_variable(ast, node, table);
+    int value = ast->first_child[node];
+    if (sym->reg) {
+        generate_expression_to(ast, value, buffer, table, sym->reg, 0);
+        return;
+    }
+    int source = generate_operand(ast, value, buffer, table, 0);
+    if (sym->frame_offset >= 0) {
+        emit(buffer, OP_SW, source, REG_FP, 0, sym->frame_offset, NO_LABEL);
+    } else {
+        emit(buffer, OP_LA, REG_T(1), 0, 0, 0, sym->label);
+        emit(buffer, OP_SW, source, REG_T(1), 0, 0, NO_LABEL);
+    }
+}
 
-    append_to_buffer(buffer, 0, "%s:\n", start_body_label);
-    struct TokenNode* body = &node->children[1];
-    for (int i=0; i<body->children_count-1; ++i){
-        // gen code for the body of the if statement
-        generate_code(&body->children[i], buffer, table);
+void handle_block(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    push_scope(table);
+    for (int stmt = ast->first_child[node]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]){
+        generate_code(ast, stmt, buffer, table);
     }
+    pop_scope(table);
+}
+
+void handle_if_statement(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    int condition = ast_child(ast, node, 0);
+    int body = ast_child(ast, node, 1);
+
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_IF_START, NO_LABEL);
+    int false_label = generate_label(buffer);
+    generate_branch(ast, condition, buffer, table, false_label, 0);
+
+    handle_block(ast, body, buffer, table);
 
     // label for skipping the body
-    append_to_buffer(buffer, 0, "# == if-conditional end ==\n");
-    append_to_buffer(buffer, 0, "%s:\n", false_label);
-    free(false_label);
-    free(start_body_label);
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_IF_END, NO_LABEL);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, false_label);
+}
+
+// copies of a loop's body, each followed by the step of a for and the
+// updates of the registers carrying induction products
+static void emit_loop_copies(const AST* ast, int body, int step, int copies, const int* regs, const int* increments,
+                             int products, CodeBuffer* buffer, SymbolTable* table) {
+    ++buffer->loop_depth;
+    for (int i = 0; i < copies; ++i) {
+        handle_block(ast, body, buffer, table);
+        generate_code(ast, step, buffer, table);
+        for (int p = 0; p < products; ++p) emit(buffer, OP_ADDIU, regs[p], regs[p], 0, increments[p], NO_LABEL);
+    }
+    --buffer->loop_depth;
 }
 
-void handle_while_loop(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table){
-    if (node->children_count < 2 || node->children[0].token_data->type != OPEN_PAREN ||
-        node->children[1].token_data->type != OPEN_BRACE || node->children[1].children_count == 1) return;
+// instructions one copy takes, found by generating it and throwing it away;
+// the labels it took stay taken, literals may have been given theirs
+static int loop_copy_size(const AST* ast, int body, int step, CodeBuffer* buffer, SymbolTable* table) {
+    int body_count = buffer->body_count;
+    int data_count = buffer->data_count;
+    emit_loop_copies(ast, body, step, 1, NULL, NULL, 0, buffer, table);
+    int size = 0;
+    for (int i = body_count; i < buffer->body_count; ++i) {
+        if (buffer->body[i].op != OP_LABEL && buffer->body[i].op != OP_COMMENT) ++size;
+    }
+    buffer->body_count = body_count;
+    buffer->data_count = data_count;
+    return size;
+}
 
-    append_to_buffer(buffer, 0, "# == while-conditional start ==\n");
+// With -funroll=N, a loop whose trip count constant folding worked out runs
+// N copies of its body per test of the condition, after the trip count
+// modulo N copies peeled off in front; one that runs at most N times is
+// unrolled completely. Fewer copies are made when N of them would not fit
+// in UNROLL_MAX_INSTRUCTIONS. Returns the copies per test, 0 when the loop
+// is left alone.
+static int unroll_factor(const AST* ast, int node, int body, int step, CodeBuffer* buffer, SymbolTable* table) {
+    int trips = ast->value[node];
+    if (buffer->unroll < 2 || trips <= 0) return 0;
+    int size = loop_copy_size(ast, body, step, buffer, table);
+    int copies = buffer->unroll;
+    if (size > 0 && copies > UNROLL_MAX_INSTRUCTIONS / size) copies = UNROLL_MAX_INSTRUCTIONS / size;
+    if (trips <= copies) return trips;
+    while (copies >= 2 && (long long) (copies + trips % copies) * size > UNROLL_MAX_INSTRUCTIONS) --copies;
+    return copies >= 2 ? copies : 0;
+}
 
-    // list of condition
-    char* loop_label = generate_label(buffer);
-    append_to_buffer(buffer, 0, "%s:\n", loop_label);
+// Emits a loop unrolled by unroll_factor. Returns the head of the loop that
+// is left, for the caller to close with the exit test, or NO_LABEL when the
+// loop is gone. There is no guard: the loop runs more than copies times.
+static int emit_unrolled(const AST* ast, int node, int body, int step, int copies, const int* regs,
+                         const int* increments, int products, CodeBuffer* buffer, SymbolTable* table) {
+    int trips = ast->value[node];
+    if (trips <= copies) {
+        emit_loop_copies(ast, body, step, trips, regs, increments, products, buffer, table);
+        return NO_LABEL;
+    }
+    emit_loop_copies(ast, body, step, trips % copies, regs, increments, products, buffer, table);
+    int top_label = generate_label(buffer);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, top_label);
+    emit_loop_copies(ast, body, step, copies, regs, increments, products, buffer, table);
+    return top_label;
+}
 
-    char* false_label = generate_label(buffer);
-    char* start_body_label = generate_label(buffer);
-    evaluate_condition(&node->children[0], buffer, table, false_label, start_body_label);
+void handle_while_loop(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table){
+    int condition = ast_child(ast, node, 0);
+    int body = ast_child(ast, node, 1);
 
-    append_to_buffer(buffer, 0, "%s:\n", start_body_label);
-    struct TokenNode* body = &node->children[1];
-    for (int i=0; i<body->children_count-1; ++i){
-        // gen code for the body of the if statement
-        generate_code(&body->children[i], buffer, table);
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_WHILE_START, NO_LABEL);
+    int copies = buffer->opt_level >= 1 ? unroll_factor(ast, node, body, NO_NODE, buffer, table) : 0;
+    if (copies) {
+        int top_label = emit_unrolled(ast, node, body, NO_NODE, copies, NULL, NULL, 0, buffer, table);
+        if (top_label != NO_LABEL) generate_branch(ast, condition, buffer, table, top_label, 1);
+        emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_WHILE_END, NO_LABEL);
+        return;
+    }
+    if (buffer->opt_level >= 1) {
+        // rotated into a do-while behind a guard: one branch per iteration
+        // instead of a test at the top and a jump at the bottom
+        int exit_label = generate_label(buffer);
+        if (!ast->value[node]) generate_branch(ast, condition, buffer, table, exit_label, 0);
+        int top_label = generate_label(buffer);
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, top_label);
+
+        ++buffer->loop_depth;
+        handle_block(ast, body, buffer, table);
+        --buffer->loop_depth;
+
+        generate_branch(ast, condition, buffer, table, top_label, 1);
+        emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_WHILE_END, NO_LABEL);
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, exit_label);
+        return;
     }
+    int loop_label = generate_label(buffer);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, loop_label);
+
+    int false_label = generate_label(buffer);
+    generate_branch(ast, condition, buffer, table, false_label, 0);
+
+    ++buffer->loop_depth;
+    handle_block(ast, body, buffer, table);
+    --buffer->loop_depth;
 
     // looping
-    append_to_buffer(buffer, 0, "j %s\n", loop_label);
+    emit(buffer, OP_J, 0, 0, 0, 0, loop_label);
 
-    append_to_buffer(buffer, 0, "# == while-conditional loop/end ==\n");
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_WHILE_END, NO_LABEL);
     // label for skipping the body
-    append_to_buffer(buffer, 0, "%s:\n", false_label);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, false_label);
+}
 
-    free(loop_label);
-    free(false_label);
-    free(start_body_label);
+// whether anything under node declares, assigns or, with reads, reads name
+static int mentions_name(const AST* ast, int node, int name, int reads) {
+    NodeKind kind = ast->kind[node];
+    if ((kind == NODE_VAR_DECL || kind == NODE_ASSIGN || (reads && kind == NODE_VAR)) && ast->value[node] == name) {
+        return 1;
+    }
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        if (mentions_name(ast, child, name, reads)) return 1;
+    }
+    return 0;
 }
 
-// operations such as plus, plus_equal, etc, are terminated by semicolon
-void handle_int_operations(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table) {
-    if (node->children_count < 3 || node->children_count > 4) {
-        fprintf(stderr, "Invalid integer operation '%s' on line: %d\n", node->token_data->data, node->token_data->line);
-        exit(EXIT_FAILURE);
+// An int variable in a register that the step of a for loop moves by a
+// constant and nothing else in the loop assigns, compared against a bound
+// the loop does not change.
+typedef struct {
+    int name;
+    int reg;
+    int step;
+    TokenType compare; // normalized to "variable compare bound"
+    int bound;         // node of the bound
+} Induction;
+
+static int find_induction(const AST* ast, int node, SymbolTable* table, Induction* iv) {
+    int condition = ast_child(ast, node, 1);
+    int step = ast_child(ast, node, 2);
+    int body = ast_child(ast, node, 3);
+
+    int name = ast->value[step];
+    int value = ast->first_child[step];
+    if (ast->kind[value] != NODE_BINOP) return 0;
+    TokenType op = ast->op[value];
+    int left = ast_child(ast, value, 0);
+    int right = ast_child(ast, value, 1);
+    if (op == PLUS && ast->kind[left] == NODE_INT) {
+        int swap = left;
+        left = right;
+        right = swap;
+    }
+    if ((op != PLUS && op != MINUS) || ast->kind[left] != NODE_VAR || ast->value[left] != name ||
+        ast->kind[right] != NODE_INT || ast->value[right] == 0 || ast->value[right] == INT_MIN) return 0;
+    iv->step = op == PLUS ? ast->value[right] : -ast->value[right];
+    iv->name = name;
+
+    Symbol* sym = find_symbol(table, name);
+    if (!sym || sym->type != INT_TYPE || !sym->reg || mentions_name(ast, body, name, 0)) return 0;
+    iv->reg = sym->reg;
+
+    if (ast->kind[condition] != NODE_BINOP || !is_condition_node(ast, condition) ||
+        ast->op[condition] == LOGIC_AND || ast->op[condition] == LOGIC_OR) return 0;
+    static const TokenType mirrored[] = {
+        [LESS] = GREATER, [LESS_EQUAL] = GREATER_EQUAL, [GREATER] = LESS, [GREATER_EQUAL] = LESS_EQUAL,
+        [EQUAL_EQUAL] = EQUAL_EQUAL, [BANG_EQUAL] = BANG_EQUAL,
+    };
+    left = ast_child(ast, condition, 0);
+    right = ast_child(ast, condition, 1);
+    iv->compare = ast->op[condition];
+    if (ast->kind[right] == NODE_VAR && ast->value[right] == name) {
+        int swap = left;
+        left = right;
+        right = swap;
+        iv->compare = mirrored[iv->compare];
     }
+    if (ast->kind[left] != NODE_VAR || ast->value[left] != name) return 0;
+    iv->bound = right;
+    if (ast->kind[right] == NODE_INT) return 1;
+    if (ast->kind[right] != NODE_VAR || ast->value[right] == name) return 0;
+    Symbol* bound = find_symbol(table, ast->value[right]);
+    return bound && bound->type == INT_TYPE && !mentions_name(ast, body, ast->value[right], 0);
+}
 
-    struct TokenNode* var = &node->children[0];
-    struct TokenNode* operand_one = &node->children[1];
-    struct TokenNode* operand_two = (node->children_count == 4) ? &node->children[2] : NULL;
+// Gives every i * k in the body whose multiply takes more than one
+// instruction a register of its own that follows i by step * k, as long as
+// registers last. The register starts out as the product.
+static void reduce_induction_products(const AST* ast, int node, const Induction* iv, CodeBuffer* buffer,
+                                      SymbolTable* table, int* regs, int* factors, int* count) {
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        reduce_induction_products(ast, child, iv, buffer, table, regs, factors, count);
+    }
+    if (ast->kind[node] != NODE_BINOP || ast->op[node] != STAR) return;
+    int left = ast_child(ast, node, 0);
+    int right = ast_child(ast, node, 1);
+    int factor = ast->kind[right] == NODE_INT ? right : left;
+    int var = factor == right ? left : right;
+    if (ast->kind[factor] != NODE_INT || ast->kind[var] != NODE_VAR || ast->value[var] != iv->name) return;
+    int k = ast->value[factor];
+    unsigned magnitude = k < 0 ? 0u - (unsigned) k : (unsigned) k;
+    if (log2_exact(magnitude) >= 0) return;
+    long long increment = (long long) iv->step * k;
+    if (increment < -32768 || increment > 32767) return;
 
-    if (var->token_data->type != IDENTIFIER) {
-        fprintf(stderr, "Left-hand side of operation '%s' on line: %d must be a variable\n", node->token_data->data, node->token_data->line);
-        exit(EXIT_FAILURE);
+    int i = 0;
+    while (i < *count && factors[i] != k) ++i;
+    if (i == *count) {
+        if (!buffer->free_induction_regs) return;
+        int reg = __builtin_ctz(buffer->free_induction_regs);
+        buffer->free_induction_regs &= ~(1u << reg);
+        generate_expression_to(ast, node, buffer, table, reg, 0);
+        regs[i] = reg;
+        factors[i] = k;
+        ++*count;
     }
+    buffer->induction_reg[node] = regs[i];
+}
 
-    Symbol* sym = find_symbol(table, var->token_data->data);
-    if (!sym) {
-        fprintf(stderr, "Undefined variable '%s' in operation on line: %d\n", var->token_data->data, node->token_data->line);
-        exit(EXIT_FAILURE);
+static void clear_induction_products(const AST* ast, int node, CodeBuffer* buffer, const int* regs, int count) {
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        clear_induction_products(ast, child, buffer, regs, count);
+    }
+    for (int i = 0; i < count; ++i) {
+        if (buffer->induction_reg[node] == regs[i]) buffer->induction_reg[node] = 0;
     }
+}
 
-    if (sym->type != INT_TYPE) {
-        fprintf(stderr, "Operation '%s' on line: %d is only for integers\n", node->token_data->data, node->token_data->line);
-        exit(EXIT_FAILURE);
-    }
-
-    // load lhs variable
-    append_to_buffer(buffer, 0, "la $t0, %s\n", sym->label);
-    append_to_buffer(buffer, 0, "lw $t1, 0($t0)\n");
-
-    // load the operand(s)
-    // OP 1
-    if (operand_one->token_data->type == INT_LITERAL) {
-        append_to_buffer(buffer, 0, "li $t2, %s\n", operand_one->token_data->data);
-    } else if (operand_one->token_data->type == IDENTIFIER) {
-        Symbol* operand_one_sym = find_symbol(table, operand_one->token_data->data);
-        if (!operand_one_sym) {
-            fprintf(stderr, "Undefined operand variable '%s' on line: %d\n", operand_one->token_data->data, node->token_data->line);
-            exit(EXIT_FAILURE);
-        }
-        if (operand_one_sym->type != INT_TYPE) {
-            fprintf(stderr, "Operand '%s' on line: %d must be an integer\n", operand_one->token_data->data, node->token_data->line);
-            exit(EXIT_FAILURE);
-        }
-        append_to_buffer(buffer, 0, "la $t2, %s\n", operand_one_sym->label);
-        append_to_buffer(buffer, 0, "lw $t2, 0($t2)\n");
+// Replaces the value of the induction variable with the number of iterations
+// left when the loop only uses it to count and it is gone after the loop.
+// Returns 0 when the trip count cannot be had with one subtraction.
+static int emit_trip_count(const AST* ast, int node, const Induction* iv, CodeBuffer* buffer, SymbolTable* table) {
+    int init = ast_child(ast, node, 0);
+    int body = ast_child(ast, node, 3);
+    if (ast->kind[init] != NODE_VAR_DECL || mentions_name(ast, body, iv->name, 1)) return 0;
+
+    int bound = iv->bound;
+    int constant = ast->kind[bound] == NODE_INT;
+    int limit = constant ? ast->value[bound] : 0;
+    int up;
+    if (iv->step == 1 && iv->compare == LESS) {
+        up = 1;
+    } else if (iv->step == 1 && iv->compare == LESS_EQUAL && constant && limit != INT_MAX) {
+        up = 1;
+        ++limit;
+    } else if (iv->step == -1 && iv->compare == GREATER) {
+        up = 0;
+    } else if (iv->step == -1 && iv->compare == GREATER_EQUAL && constant && limit != INT_MIN) {
+        up = 0;
+        --limit;
+    } else {
+        return 0;
     }
+    int limit_reg = REG_ZERO;
+    if (!constant) {
+        limit_reg = generate_operand(ast, bound, buffer, table, 0);
+    } else if (limit != 0) {
+        limit_reg = REG_T(0);
+        emit(buffer, OP_LI, limit_reg, 0, 0, limit, NO_LABEL);
+    }
+    // the guard has made sure there is at least one iteration; subu because
+    // the distance can be anything up to 2^32 - 1
+    if (up) emit(buffer, OP_SUBU, iv->reg, limit_reg, iv->reg, 0, NO_LABEL);
+    else if (limit_reg != REG_ZERO) emit(buffer, OP_SUBU, iv->reg, iv->reg, limit_reg, 0, NO_LABEL);
+    return 1;
+}
 
-    // for += and -=, there's only one operand
-    if (node->token_data->type == PLUS_EQUAL || node->token_data->type == MINUS_EQUAL) {
-        // perform the operation
-        if (node->token_data->type == PLUS_EQUAL) {
-            append_to_buffer(buffer, 0, "add $t1, $t1, $t2\n");
-        } else if (node->token_data->type == MINUS_EQUAL) {
-            append_to_buffer(buffer, 0, "sub $t1, $t1, $t2\n");
-        }
-        append_to_buffer(buffer, 0, "sw $t1, 0($t0)\n");
-        return;
+// The exit test of a loop on an induction variable with a step of one:
+// counting up from below the bound it is reached exactly, so "i < n" can be
+// "i != n", a single bne. Returns 0 when that does not hold.
+static int emit_induction_exit(const AST* ast, const Induction* iv, CodeBuffer* buffer, SymbolTable* table, int top_label) {
+    int bound = iv->bound;
+    int constant = ast->kind[bound] == NODE_INT;
+    int limit = constant ? ast->value[bound] : 0;
+    if (iv->compare == BANG_EQUAL ||
+        (iv->step == 1 && iv->compare == LESS) || (iv->step == -1 && iv->compare == GREATER)) {
+        // as is
+    } else if (iv->step == 1 && iv->compare == LESS_EQUAL && constant && limit != INT_MAX) {
+        ++limit;
+    } else if (iv->step == -1 && iv->compare == GREATER_EQUAL && constant && limit != INT_MIN) {
+        --limit;
+    } else {
+        return 0;
     }
+    int limit_reg = REG_ZERO;
+    if (!constant) {
+        limit_reg = generate_operand(ast, bound, buffer, table, 0);
+    } else if (limit != 0) {
+        limit_reg = REG_T(0);
+        emit(buffer, OP_LI, limit_reg, 0, 0, limit, NO_LABEL);
+    }
+    emit(buffer, OP_BNE, 0, iv->reg, limit_reg, 0, top_label);
+    return 1;
+}
 
+// Rotated like a while loop at -O1. When the loop has an induction variable
+// it either counts down to zero or exits on a bne against the bound, and its
+// products with constants are carried in registers of their own.
+void handle_for_loop(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    int init = ast_child(ast, node, 0);
+    int condition = ast_child(ast, node, 1);
+    int step = ast_child(ast, node, 2);
+    int body = ast_child(ast, node, 3);
+
+    push_scope(table);
+    generate_code(ast, init, buffer, table);
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_FOR_START, NO_LABEL);
+    int exit_label = generate_label(buffer);
+    int top_label = generate_label(buffer);
+
+    if (buffer->opt_level < 1) {
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, top_label);
+        generate_branch(ast, condition, buffer, table, exit_label, 0);
+        ++buffer->loop_depth;
+        handle_block(ast, body, buffer, table);
+        generate_code(ast, step, buffer, table);
+        --buffer->loop_depth;
+        emit(buffer, OP_J, 0, 0, 0, 0, top_label);
+        emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_FOR_END, NO_LABEL);
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, exit_label);
+        pop_scope(table);
+        return;
+    }
 
-    if (operand_two == NULL){
-        fprintf(stderr, "Did not provide a second operand for operation '%s' on line: %d\n", node->token_data->data, node->token_data->line);
-        exit(EXIT_FAILURE);
+    Induction iv;
+    int induction = find_induction(ast, node, table, &iv);
+    int copies = unroll_factor(ast, node, body, step, buffer, table);
+    if (!copies && !ast->value[node]) generate_branch(ast, condition, buffer, table, exit_label, 0);
+    int counting_down = !copies && induction && emit_trip_count(ast, node, &iv, buffer, table);
+
+    int regs[32], factors[32], increments[32] = {0};
+    int products = 0;
+    if (induction && !counting_down && buffer->strength_reduce) {
+        if (!buffer->induction_reg) {
+            buffer->induction_reg = (int*) counted_calloc(ast->count, sizeof(int));
+            if (!buffer->induction_reg) {
+                compile_error("Error: Malloc Failed on handle_for_loop\n");
+            }
+        }
+        reduce_induction_products(ast, body, &iv, buffer, table, regs, factors, &products);
+        for (int i = 0; i < products; ++i) increments[i] = iv.step * factors[i];
     }
 
-    // for +, -, *, /, there are two operands
-    // OP 2 into $t3
-    if (operand_two->token_data->type == INT_LITERAL) {
-        append_to_buffer(buffer, 0, "li $t3, %s\n", operand_two->token_data->data);
-    } else if (operand_two->token_data->type == IDENTIFIER) {
-        Symbol* operand_two_sym = find_symbol(table, operand_two->token_data->data);
-        if (!operand_two_sym) {
-            fprintf(stderr, "Undefined operand variable '%s' on line: %d\n", operand_two->token_data->data, node->token_data->line);
-            exit(EXIT_FAILURE);
+    if (copies) {
+        // the trip count is exact, so the bne exit holds for any number of copies
+        int unrolled_top = emit_unrolled(ast, node, body, step, copies, regs, increments, products, buffer, table);
+        if (unrolled_top != NO_LABEL && (!induction || !emit_induction_exit(ast, &iv, buffer, table, unrolled_top))) {
+            generate_branch(ast, condition, buffer, table, unrolled_top, 1);
         }
-        if (operand_two_sym->type != INT_TYPE) {
-            fprintf(stderr, "Operand '%s' on line: %d must be an integer\n", operand_two->token_data->data, node->token_data->line);
-            exit(EXIT_FAILURE);
+    } else {
+        emit(buffer, OP_LABEL, 0, 0, 0, 0, top_label);
+        ++buffer->loop_depth;
+        handle_block(ast, body, buffer, table);
+        if (counting_down) {
+            emit(buffer, OP_ADDIU, iv.reg, iv.reg, 0, -1, NO_LABEL);
+        } else {
+            generate_code(ast, step, buffer, table);
+        }
+        --buffer->loop_depth;
+
+        for (int i = 0; i < products; ++i) {
+            emit(buffer, OP_ADDIU, regs[i], regs[i], 0, increments[i], NO_LABEL);
+        }
+        if (counting_down) {
+            emit(buffer, OP_BNE, 0, iv.reg, REG_ZERO, 0, top_label);
+        } else if (!induction || !emit_induction_exit(ast, &iv, buffer, table, top_label)) {
+            generate_branch(ast, condition, buffer, table, top_label, 1);
         }
-        append_to_buffer(buffer, 0, "la $t3, %s\n", operand_two_sym->label);
-        append_to_buffer(buffer, 0, "lw $t3, 0($t3)\n");
     }
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_FOR_END, NO_LABEL);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, exit_label);
 
-    // perform the operation
-    switch (node->token_data->type) {
-        case PLUS: append_to_buffer(buffer, 0, "add $t1, $t2, $t3\n"); break;
-        case MINUS: append_to_buffer(buffer, 0, "sub $t1, $t2, $t3\n"); break;
-        case STAR: append_to_buffer(buffer, 0, "mul $t1, $t2, $t3\n"); break; // use pseudo for 32 bit maximum result
-        case SLASH:
-            append_to_buffer(buffer, 0, "div $t2, $t3\n");
-            append_to_buffer(buffer, 0, "mflo $t1\n"); // we will just max it to lower 32 bits of division
-            break;
-        case MODULO:
-            // bit mask using logical and was the first idea, but it is only an optimization for when t3 is a power of 2
-            // a generalized modulo operation:
-            append_to_buffer(buffer, 0, "div $t2, $t3\n");
-            append_to_buffer(buffer, 0, "mfhi $t1\n");
-            break;
-        case BIT_AND:
-            append_to_buffer(buffer, 0, "and $t1, $t2, $t3\n");
-            break;
-        case BIT_OR:
-            append_to_buffer(buffer, 0, "or $t1, $t2, $t3\n");
-            break;
-        default:
-            fprintf(stderr, "Unsupported arithmetic operation '%s' on line: %d\n", node->token_data->data, node->token_data->line);
-            exit(EXIT_FAILURE);
+    if (products) {
+        clear_induction_products(ast, body, buffer, regs, products);
+        for (int i = 0; i < products; ++i) buffer->free_induction_regs |= 1u << regs[i];
     }
-    // store result
-    append_to_buffer(buffer, 0, "sw $t1, 0($t0)\n");
+    pop_scope(table);
 }
 
-// delegate functions based on node token type
-void generate_code(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table) {
-    if (!node) return;
-    if (!node->token_data) return;
-    switch(node->token_data->type){
-        case MAIN:
-            handle_function(node, buffer, table);
+// delegate functions based on node kind
+void generate_code(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    if (node == NO_NODE) return;
+    // code emitted after a nested statement, like a loop's bottom test,
+    // goes back to the enclosing statement's line
+    int enclosing_line = buffer->line;
+    buffer->line = ast_token(ast, node)->line;
+    switch(ast->kind[node]){
+        case NODE_FUNCTION:
+            handle_function(ast, node, buffer, table);
             break;
-        case RETURN:
-            handle_statement(node, buffer);
+        case NODE_BLOCK:
+            handle_block(ast, node, buffer, table);
             break;
-        case PRINT:
-            handle_print(node, buffer, table);
+        case NODE_RETURN:
+            handle_return(ast, node, buffer, table);
             break;
-        case STRING_TYPE:
-            handle_variable_declaration(node, buffer, table, STRING_TYPE);
+        case NODE_PRINT:
+            handle_print(ast, node, buffer, table);
             break;
-        case INT_TYPE:
-            handle_variable_declaration(node, buffer, table, INT_TYPE);
+        case NODE_VAR_DECL:
+            handle_variable_declaration(ast, node, buffer, table);
             break;
-        case PLUS:
-        case MINUS:
-        case SLASH:
-        case STAR:
-        case MODULO:
-        case PLUS_EQUAL:
-        case MINUS_EQUAL:
-        case BIT_AND:
-        case BIT_OR:
-            handle_int_operations(node, buffer, table);
+        case NODE_ASSIGN:
+            handle_assignment(ast, node, buffer, table);
             break;
-        case IF:
-            handle_if_statement(node, buffer, table);
+        case NODE_IF:
+            handle_if_statement(ast, node, buffer, table);
             break;
-        case WHILE:
-            handle_while_loop(node, buffer, table);
+        case NODE_WHILE:
+            handle_while_loop(ast, node, buffer, table);
+            break;
+        case NODE_FOR:
+            handle_for_loop(ast, node, buffer, table);
             break;
         default: break;
     }
+    buffer->line = enclosing_line;
 }
 
-// TODO: should be adding function to symbol table, specifying what is allocated to stack
-void handle_function(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table) {
-    if (node->children_count < 2 || node->children[0].token_data->type != OPEN_PAREN ||
-            node->children[1].token_data->type != OPEN_BRACE) return;
-
-    append_to_buffer(buffer, 0, "\n%s:\n", node->token_data->data);
-    append_to_buffer(buffer, 0, "addi $sp, $sp, -4\n");
-    append_to_buffer(buffer, 0, "sw $ra, 0($sp)\n");
-    append_to_buffer(buffer, 0, "# function content\n\n");
+// Sets up (OP_SW) or tears down (OP_LW) the stack frame: $ra at 0($sp), the
+// $s registers holding variables above it, then the caller's $fp and the
+// slots of spilled variables, which are addressed from $fp so that pushes in
+// the middle of an expression don't move them.
+static void emit_frame(CodeBuffer* buffer, Opcode op) {
+    const RegAllocation* alloc = buffer->alloc;
+    int size = alloc ? alloc->frame_size : 4;
+    if (op == OP_SW) emit(buffer, OP_ADDI, REG_SP, REG_SP, 0, -size, NO_LABEL);
+    emit(buffer, op, REG_RA, REG_SP, 0, 0, NO_LABEL);
+    if (alloc) {
+        int offset = 4;
+        for (int reg = REG_S0; reg < REG_S0 + ALLOCATABLE_REGS; ++reg) {
+            if (alloc->saved_regs & (1u << reg)) {
+                emit(buffer, op, reg, REG_SP, 0, offset, NO_LABEL);
+                offset += 4;
+            }
+        }
+        if (alloc->fp_offset >= 0) {
+            emit(buffer, op, REG_FP, REG_SP, 0, alloc->fp_offset, NO_LABEL);
+            if (op == OP_SW) emit(buffer, OP_MOVE, REG_FP, REG_SP, 0, 0, NO_LABEL);
+        }
+    }
+    if (op == OP_LW) emit(buffer, OP_ADDI, REG_SP, REG_SP, 0, size, NO_LABEL);
+}
 
-    //child[0] is open paren for arguments
-    //child[1] is open curly brace for function content
+// TODO: should be adding function to symbol table, specifying what is allocated to stack
+void handle_function(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    int body = ast->first_child[node];
+    Token* name = ast_token(ast, node);
+    emit(buffer, OP_LABEL, 0, 0, 0, 0, LABEL_MAIN);
+    emit_frame(buffer, OP_SW);
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_FUNCTION, NO_LABEL);
 
     int has_return = 0;
-    struct TokenNode* brace = &node->children[1];
-    for (int i=0; i < (brace->children_count-1); ++i){
-        if (brace->children[i].token_data->type == RETURN){
+    for (int stmt = ast->first_child[body]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]){
+        if (ast->kind[stmt] == NODE_RETURN){
             has_return = 1;
         }
-        generate_code(&brace->children[i], buffer, table);
+        generate_code(ast, stmt, buffer, table);
     }
     if (!has_return) {
-        fprintf(stderr, "No return statement on function: %s\n", node->token_data->data);
-        exit(EXIT_FAILURE);
+        compile_error("No return statement on function: %s\n", token_text(ast->prog, name));
     }
 
     // unload function on the occurence of a "return" as one of the children
 }
 
-void handle_statement(struct TokenNode* node, CodeBuffer* buffer) {
-    if (node->token_data->type == RETURN) {
-        if (node->children_count == 1 && node->children[0].token_data->type == INT_LITERAL){
-            // child[0] is integer value to return
-            append_to_buffer(buffer, 0, "# returning here\n");
-            append_to_buffer(buffer, 0, "li $v0, %s\n", node->children[0].token_data->data);
-            append_to_buffer(buffer, 0, "# unloading function\n");
-            append_to_buffer(buffer, 0, "lw $ra, 0($sp)\n");
-            append_to_buffer(buffer, 0, "addi $sp, $sp, 4\n");
-            append_to_buffer(buffer, 0, "jr $ra\n\n");
-        }
-    }
+void handle_return(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table) {
+    int value = ast->first_child[node];
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_RETURN, NO_LABEL);
+    if (buffer->prints) emit(buffer, OP_JAL, 0, 0, 0, 0, LABEL_PRINT_FLUSH);
+    generate_expression_to(ast, value, buffer, table, REG_V0, 0);
+    emit(buffer, OP_COMMENT, 0, 0, 0, COMMENT_UNLOAD, NO_LABEL);
+    emit_frame(buffer, OP_LW);
+    emit(buffer, OP_JR, 0, REG_RA, 0, 0, NO_LABEL);
 }
 
-// caller must free mem
-char* generate_label(CodeBuffer* buffer) {
-    char* label = malloc(20);
-    if (!label) {
-        fprintf(stderr, "Memory allocation failed for label generation.\n");
-        exit(EXIT_FAILURE);
-    }
-    snprintf(label, 20, "L%d", buffer->label_counter);
-    ++buffer->label_counter;
-    return label;
+int generate_label(CodeBuffer* buffer) {
+    return buffer->label_counter++;
 }
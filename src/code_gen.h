@@ -3,40 +3,142 @@
 
 #include "parser.h"
 #include "symbol_table.h"
+#include "reg_alloc.h"
+#include "literals.h"
 #include <stddef.h>
 
+// expression temporaries are $t0..$t7, deeper expressions spill to the stack
+#define MAX_EXPRESSION_REG 7
+
+// register numbers as the assembler knows them
+enum {
+    REG_ZERO = 0, REG_V0 = 2, REG_V1 = 3, REG_A0 = 4, REG_A1 = 5, REG_A2 = 6, REG_A3 = 7,
+    REG_T0 = 8,   // $t0..$t7 are 8..15
+    REG_S0 = 16,  // $s0..$s7 are 16..23
+    REG_T8 = 24, REG_T9 = 25, REG_SP = 29, REG_FP = 30, REG_RA = 31,
+};
+#define REG_T(n) (REG_T0 + (n))
+// nothing else touches these, so they can carry the strength reduced
+// induction expressions of for loops across whole loop bodies
+#define INDUCTION_REGS (1u << REG_V1 | 1u << REG_A2 | 1u << REG_A3)
+
+typedef enum {
+    // body
+    OP_LABEL,   // label:
+    OP_COMMENT, // # comment_text[imm]
+    OP_LI,      // li rd, imm
+    OP_LA,      // la rd, label(+imm)
+    OP_LW,      // lw rd, imm(rs)
+    OP_SW,      // sw rd, imm(rs)
+    OP_MOVE,    // move rd, rs
+    OP_ADD, OP_SUB, OP_ADDU, OP_SUBU, OP_MUL, OP_AND, OP_OR, // op rd, rs, rt
+    OP_ADDI, OP_ADDIU, OP_ANDI, OP_ORI, OP_SLL, OP_SRL, OP_SRA, OP_SLTI, // op rd, rs, imm
+    OP_DIV, OP_MULT, // op rs, rt
+    OP_MFLO, OP_MFHI, // op rd
+    OP_BEQ, OP_BNE, OP_BLT, OP_BLE, OP_BGT, OP_BGE, // op rs, rt, label
+    OP_J, OP_JAL, // op label
+    OP_JR,      // jr rs
+    OP_SYSCALL,
+    OP_NOP,     // deleted by an optimization, never written out
+    // data
+    OP_ASCIIZ,  // label: .asciiz <string pool entry imm>
+    OP_WORD,    // label: .word imm
+    OP_ALIGN,   // .align imm
+} Opcode;
+
+// One emitted instruction or data directive. Labels are plain integers:
+// non-negative ids print as L<id>, the negative ones are the named labels below.
+typedef struct {
+    unsigned char op;
+    unsigned char rd, rs, rt;
+    int imm;
+    int label;
+    int line;   // source line of the statement it was generated for, 0 for none
+} Instr;
+
+enum {
+    NO_LABEL = -1,
+    LABEL_MAIN = -2,
+    LABEL_NEWLINE = -3,
+    LABEL_STRCMP = -4,
+    LABEL_PRINT_STRING = -5,
+    LABEL_PRINT_INT = -6,
+    LABEL_PRINT_FLUSH = -7,
+};
+
+enum {
+    COMMENT_PRINT_START, COMMENT_PRINT_END,
+    COMMENT_IF_START, COMMENT_IF_END,
+    COMMENT_WHILE_START, COMMENT_WHILE_END,
+    COMMENT_FOR_START, COMMENT_FOR_END,
+    COMMENT_FUNCTION, COMMENT_RETURN, COMMENT_UNLOAD,
+};
+
 typedef struct {
-    char* data;
-    char* body;
-    char* util; // for functions like strcmp
-    int body_size;
+    Instr* body;
+    int body_count;
     int body_capacity;
 
-    int data_size;
+    Instr* data;
+    int data_count;
     int data_capacity;
 
+    char* util; // the runtime routines the code calls, copied in as text
     int util_size;
     int util_capacity;
 
     int label_counter;
+    StringPool* strings; // text of the .asciiz directives
+    int newline_string;  // pool id of "\n", stored under the newline label when it has storage of its own
+    LiteralLayout literals;
+    int* literal_label;  // per string pool id, the .data label of a literal holding bytes, NO_LABEL until used
+    unsigned char* literal_aligned; // per string pool id, whether the literal holding bytes sits in whole words of its own
+    int prints;          // whether anything is printed, so returns flush the output buffer
+    int line;            // source line emitted instructions are tagged with
+    int line_comments;   // precede instructions with "# .loc <line>" where the source line changes
+    int symbol_count;    // variables declared, for --stats
+
+    const RegAllocation* alloc; // NULL keeps every variable in .data
+    int loop_depth;
+    int strength_reduce; // * / % by constants become shifts and multiplies
+    int opt_level;
+    int unroll;          // copies of the body per iteration of a loop with a known trip count, 1 for none
+    int* induction_reg;          // per AST node, the register holding an i * k of an enclosing for loop, 0 if none
+    unsigned free_induction_regs;
 } CodeBuffer;
 
-void init_buffer(CodeBuffer* buffer);
-void append_to_buffer(CodeBuffer* buf, int segment, const char* format, ...);
+typedef struct {
+    int opt_level;      // -O<n>, 0 emits the code exactly as generated
+    int peephole_stats; // --peephole-stats
+    int strength_reduce; // at -O1, cheaper sequences for * / % by constants (-fno-strength-reduce)
+    int unroll;          // at -O1, unroll factor for loops with a known trip count (-funroll=N), 0 or 1 for none
+    int line_comments;   // "# .loc <line>" comments mapping the code back to the source (-g)
+} CodegenOptions;
+
+void init_buffer(CodeBuffer* buffer, StringPool* strings);
+void emit(CodeBuffer* buffer, Opcode op, int rd, int rs, int rt, int imm, int label);
+void emit_data(CodeBuffer* buffer, Opcode op, int label, int imm);
 void free_buffer(CodeBuffer* buffer);
-void write_buffer_to_file(CodeBuffer* buffer, const char* filename);
-void generate_mips_code(AST* ast, const char* output_filename);
-void handle_print(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void handle_variable_declaration(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, TokenType type);
-void generate_operand_code(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, int* string_cmp, int is_right);
-void generate_comparator_code(TokenType comparator_type, CodeBuffer* buffer, int string_cmp);
-void evaluate_condition(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table, char* false_label, char* start_body_label);
-void handle_if_statement(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void handle_while_loop(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void handle_int_operations(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void generate_code(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void handle_function(struct TokenNode* node, CodeBuffer* buffer, SymbolTable* table);
-void handle_statement(struct TokenNode* node, CodeBuffer* buffer);
-char* generate_label(CodeBuffer* buffer);
+// the assembly as text, NUL terminated, to be released with counted_free
+char* render_buffer(const CodeBuffer* buffer, size_t* length);
+size_t write_buffer_to_file(CodeBuffer* buffer, const char* filename);
+void generate_mips_buffer(AST* ast, CodeBuffer* buffer, const CodegenOptions* options);
+void generate_mips_code(AST* ast, const char* output_filename, const CodegenOptions* options);
+void handle_print(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_variable_declaration(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_assignment(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void generate_expression(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int reg);
+void generate_expression_to(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int dest, int reg);
+int generate_operand(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int reg);
+void generate_branch(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table, int label, int jump_if);
+void check_names(const AST* ast, int node, SymbolTable* table);
+void handle_block(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_if_statement(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_while_loop(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_for_loop(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void generate_code(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_function(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+void handle_return(const AST* ast, int node, CodeBuffer* buffer, SymbolTable* table);
+int generate_label(CodeBuffer* buffer);
 
 #endif
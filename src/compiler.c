@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include "compiler.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+int compile(const char* src, size_t length, const CodegenOptions* options,
+            CompileOutput* output, Diagnostics* diagnostics) {
+    CodegenOptions quiet = {0, 0, 1, 1, 0};
+    if (options) quiet = *options;
+    quiet.peephole_stats = 0;
+
+    output->text = NULL;
+    output->length = 0;
+    if (diagnostics) diagnostics->message = NULL;
+
+    // an error unwinds to here, and everything the compile allocated goes
+    // with the scope
+    AllocScope scope;
+    ErrorTrap trap;
+    counted_begin_scope(&scope);
+    set_error_trap(&trap);
+    if (setjmp(trap.env)) {
+        clear_error_trap(&trap);
+        counted_end_scope(&scope, 1);
+        if (diagnostics) diagnostics->message = trap.message;
+        else free(trap.message);
+        return -1;
+    }
+
+    // the source is borrowed, the program never frees it
+    Program prog = {0};
+    prog.source.data = src;
+    prog.source.size = length;
+    lex_buffer(&prog);
+
+    AST ast;
+    build_ast(&prog, &ast);
+
+    CodeBuffer buffer;
+    generate_mips_buffer(&ast, &buffer, &quiet);
+    output->text = render_buffer(&buffer, &output->length);
+
+    free_buffer(&buffer);
+    free_ast(&ast);
+    prog.source.data = NULL;
+    free_program(&prog);
+
+    clear_error_trap(&trap);
+    counted_end_scope(&scope, 0);
+    return 0;
+}
+
+void free_compile_output(CompileOutput* output) {
+    counted_free(output->text);
+    output->text = NULL;
+    output->length = 0;
+}
+
+void free_diagnostics(Diagnostics* diagnostics) {
+    free(diagnostics->message);
+    diagnostics->message = NULL;
+}
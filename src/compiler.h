@@ -0,0 +1,30 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stddef.h>
+#include "code_gen.h"
+
+// Compiling from memory, for embedding the compiler (build/libcompiler.a):
+// no files are read or written, nothing is printed and an error is returned
+// instead of exiting. Compiles share no state, any number of them may run at
+// once on different threads.
+
+typedef struct {
+    char* text;      // the assembly, NUL terminated
+    size_t length;
+} CompileOutput;
+
+typedef struct {
+    char* message;   // the error as the command line prints it, NULL when there was none
+} Diagnostics;
+
+// Compiles the length bytes at src with options (NULL for the defaults, as
+// with no flags; peephole_stats is ignored). Returns 0 and fills output, or
+// -1 with output empty and the error in diagnostics, which may be NULL.
+// Everything allocated along the way is freed either way.
+int compile(const char* src, size_t length, const CodegenOptions* options,
+            CompileOutput* output, Diagnostics* diagnostics);
+void free_compile_output(CompileOutput* output);
+void free_diagnostics(Diagnostics* diagnostics);
+
+#endif
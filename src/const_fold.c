@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "const_fold.h"
+#include "symbol_table.h"
+#include "literals.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+// One entry of the undo trail: the state a variable had before it changed.
+typedef struct {
+    int decl;
+    int known;
+    int value;
+} Change;
+
+typedef struct {
+    AST* ast;
+    SymbolTable scopes;   // a symbol's label is its VAR_DECL node, -1 for loop locals
+
+    // what is known about each int variable, indexed by VAR_DECL node
+    unsigned char* known;
+    int* value;
+
+    Change* trail;        // every change since the start, so a path can be undone
+    int trail_count;
+    int trail_capacity;
+
+    Change* merged;       // scratch for merge_paths
+    int* stamp;           // dedupes the variables merge_paths looks at
+    int stamp_counter;
+} Folder;
+
+static void* grow(void* ptr, size_t size) {
+    ptr = counted_realloc(ptr, size);
+    if (!ptr) {
+        compile_error("Error: Realloc Failed on fold_constants\n");
+    }
+    return ptr;
+}
+
+static void set_value(Folder* f, int decl, int known, int value) {
+    if (f->known[decl] == known && (!known || f->value[decl] == value)) return;
+    if (f->trail_count == f->trail_capacity) {
+        f->trail_capacity *= 2;
+        f->trail = (Change*) grow(f->trail, sizeof(Change) * f->trail_capacity);
+        f->merged = (Change*) grow(f->merged, sizeof(Change) * f->trail_capacity);
+    }
+    f->trail[f->trail_count++] = (Change){decl, f->known[decl], f->value[decl]};
+    f->known[decl] = known;
+    f->value[decl] = value;
+}
+
+static void undo_to(Folder* f, int mark) {
+    while (f->trail_count > mark) {
+        Change* c = &f->trail[--f->trail_count];
+        f->known[c->decl] = c->known;
+        f->value[c->decl] = c->value;
+    }
+}
+
+// Joins the state after a path that may or may not have run (everything
+// since mark) with the state before it: a variable stays known only when
+// both agree.
+static void merge_paths(Folder* f, int mark) {
+    int count = 0;
+    ++f->stamp_counter;
+    for (int i = f->trail_count - 1; i >= mark; --i) {
+        int decl = f->trail[i].decl;
+        if (f->stamp[decl] == f->stamp_counter) continue;
+        f->stamp[decl] = f->stamp_counter;
+        f->merged[count++] = (Change){decl, f->known[decl], f->value[decl]};
+    }
+    undo_to(f, mark);
+    for (int i = 0; i < count; ++i) {
+        Change* after = &f->merged[i];
+        if (!after->known || !f->known[after->decl] || f->value[after->decl] != after->value) {
+            set_value(f, after->decl, 0, 0);
+        }
+    }
+}
+
+// VAR_DECL node of the int variable a node names, -1 for anything else
+static int resolve(Folder* f, int node) {
+    Symbol* sym = find_symbol(&f->scopes, f->ast->value[node]);
+    if (!sym || sym->type != INT_TYPE) return -1;
+    return sym->label;
+}
+
+// pool id of the literal a string literal or string variable stands for, -1 for anything else
+static int string_literal(Folder* f, int node) {
+    if (f->ast->kind[node] == NODE_STRING) return f->ast->value[node];
+    if (f->ast->kind[node] != NODE_VAR) return -1;
+    Symbol* sym = find_symbol(&f->scopes, f->ast->value[node]);
+    return sym && sym->type == STRING_TYPE ? sym->value : -1;
+}
+
+static int is_comparison(TokenType op) {
+    return op == EQUAL_EQUAL || op == BANG_EQUAL || op == LESS || op == LESS_EQUAL
+        || op == GREATER || op == GREATER_EQUAL;
+}
+
+// 0 when the result is not defined at compile time (division by zero, the
+// one overflowing division, and + and - overflowing, which add and sub trap
+// on), the target decides those at run time; * wraps around like mul
+static int apply_binop(TokenType op, int a, int b, int* result) {
+    switch (op) {
+        case PLUS: return !__builtin_add_overflow(a, b, result);
+        case MINUS: return !__builtin_sub_overflow(a, b, result);
+        case STAR: *result = (int) ((unsigned) a * (unsigned) b); return 1;
+        case SLASH:
+        case MODULO:
+            if (b == 0 || (a == INT_MIN && b == -1)) return 0;
+            *result = op == SLASH ? a / b : a % b;
+            return 1;
+        case BIT_AND: *result = a & b; return 1;
+        case BIT_OR: *result = a | b; return 1;
+        case EQUAL_EQUAL: *result = a == b; return 1;
+        case BANG_EQUAL: *result = a != b; return 1;
+        case LESS: *result = a < b; return 1;
+        case LESS_EQUAL: *result = a <= b; return 1;
+        case GREATER: *result = a > b; return 1;
+        case GREATER_EQUAL: *result = a >= b; return 1;
+        default: return 0;
+    }
+}
+
+int can_trap(const AST* ast, int node) {
+    if (ast->kind[node] != NODE_BINOP) return 0;
+    if (ast->op[node] == PLUS || ast->op[node] == MINUS) return 1;
+    return can_trap(ast, ast_child(ast, node, 0)) || can_trap(ast, ast_child(ast, node, 1));
+}
+
+// Value of an expression under the current state, without rewriting it.
+// Returns 0 when it is not known.
+static int evaluate(Folder* f, int node, int* result) {
+    AST* ast = f->ast;
+    switch (ast->kind[node]) {
+        case NODE_INT:
+        case NODE_BOOL:
+            *result = ast->value[node];
+            return 1;
+        case NODE_VAR: {
+            int decl = resolve(f, node);
+            if (decl < 0 || !f->known[decl]) return 0;
+            *result = f->value[decl];
+            return 1;
+        }
+        case NODE_BINOP: {
+            int a, b;
+            int left_known = evaluate(f, ast_child(ast, node, 0), &a);
+            TokenType op = ast->op[node];
+            if (op == LOGIC_AND || op == LOGIC_OR) {
+                // either side alone can decide it
+                int decides = op == LOGIC_OR;
+                if (left_known && (a != 0) == decides) {
+                    *result = decides;
+                    return 1;
+                }
+                if (!evaluate(f, ast_child(ast, node, 1), &b)) return 0;
+                // the left side still runs first and may trap
+                if ((b != 0) == decides && (left_known || !can_trap(ast, ast_child(ast, node, 0)))) {
+                    *result = decides;
+                    return 1;
+                }
+                if (!left_known) return 0;
+                *result = !decides;
+                return 1;
+            }
+            if (!left_known || !evaluate(f, ast_child(ast, node, 1), &b)) return 0;
+            return apply_binop(op, a, b, result);
+        }
+        default:
+            return 0;
+    }
+}
+
+static void make_constant(AST* ast, int node, NodeKind kind, int value) {
+    ast->kind[node] = kind;
+    ast->value[node] = value;
+    ast->first_child[node] = ast->last_child[node] = NO_NODE;
+}
+
+// node takes over everything but its place among its siblings from other
+static void replace_node(AST* ast, int node, int other) {
+    ast->kind[node] = ast->kind[other];
+    ast->op[node] = ast->op[other];
+    ast->value[node] = ast->value[other];
+    ast->token[node] = ast->token[other];
+    ast->first_child[node] = ast->first_child[other];
+    ast->last_child[node] = ast->last_child[other];
+}
+
+// whether an expression is certainly an int, so that dropping it cannot hide
+// a type error from the code generator
+static int is_int_expression(Folder* f, int node) {
+    AST* ast = f->ast;
+    switch (ast->kind[node]) {
+        case NODE_INT: return 1;
+        case NODE_VAR: return resolve(f, node) >= 0;
+        case NODE_BINOP:
+            return !is_comparison(ast->op[node]) && ast->op[node] != LOGIC_AND && ast->op[node] != LOGIC_OR
+                && is_int_expression(f, ast_child(ast, node, 0)) && is_int_expression(f, ast_child(ast, node, 1));
+        default: return 0;
+    }
+}
+
+static void fold_condition(Folder* f, int node);
+
+static void fold_expression(Folder* f, int node) {
+    AST* ast = f->ast;
+    switch (ast->kind[node]) {
+        case NODE_VAR: {
+            int decl = resolve(f, node);
+            if (decl >= 0 && f->known[decl]) make_constant(ast, node, NODE_INT, f->value[decl]);
+            return;
+        }
+        case NODE_BINOP: break;
+        default: return;
+    }
+
+    TokenType op = ast->op[node];
+    int left = ast_child(ast, node, 0);
+    int right = ast_child(ast, node, 1);
+
+    if (op == LOGIC_AND || op == LOGIC_OR) {
+        fold_condition(f, left);
+        fold_condition(f, right);
+        // a constant operand either decides the result or drops out; the
+        // other operand has no side effects, so it can go in both cases,
+        // unless it runs before a deciding constant and can trap
+        int decides = op == LOGIC_OR;
+        int constant = ast->kind[left] == NODE_BOOL ? left : ast->kind[right] == NODE_BOOL ? right : NO_NODE;
+        if (constant == NO_NODE) return;
+        if (ast->value[constant] == decides) {
+            if (constant == right && can_trap(ast, left)) return;
+            make_constant(ast, node, NODE_BOOL, decides);
+        } else {
+            replace_node(ast, node, constant == left ? right : left);
+        }
+        return;
+    }
+
+    // two strings compare like strcmp's result against 0
+    int left_string = string_literal(f, left);
+    int right_string = string_literal(f, right);
+    int order, result;
+    if (is_comparison(op) && left_string >= 0 && right_string >= 0
+        && compare_literals(&ast->prog->strings, left_string, right_string, &order)) {
+        apply_binop(op, order, 0, &result);
+        make_constant(ast, node, NODE_BOOL, result);
+        return;
+    }
+
+    fold_expression(f, left);
+    fold_expression(f, right);
+    int left_int = ast->kind[left] == NODE_INT;
+    int right_int = ast->kind[right] == NODE_INT;
+    if (left_int && right_int) {
+        if (apply_binop(op, ast->value[left], ast->value[right], &result)) {
+            make_constant(ast, node, is_comparison(op) ? NODE_BOOL : NODE_INT, result);
+        }
+        return;
+    }
+    if (!left_int && !right_int) return;
+
+    // identities with one constant operand; a string variable on the other
+    // side is left for the code generator to complain about
+    int constant = ast->value[left_int ? left : right];
+    int other = left_int ? right : left;
+    if (ast->kind[other] == NODE_VAR && resolve(f, other) < 0) return;
+    if (constant == 0 && (op == PLUS || op == BIT_OR || (op == MINUS && right_int))) {
+        replace_node(ast, node, other);
+    } else if (constant == 1 && (op == STAR || (op == SLASH && right_int))) {
+        replace_node(ast, node, other);
+    } else if (constant == 0 && (op == STAR || op == BIT_AND) && is_int_expression(f, other) && !can_trap(ast, other)) {
+        make_constant(ast, node, NODE_INT, 0);
+    }
+}
+
+// like fold_expression, but an int that ends up in a condition becomes a bool
+static void fold_condition(Folder* f, int node) {
+    fold_expression(f, node);
+    if (f->ast->kind[node] == NODE_INT) make_constant(f->ast, node, NODE_BOOL, f->ast->value[node] != 0);
+}
+
+// Forgets the value of every outer variable assigned somewhere under node.
+static void kill_assigned(Folder* f, int node) {
+    AST* ast = f->ast;
+    switch (ast->kind[node]) {
+        case NODE_BLOCK:
+        case NODE_FOR:
+            push_scope(&f->scopes);
+            for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+                kill_assigned(f, child);
+            }
+            pop_scope(&f->scopes);
+            return;
+        case NODE_VAR_DECL:
+            add_symbol(&f->scopes, ast->value[node], -1, ast->op[node], 0);
+            return;
+        case NODE_ASSIGN: {
+            int decl = resolve(f, node);
+            if (decl >= 0) set_value(f, decl, 0, 0);
+            return;
+        }
+        case NODE_IF:
+        case NODE_WHILE:
+            for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+                kill_assigned(f, child);
+            }
+            return;
+        default:
+            return;
+    }
+}
+
+// how many statements under node assign or declare name
+static int count_assignments(const AST* ast, int node, int name) {
+    int count = (ast->kind[node] == NODE_ASSIGN || ast->kind[node] == NODE_VAR_DECL) && ast->value[node] == name;
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        count += count_assignments(ast, child, name);
+    }
+    return count;
+}
+
+// x = x + c, x = c + x or x = x - c with c known: what stmt adds to x
+static int counter_step(Folder* f, int stmt, int name, int* delta) {
+    AST* ast = f->ast;
+    if (ast->kind[stmt] != NODE_ASSIGN || ast->value[stmt] != name) return 0;
+    int value = ast->first_child[stmt];
+    if (ast->kind[value] != NODE_BINOP || (ast->op[value] != PLUS && ast->op[value] != MINUS)) return 0;
+    int left = ast_child(ast, value, 0);
+    int right = ast_child(ast, value, 1);
+    if (ast->op[value] == PLUS && ast->kind[right] == NODE_VAR && ast->value[right] == name) {
+        int swap = left;
+        left = right;
+        right = swap;
+    }
+    int c;
+    if (ast->kind[left] != NODE_VAR || ast->value[left] != name) return 0;
+    if (!evaluate(f, right, &c) || c == 0 || c == INT_MIN) return 0;
+    *delta = ast->op[value] == PLUS ? c : -c;
+    return 1;
+}
+
+// Iterations of "x compare bound" with x going start, start + delta, ...,
+// -1 when that never ends or x leaves the int range first.
+static long long iterations(TokenType compare, long long start, long long bound, long long delta) {
+    long long trips;
+    switch (compare) {
+        case LESS_EQUAL:
+            ++bound;
+            // fall through
+        case LESS:
+            if (start >= bound) return 0;
+            if (delta < 0) return -1;
+            trips = (bound - start + delta - 1) / delta;
+            break;
+        case GREATER_EQUAL:
+            --bound;
+            // fall through
+        case GREATER:
+            if (start <= bound) return 0;
+            if (delta > 0) return -1;
+            trips = (start - bound - delta - 1) / -delta;
+            break;
+        case BANG_EQUAL:
+            if ((bound - start) % delta != 0 || (bound - start) / delta < 0) return -1;
+            trips = (bound - start) / delta;
+            break;
+        case EQUAL_EQUAL:
+            trips = start == bound;
+            break;
+        default:
+            return -1;
+    }
+    // the last step still has to stay an int
+    long long last = start + trips * delta;
+    if (last < INT_MIN || last > INT_MAX) return -1;
+    return trips;
+}
+
+// What each side of a loop condition holds on entry, for trip_count.
+// Returns a mask of the sides that are known.
+static int entry_values(Folder* f, int condition, int* start) {
+    AST* ast = f->ast;
+    if (ast->kind[condition] != NODE_BINOP || !is_comparison(ast->op[condition])) return 0;
+    int known = 0;
+    for (int side = 0; side < 2; ++side) {
+        if (evaluate(f, ast_child(ast, condition, side), &start[side])) known |= 1 << side;
+    }
+    return known;
+}
+
+// Number of times a loop runs when its condition compares a variable that a
+// single statement moves by a constant (the step of a for, a top level
+// statement of a while) against a bound the loop leaves alone; 0 when that
+// cannot be told. Called once kill_assigned has forgotten what the loop
+// assigns, with entry_values taken before.
+static int trip_count(Folder* f, int condition, int body, int step, const int* start, int known) {
+    AST* ast = f->ast;
+    static const TokenType mirrored[] = {
+        [LESS] = GREATER, [LESS_EQUAL] = GREATER_EQUAL, [GREATER] = LESS, [GREATER_EQUAL] = LESS_EQUAL,
+        [EQUAL_EQUAL] = EQUAL_EQUAL, [BANG_EQUAL] = BANG_EQUAL,
+    };
+    for (int side = 0; side < 2; ++side) {
+        int counter = ast_child(ast, condition, side);
+        int bound;
+        if (!(known & (1 << side)) || ast->kind[counter] != NODE_VAR || resolve(f, counter) < 0 ||
+            !evaluate(f, ast_child(ast, condition, !side), &bound)) continue;
+        int name = ast->value[counter];
+        int stmt = step;
+        if (step == NO_NODE) {
+            for (stmt = ast->first_child[body]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]) {
+                if (ast->kind[stmt] == NODE_ASSIGN && ast->value[stmt] == name) break;
+            }
+        }
+        int delta;
+        if (stmt == NO_NODE || count_assignments(ast, body, name) + (step != NO_NODE) != 1 ||
+            !counter_step(f, stmt, name, &delta)) continue;
+        TokenType compare = side ? mirrored[ast->op[condition]] : ast->op[condition];
+        long long trips = iterations(compare, start[side], bound, delta);
+        return trips > 0 && trips <= INT_MAX ? (int) trips : 0;
+    }
+    return 0;
+}
+
+static void fold_block(Folder* f, int block);
+
+// returns 0 when the statement can never run and should be dropped
+static int fold_statement(Folder* f, int node) {
+    AST* ast = f->ast;
+    switch (ast->kind[node]) {
+        case NODE_VAR_DECL: {
+            int literal = ast->first_child[node];
+            // check_names has reported duplicates already
+            if (add_symbol(&f->scopes, ast->value[node], node, ast->op[node], ast->value[literal])
+                && ast->op[node] == INT_TYPE) {
+                set_value(f, node, 1, ast->value[literal]);
+            }
+            return 1;
+        }
+        case NODE_ASSIGN: {
+            int value = ast->first_child[node];
+            fold_expression(f, value);
+            int decl = resolve(f, node);
+            if (decl >= 0) {
+                if (ast->kind[value] == NODE_INT) set_value(f, decl, 1, ast->value[value]);
+                else set_value(f, decl, 0, 0);
+            }
+            return 1;
+        }
+        case NODE_PRINT:
+            for (int item = ast->first_child[node]; item != NO_NODE; item = ast->next_sibling[item]) {
+                // strings can't be assigned, a string variable printed is its literal
+                Symbol* sym = ast->kind[item] == NODE_VAR ? find_symbol(&f->scopes, ast->value[item]) : NULL;
+                if (sym && sym->type == STRING_TYPE) make_constant(ast, item, NODE_STRING, sym->value);
+                else fold_expression(f, item);
+            }
+            return 1;
+        case NODE_RETURN:
+            fold_expression(f, ast->first_child[node]);
+            return 1;
+        case NODE_BLOCK:
+            fold_block(f, node);
+            return 1;
+        case NODE_IF: {
+            int condition = ast_child(ast, node, 0);
+            int body = ast_child(ast, node, 1);
+            fold_condition(f, condition);
+            if (ast->kind[condition] == NODE_BOOL) {
+                if (!ast->value[condition]) return 0;
+                // always taken: the if is just its block
+                fold_block(f, body);
+                replace_node(ast, node, body);
+                return 1;
+            }
+            int mark = f->trail_count;
+            fold_block(f, body);
+            merge_paths(f, mark);
+            return 1;
+        }
+        case NODE_WHILE: {
+            int condition = ast_child(ast, node, 0);
+            int body = ast_child(ast, node, 1);
+            int value;
+            if (evaluate(f, condition, &value)) {
+                if (!value) return 0;
+                // runs at least once, code generation can skip the entry test
+                ast->value[node] = -1;
+            }
+            int start[2];
+            int known = entry_values(f, condition, start);
+            // what the loop assigns is unknown at its head on every iteration
+            // and so after it too; what it leaves alone is known throughout
+            kill_assigned(f, node);
+            int trips = trip_count(f, condition, body, NO_NODE, start, known);
+            if (trips) ast->value[node] = trips;
+            int mark = f->trail_count;
+            fold_condition(f, condition);
+            fold_block(f, body);
+            undo_to(f, mark);
+            return 1;
+        }
+        case NODE_FOR: {
+            int init = ast_child(ast, node, 0);
+            int condition = ast_child(ast, node, 1);
+            int step = ast_child(ast, node, 2);
+            int body = ast_child(ast, node, 3);
+            push_scope(&f->scopes);
+            fold_statement(f, init);
+            int value;
+            if (evaluate(f, condition, &value)) {
+                if (!value) {
+                    pop_scope(&f->scopes);
+                    // an init that only declares the loop variable goes with the loop
+                    if (ast->kind[init] == NODE_VAR_DECL) return 0;
+                    replace_node(ast, node, init);
+                    return 1;
+                }
+                ast->value[node] = -1;
+            }
+            int start[2];
+            int known = entry_values(f, condition, start);
+            // the init runs once, but the step makes the loop variable as
+            // unknown as anything else the loop assigns
+            kill_assigned(f, step);
+            kill_assigned(f, body);
+            int trips = trip_count(f, condition, body, step, start, known);
+            if (trips) ast->value[node] = trips;
+            int mark = f->trail_count;
+            fold_condition(f, condition);
+            fold_block(f, body);
+            fold_statement(f, step);
+            undo_to(f, mark);
+            pop_scope(&f->scopes);
+            return 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+static void fold_block(Folder* f, int block) {
+    AST* ast = f->ast;
+    push_scope(&f->scopes);
+    int prev = NO_NODE;
+    for (int stmt = ast->first_child[block]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]) {
+        if (!fold_statement(f, stmt)) {
+            // unlink it, prev stays where it is
+            if (prev == NO_NODE) ast->first_child[block] = ast->next_sibling[stmt];
+            else ast->next_sibling[prev] = ast->next_sibling[stmt];
+            if (ast->last_child[block] == stmt) ast->last_child[block] = prev;
+            continue;
+        }
+        prev = stmt;
+        if (ast->kind[stmt] == NODE_RETURN) {
+            // nothing after a return runs
+            ast->next_sibling[stmt] = NO_NODE;
+            ast->last_child[block] = stmt;
+            break;
+        }
+    }
+    pop_scope(&f->scopes);
+}
+
+void fold_constants(AST* ast, int function) {
+    Folder f;
+    f.ast = ast;
+    init_symbol_table(&f.scopes);
+    f.known = (unsigned char*) grow(NULL, ast->count);
+    f.value = (int*) grow(NULL, sizeof(int) * ast->count);
+    f.stamp = (int*) grow(NULL, sizeof(int) * ast->count);
+    memset(f.known, 0, ast->count);
+    memset(f.stamp, 0, sizeof(int) * ast->count);
+    f.stamp_counter = 0;
+    f.trail_capacity = 64;
+    f.trail_count = 0;
+    f.trail = (Change*) grow(NULL, sizeof(Change) * f.trail_capacity);
+    f.merged = (Change*) grow(NULL, sizeof(Change) * f.trail_capacity);
+
+    fold_block(&f, ast->first_child[function]);
+
+    counted_free(f.known);
+    counted_free(f.value);
+    counted_free(f.stamp);
+    counted_free(f.trail);
+    counted_free(f.merged);
+    free_symbol_table(&f.scopes);
+}
@@ -0,0 +1,24 @@
+#ifndef CONST_FOLD_H
+#define CONST_FOLD_H
+
+#include "parser.h"
+
+// Forward constant propagation over one function, rewriting the tree in
+// place. Int variables whose value is known at a use are replaced by the
+// value, operators on constants are evaluated, conditions that are known
+// become true/false (comparisons of string literals and string variables
+// included, strings can't be assigned), and ifs, whiles and fors that can never run are
+// unlinked from their block along with statements following a return. Loops
+// that are entered at least once are marked through their value, which is
+// their trip count when a counter moved by a constant decides it.
+//
+// A variable assigned anywhere inside a while loop is unknown for the whole
+// loop and after it; at the end of an if a variable keeps its value only if
+// both paths agree on it.
+void fold_constants(AST* ast, int function);
+
+// whether evaluating an expression can raise an exception: + and - left in
+// it compile to add, sub or addi, which trap on overflow
+int can_trap(const AST* ast, int node);
+
+#endif
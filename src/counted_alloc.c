@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include "counted_alloc.h"
+
+// keeps the block behind it aligned like malloc's
+typedef union {
+    struct {
+        size_t size;
+        AllocLink link;  // in the scope it was allocated in, both NULL outside any
+    } block;
+    long double align_ld;
+    void* align_ptr;
+    long long align_ll;
+} Header;
+
+static long long allocations;
+static size_t live_bytes;
+static size_t peak_bytes;
+
+static _Thread_local AllocScope* current_scope;
+
+static void record(long long calls, size_t added, size_t removed) {
+    if (calls) __atomic_add_fetch(&allocations, calls, __ATOMIC_RELAXED);
+    if (removed) __atomic_sub_fetch(&live_bytes, removed, __ATOMIC_RELAXED);
+    if (!added) return;
+    size_t live = __atomic_add_fetch(&live_bytes, added, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&peak_bytes, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static Header* header_of(AllocLink* link) {
+    return (Header*) ((char*) link - offsetof(Header, block.link));
+}
+
+static void link_block(Header* header) {
+    AllocLink* link = &header->block.link;
+    if (!current_scope) {
+        link->prev = link->next = NULL;
+        return;
+    }
+    AllocLink* head = &current_scope->blocks;
+    link->prev = head;
+    link->next = head->next;
+    head->next->prev = link;
+    head->next = link;
+}
+
+static void unlink_block(Header* header) {
+    AllocLink* link = &header->block.link;
+    if (!link->prev) return;
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+}
+
+void* counted_malloc(size_t size) {
+    Header* header = (Header*) malloc(sizeof(Header) + size);
+    if (!header) return NULL;
+    header->block.size = size;
+    link_block(header);
+    record(1, size, 0);
+    return header + 1;
+}
+
+void* counted_calloc(size_t count, size_t size) {
+    if (size && count > ((size_t) -1 - sizeof(Header)) / size) return NULL;
+    void* ptr = counted_malloc(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* counted_realloc(void* ptr, size_t size) {
+    if (!ptr) return counted_malloc(size);
+    Header* old = (Header*) ptr - 1;
+    size_t old_size = old->block.size;
+    Header* header = (Header*) realloc(old, sizeof(Header) + size);
+    if (!header) return NULL;
+    header->block.size = size;
+    // the neighbours still point at the old address
+    AllocLink* link = &header->block.link;
+    if (link->prev) {
+        link->prev->next = link;
+        link->next->prev = link;
+    }
+    record(1, size, old_size);
+    return header + 1;
+}
+
+void counted_free(void* ptr) {
+    if (!ptr) return;
+    Header* header = (Header*) ptr - 1;
+    unlink_block(header);
+    record(0, 0, header->block.size);
+    free(header);
+}
+
+void counted_stats(AllocStats* stats) {
+    stats->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    stats->live_bytes = __atomic_load_n(&live_bytes, __ATOMIC_RELAXED);
+    stats->peak_bytes = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+}
+
+void counted_reset_peak(void) {
+    __atomic_store_n(&peak_bytes, __atomic_load_n(&live_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+void counted_begin_scope(AllocScope* scope) {
+    scope->blocks.prev = scope->blocks.next = &scope->blocks;
+    scope->outer = current_scope;
+    current_scope = scope;
+}
+
+void counted_end_scope(AllocScope* scope, int release) {
+    AllocLink* head = &scope->blocks;
+    for (AllocLink* link = head->next; link != head;) {
+        AllocLink* next = link->next;
+        Header* header = header_of(link);
+        if (release) {
+            record(0, 0, header->block.size);
+            free(header);
+        } else {
+            link->prev = link->next = NULL;
+        }
+        link = next;
+    }
+    head->prev = head->next = head;
+    current_scope = scope->outer;
+}
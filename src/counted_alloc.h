@@ -0,0 +1,44 @@
+#ifndef COUNTED_ALLOC_H
+#define COUNTED_ALLOC_H
+
+#include <stddef.h>
+
+// malloc, calloc, realloc and free that count the allocations made and the
+// bytes in use, for --stats. Each block carries its size in a small header,
+// so a block from here must go back through counted_free or counted_realloc
+// and never through free. They fail like their libc counterparts, returning
+// NULL. The counters are process wide and safe to update from any thread.
+typedef struct {
+    long long allocations;  // malloc, calloc and realloc calls that returned a new block
+    size_t live_bytes;
+    size_t peak_bytes;      // most live bytes since the start or the last counted_reset_peak
+} AllocStats;
+
+typedef struct AllocLink {
+    struct AllocLink* prev;
+    struct AllocLink* next;
+} AllocLink;
+
+// The blocks a thread allocates while a scope is open are linked into it, so
+// that a compile abandoned half way can free everything it allocated at once.
+typedef struct AllocScope {
+    AllocLink blocks;          // circular list, the scope itself is its head
+    struct AllocScope* outer;  // scope open on this thread before this one
+} AllocScope;
+
+void* counted_malloc(size_t size);
+void* counted_calloc(size_t count, size_t size);
+void* counted_realloc(void* ptr, size_t size);
+void counted_free(void* ptr);
+void counted_stats(AllocStats* stats);
+// starts a new peak from the bytes in use now
+void counted_reset_peak(void);
+
+// scope collects the blocks this thread allocates until it is ended
+void counted_begin_scope(AllocScope* scope);
+// Closes scope, the innermost one open on this thread. With release set the
+// blocks still live in it are freed, otherwise they are kept and become
+// ordinary blocks.
+void counted_end_scope(AllocScope* scope, int release);
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "diagnostics.h"
+
+static _Thread_local ErrorTrap* current_trap;
+
+void set_error_trap(ErrorTrap* trap) {
+    trap->message = NULL;
+    trap->outer = current_trap;
+    current_trap = trap;
+}
+
+void clear_error_trap(ErrorTrap* trap) {
+    current_trap = trap->outer;
+}
+
+void compile_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    ErrorTrap* trap = current_trap;
+    if (!trap) {
+        vfprintf(stderr, format, args);
+        va_end(args);
+        exit(EXIT_FAILURE);
+    }
+
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    trap->message = (char*) malloc(length > 0 ? length + 1 : 1);
+    if (trap->message) vsnprintf(trap->message, length + 1, format, args);
+    va_end(args);
+    longjmp(trap->env, 1);
+}
@@ -0,0 +1,22 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <setjmp.h>
+
+// Errors found while compiling. With no trap set an error is printed to
+// stderr and the process exits, which is all the command line needs.
+// compile() (compiler.h) sets a trap instead: the message is kept and the
+// compile unwinds to the trap's setjmp.
+typedef struct ErrorTrap {
+    jmp_buf env;
+    char* message;             // malloc'd, NULL until an error
+    struct ErrorTrap* outer;   // trap set on this thread before this one
+} ErrorTrap;
+
+// makes trap the one errors on this thread unwind to, until cleared
+void set_error_trap(ErrorTrap* trap);
+void clear_error_trap(ErrorTrap* trap);
+// message is printf style and ends in a newline
+void compile_error(const char* format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+void init_flow(FlowGraph* flow, int label_count) {
+    flow->code = NULL;
+    flow->count = 0;
+    flow->live_capacity = 0;
+    flow->live_in = NULL;
+    flow->label_count = label_count;
+    flow->label_pos = (int*)counted_malloc(sizeof(int) * (label_count + 1));
+    flow->label_refs = (int*)counted_malloc(sizeof(int) * (label_count + 1));
+    if (!flow->label_pos || !flow->label_refs) {
+        compile_error("Error: Malloc Failed on init_flow\n");
+    }
+}
+
+void free_flow(FlowGraph* flow) {
+    counted_free(flow->live_in);
+    counted_free(flow->label_pos);
+    counted_free(flow->label_refs);
+    flow->live_in = NULL;
+    flow->label_pos = flow->label_refs = NULL;
+}
+
+int is_branch(int op) {
+    return op >= OP_BEQ && op <= OP_BGE;
+}
+
+unsigned instr_uses(const Instr* in) {
+    switch (in->op) {
+        case OP_LW: case OP_MOVE: case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI:
+        case OP_SLL: case OP_SRL: case OP_SRA: case OP_SLTI:
+            return BIT(in->rs);
+        case OP_SW:
+            return BIT(in->rd) | BIT(in->rs);
+        case OP_ADD: case OP_SUB: case OP_ADDU: case OP_SUBU: case OP_MUL: case OP_AND: case OP_OR: case OP_DIV: case OP_MULT:
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BLE: case OP_BGT: case OP_BGE:
+            return BIT(in->rs) | BIT(in->rt);
+        case OP_MFLO: return BIT(REG_LO);
+        case OP_MFHI: return BIT(REG_HI);
+        case OP_JAL: return ARG_REGS | BIT(REG_SP);
+        case OP_JR: return BIT(in->rs) | BIT(REG_V0) | BIT(REG_SP) | CALLEE_SAVED;
+        case OP_SYSCALL: return BIT(REG_V0) | ARG_REGS;
+        default: return 0;
+    }
+}
+
+unsigned instr_defs(const Instr* in) {
+    switch (in->op) {
+        case OP_LI: case OP_LA: case OP_LW: case OP_MOVE:
+        case OP_ADD: case OP_SUB: case OP_ADDU: case OP_SUBU: case OP_AND: case OP_OR:
+        case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_SLL: case OP_SRL: case OP_SRA: case OP_SLTI:
+        case OP_MFLO: case OP_MFHI:
+            return BIT(in->rd);
+        case OP_MUL: return BIT(in->rd) | BIT(REG_LO) | BIT(REG_HI); // spim expands it through mult
+        case OP_DIV: case OP_MULT: return BIT(REG_LO) | BIT(REG_HI);
+        case OP_JAL:
+            if (in->label == LABEL_STRCMP) return STRCMP_CLOBBERS;
+            if (in->label == LABEL_PRINT_STRING || in->label == LABEL_PRINT_INT || in->label == LABEL_PRINT_FLUSH) {
+                return PRINT_CLOBBERS;
+            }
+            return CALLER_SAVED;
+        case OP_SYSCALL: return BIT(REG_V0);
+        default: return 0;
+    }
+}
+
+// instructions whose only effect is the registers they define
+int is_pure(int op) {
+    return (op >= OP_LI && op <= OP_SLTI && op != OP_SW) || op == OP_DIV || op == OP_MULT || op == OP_MFLO || op == OP_MFHI;
+}
+
+// add, sub and addi raise an exception on signed overflow, so they stay even
+// when nobody reads their result
+int may_trap(int op) {
+    return op == OP_ADD || op == OP_SUB || op == OP_ADDI;
+}
+
+// pure instructions that write their result to rd, so rd can be renamed
+int defines_rd(int op) {
+    return is_pure(op) && op != OP_DIV && op != OP_MULT;
+}
+
+static unsigned live_at_label(const FlowGraph* flow, int label) {
+    if (label < 0 || label >= flow->label_count || flow->label_pos[label] < 0) return ~0u;
+    return flow->live_in[flow->label_pos[label]];
+}
+
+unsigned live_out(const FlowGraph* flow, int i) {
+    const Instr* in = &flow->code[i];
+    unsigned out = 0;
+    if (is_branch(in->op) || in->op == OP_J) out |= live_at_label(flow, in->label);
+    if (in->op != OP_J && in->op != OP_JR) {
+        // running off the end would fall into the runtime helpers
+        out |= i + 1 < flow->count ? flow->live_in[i + 1] : ~0u;
+    }
+    return out & ~BIT(REG_ZERO);
+}
+
+// backward dataflow to a fixed point; loops only need a couple of passes
+static void compute_liveness(FlowGraph* flow) {
+    memset(flow->live_in, 0, sizeof(unsigned) * flow->count);
+    int changed;
+    do {
+        changed = 0;
+        for (int i = flow->count - 1; i >= 0; --i) {
+            const Instr* in = &flow->code[i];
+            unsigned live = (instr_uses(in) | (live_out(flow, i) & ~instr_defs(in))) & ~BIT(REG_ZERO);
+            if (live != flow->live_in[i]) {
+                flow->live_in[i] = live;
+                changed = 1;
+            }
+        }
+    } while (changed);
+}
+
+static void index_labels(FlowGraph* flow) {
+    memset(flow->label_pos, -1, sizeof(int) * flow->label_count);
+    memset(flow->label_refs, 0, sizeof(int) * flow->label_count);
+    for (int i = 0; i < flow->count; ++i) {
+        const Instr* in = &flow->code[i];
+        if (in->label < 0 || in->label >= flow->label_count) continue;
+        if (in->op == OP_LABEL) {
+            flow->label_pos[in->label] = i;
+        } else if (is_branch(in->op) || in->op == OP_J) {
+            ++flow->label_refs[in->label];
+        }
+    }
+}
+
+// next instruction after i that is neither a comment nor deleted
+int next_instr(const FlowGraph* flow, int i) {
+    for (++i; i < flow->count; ++i) {
+        if (flow->code[i].op != OP_COMMENT && flow->code[i].op != OP_NOP) break;
+    }
+    return i;
+}
+
+// first real instruction executed after jumping to label
+int label_target(const FlowGraph* flow, int label) {
+    if (label < 0 || label >= flow->label_count || flow->label_pos[label] < 0) return flow->count;
+    int i = flow->label_pos[label];
+    while (i < flow->count && (flow->code[i].op == OP_LABEL || flow->code[i].op == OP_COMMENT || flow->code[i].op == OP_NOP)) {
+        ++i;
+    }
+    return i;
+}
+
+void analyze_flow(FlowGraph* flow, Instr* code, int count) {
+    if (count + 1 > flow->live_capacity) {
+        flow->live_capacity = count + 1;
+        flow->live_in = (unsigned*)counted_realloc(flow->live_in, sizeof(unsigned) * flow->live_capacity);
+        if (!flow->live_in) {
+            compile_error("Error: Realloc Failed on analyze_flow\n");
+        }
+    }
+    flow->code = code;
+    flow->count = count;
+    index_labels(flow);
+    compute_liveness(flow);
+}
@@ -0,0 +1,47 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include "code_gen.h"
+
+// $k0/$k1 are never emitted, so their liveness bits stand in for LO and HI
+#define REG_LO 26
+#define REG_HI 27
+#define BIT(reg) (1u << (reg))
+
+#define ARG_REGS (BIT(REG_A0) | BIT(REG_A1) | BIT(6) | BIT(7))
+#define TEMP_REGS (0xffu << REG_T0 | BIT(REG_T8) | BIT(REG_T9))
+#define CALLEE_SAVED ((0xffu << REG_S0) | BIT(REG_FP))
+#define CALLER_SAVED (BIT(1) | BIT(REG_V0) | BIT(3) | ARG_REGS | TEMP_REGS | BIT(REG_RA) | BIT(REG_LO) | BIT(REG_HI))
+// what util/strcmp.asm actually writes, so values survive a string compare
+#define STRCMP_CLOBBERS ((0xffu << REG_T0) | BIT(REG_V0) | BIT(REG_RA))
+// and what the routines of util/print.asm write
+#define PRINT_CLOBBERS (BIT(REG_A0) | BIT(REG_A1) | BIT(REG_V0) | BIT(REG_T8) | BIT(REG_T9) | BIT(REG_RA) | BIT(REG_LO) | BIT(REG_HI))
+
+// Control and data flow facts about the body segment, shared by the passes
+// that rewrite the generated instructions.
+typedef struct {
+    Instr* code;
+    int count;
+    unsigned* live_in;  // registers live before each instruction
+    int live_capacity;
+    int* label_pos;     // index of the OP_LABEL of each label, -1 when absent
+    int* label_refs;    // branches and jumps to each label
+    int label_count;
+} FlowGraph;
+
+void init_flow(FlowGraph* flow, int label_count);
+// indexes the labels of code and computes liveness to a fixed point
+void analyze_flow(FlowGraph* flow, Instr* code, int count);
+void free_flow(FlowGraph* flow);
+
+int is_branch(int op);
+unsigned instr_uses(const Instr* in);
+unsigned instr_defs(const Instr* in);
+int is_pure(int op);
+int may_trap(int op);
+int defines_rd(int op);
+unsigned live_out(const FlowGraph* flow, int i);
+int next_instr(const FlowGraph* flow, int i);
+int label_target(const FlowGraph* flow, int label);
+
+#endif
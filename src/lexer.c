@@ -1,176 +1,259 @@
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "lexer.h"
+#include "scan.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
 
-Keyword keywords[] = {
+const Keyword keywords[] = {
     {"and", LOGIC_AND}, {"or", LOGIC_OR}, {"if", IF}, {"true", TRUE}, {"false", FALSE},
     {"for", FOR}, {"while", WHILE}, {"main", MAIN}, {"print", PRINT}, {"return", RETURN},
     {"string", STRING_TYPE}, {"int", INT_TYPE},
 };
 
-TokenType check_keyword(const char* str) {
-    int i;
-    for (i = 0; i < (int)(sizeof(keywords) / sizeof(Keyword)); ++i) {
-        if (strcmp(str, keywords[i].keyword) == 0) {
-            return keywords[i].type;
+// character classes driving the scanner, one table lookup per byte instead of
+// a switch + ctype calls
+enum {
+    CC_INVALID = 0, // anything we do not lex: illegal token
+    CC_SPACE,       // ' ', \t, \r, \v, \f
+    CC_NEWLINE,     // \n
+    CC_HASH,        // '#' comment until end of line
+    CC_QUOTE,       // '"' string literal
+    CC_ALPHA,       // start of identifier / keyword
+    CC_DIGIT,       // start of int literal
+    CC_SINGLE,      // always a one character token
+    CC_EQ_SUFFIX,   // one character token, or two when followed by '='
+};
+
+static const unsigned char char_class[256] = {
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\r'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE,
+    ['\n'] = CC_NEWLINE,
+    ['#'] = CC_HASH,
+    ['"'] = CC_QUOTE,
+    ['a' ... 'z'] = CC_ALPHA, ['A' ... 'Z'] = CC_ALPHA,
+    ['0' ... '9'] = CC_DIGIT,
+    ['('] = CC_SINGLE, [')'] = CC_SINGLE, ['{'] = CC_SINGLE, ['}'] = CC_SINGLE,
+    ['['] = CC_SINGLE, [']'] = CC_SINGLE, [','] = CC_SINGLE, ['.'] = CC_SINGLE,
+    ['/'] = CC_SINGLE, ['*'] = CC_SINGLE, [';'] = CC_SINGLE, ['&'] = CC_SINGLE,
+    ['|'] = CC_SINGLE, ['%'] = CC_SINGLE,
+    ['-'] = CC_EQ_SUFFIX, ['+'] = CC_EQ_SUFFIX, ['!'] = CC_EQ_SUFFIX,
+    ['='] = CC_EQ_SUFFIX, ['>'] = CC_EQ_SUFFIX, ['<'] = CC_EQ_SUFFIX,
+};
+
+// token emitted for a CC_SINGLE / CC_EQ_SUFFIX character on its own
+static const TokenType single_token[256] = {
+    ['('] = OPEN_PAREN, [')'] = CLOSE_PAREN, ['{'] = OPEN_BRACE, ['}'] = CLOSE_BRACE,
+    ['['] = OPEN_BRACKET, [']'] = CLOSE_BRACKET, [','] = COMMA, ['.'] = DOT,
+    ['/'] = SLASH, ['*'] = STAR, [';'] = SEMICOLON, ['&'] = BIT_AND,
+    ['|'] = BIT_OR, ['%'] = MODULO,
+    ['-'] = MINUS, ['+'] = PLUS, ['!'] = BANG, ['='] = EQUAL, ['>'] = GREATER, ['<'] = LESS,
+};
+
+// token emitted for a CC_EQ_SUFFIX character followed by '='
+static const TokenType eq_token[256] = {
+    ['-'] = MINUS_EQUAL, ['+'] = PLUS_EQUAL, ['!'] = BANG_EQUAL,
+    ['='] = EQUAL_EQUAL, ['>'] = GREATER_EQUAL, ['<'] = LESS_EQUAL,
+};
+
+// text of the tokens that are not interned, indexed by TokenType
+static const char* token_lexeme[] = {
+    [OPEN_PAREN] = "(", [CLOSE_PAREN] = ")", [OPEN_BRACE] = "{", [CLOSE_BRACE] = "}",
+    [OPEN_BRACKET] = "[", [CLOSE_BRACKET] = "]",
+    [COMMA] = ",", [DOT] = ".", [MINUS] = "-", [PLUS] = "+", [SLASH] = "/", [STAR] = "*", [SEMICOLON] = ";",
+    [PLUS_EQUAL] = "+=", [MINUS_EQUAL] = "-=", [MODULO] = "%",
+    [BANG] = "!", [BANG_EQUAL] = "!=", [EQUAL] = "=", [EQUAL_EQUAL] = "==",
+    [GREATER] = ">", [GREATER_EQUAL] = ">=", [LESS] = "<", [LESS_EQUAL] = "<=",
+    [BIT_AND] = "&", [BIT_OR] = "|", [ROOT] = "",
+};
+
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(Keyword)))
+
+// keywords are interned first when the pool is created, so their ids are
+// their index in the keywords table
+TokenType check_keyword(int id) {
+    return id < KEYWORD_COUNT ? keywords[id].type : IDENTIFIER;
+}
+
+void add_token(Program* prog, TokenType type, unsigned int offset, unsigned int length, int line, int id){
+    if (prog->token_count >= prog->token_capacity) {
+        prog->token_capacity *= 2;
+        prog->tokens = counted_realloc(prog->tokens, sizeof(Token) * prog->token_capacity);
+        if (prog->tokens == NULL) {
+            compile_error("Error: Realloc Failed on add_token\n");
         }
     }
-    return IDENTIFIER;
+    Token* token = &prog->tokens[prog->token_count];
+    token->type = type;
+    token->line = line;
+    token->offset = offset;
+    token->length = length;
+    token->id = id;
+    ++prog->token_count;
 }
 
-Token* create_token(TokenType type, const char* data, int line){
-    Token* ret = (Token*) malloc(sizeof(Token));
-    ret->type = type;
-    ret->data = strdup(data);
-    ret->line = line;
-    return ret;
+const char* token_text(const Program* prog, const Token* token){
+    if (token->id >= 0) return pool_string(&prog->strings, token->id);
+    const char* lexeme = token_lexeme[token->type];
+    return lexeme ? lexeme : "";
 }
 
-void add_token(Token** tokens, int* token_count, int* token_capacity, Token* token){
-    if (*token_count >= *token_capacity) {
-        *token_capacity *= 2;
-        *tokens = realloc(*tokens, sizeof(Token) * (*token_capacity));
-        if (*tokens == NULL) {
-            fprintf(stderr, "Error: Realloc Failed on add_token\n");
-            exit(EXIT_FAILURE);
+// map regular files straight into memory, anything else (pipes, ttys) is
+// read in one go into a heap buffer
+int load_source(FILE* fp, SourceBuffer* src){
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+
+    struct stat st;
+    int fd = fileno(fp);
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) return 0;
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            src->data = (const char*) map;
+            src->size = st.st_size;
+            src->mapped = 1;
+            return 0;
+        }
+    }
+
+    size_t capacity = 1 << 16;
+    char* buf = (char*) malloc(capacity);
+    if (!buf) return -1;
+    size_t n;
+    while ((n = fread(buf + src->size, 1, capacity - src->size, fp)) > 0) {
+        src->size += n;
+        if (src->size == capacity) {
+            capacity *= 2;
+            char* grown = (char*) realloc(buf, capacity);
+            if (!grown) {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
         }
     }
-    // put content of token in array of tokens
-    (*tokens)[*token_count] = *token;
-    ++(*token_count);
-    free(token); // free the token (but not the char* within it)
-    token = NULL;
+    if (ferror(fp)) {
+        free(buf);
+        return -1;
+    }
+    src->data = buf;
+    return 0;
 }
 
-void lex_file(FILE* fp, Token** tokens, int* token_count, int* token_capacity){
-    if (*token_capacity != 0) exit(EXIT_FAILURE);
+void free_source(SourceBuffer* src){
+    if (src->mapped) {
+        munmap((void*) src->data, src->size);
+    } else {
+        free((void*) src->data);
+    }
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+}
 
-    *token_capacity = 100;
-    *token_count = 0;
-    *tokens = (Token*) malloc(sizeof(Token) * (*token_capacity));
+void lex_buffer(Program* prog){
+    if (prog->token_capacity != 0) compile_error("Error: program was already lexed\n");
 
-    char buf[256] = {'\0'};
-    int line = 1;
+    const char* src = prog->source.data;
+    size_t size = prog->source.size;
 
-    char c;
-    while ((c = getc(fp)) != EOF) {
-        if (c == '#'){
-            // move to the end of the line and go to next line
-            while ((c = getc(fp)) != EOF && c != '\n');
-            ++line;
-            continue;
-        }
-        if (isspace(c)) {
-            if (c == '\n') ++line;
-            continue;
-        }
+    // rough guess of one token per 6 bytes of source, so the array rarely grows
+    prog->token_capacity = size / 6 > 100 ? (int)(size / 6) : 100;
+    prog->token_count = 0;
+    prog->tokens = (Token*) counted_malloc(sizeof(Token) * prog->token_capacity);
 
-        switch (c) {
-            case '(': add_token(tokens, token_count, token_capacity, create_token(OPEN_PAREN, "(", line)); break;
-            case ')': add_token(tokens, token_count, token_capacity, create_token(CLOSE_PAREN, ")", line)); break;
-            case '{': add_token(tokens, token_count, token_capacity, create_token(OPEN_BRACE, "{", line)); break;
-            case '}': add_token(tokens, token_count, token_capacity, create_token(CLOSE_BRACE, "}", line)); break;
-            case '[': add_token(tokens, token_count, token_capacity, create_token(OPEN_BRACKET, "[", line)); break;
-            case ']': add_token(tokens, token_count, token_capacity, create_token(CLOSE_BRACKET, "]", line)); break;
-            case ',': add_token(tokens, token_count, token_capacity, create_token(COMMA, ",", line)); break;
-            case '.': add_token(tokens, token_count, token_capacity, create_token(DOT, ".", line)); break;
-            case '/': add_token(tokens, token_count, token_capacity, create_token(SLASH, "/", line)); break;
-            case '*': add_token(tokens, token_count, token_capacity, create_token(STAR, "*", line)); break;
-            case ';': add_token(tokens, token_count, token_capacity, create_token(SEMICOLON, ";", line)); break;
-            case '&': add_token(tokens, token_count, token_capacity, create_token(BIT_AND, "&", line)); break;
-            case '|': add_token(tokens, token_count, token_capacity, create_token(BIT_OR, "|", line)); break;
-            case '%': add_token(tokens, token_count, token_capacity, create_token(MODULO, "%", line)); break;
-            case '-': 
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(MINUS_EQUAL, "-=", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(MINUS, "-", line));
-                }
+    init_string_pool(&prog->strings);
+    for (int i = 0; i < KEYWORD_COUNT; ++i) {
+        intern_string(&prog->strings, keywords[i].keyword, strlen(keywords[i].keyword));
+    }
+
+    // runs of whitespace, comments, strings, identifiers and digits go
+    // through the widest vector kernels this CPU has
+    const ScanKernels* scan = scan_kernels();
+
+    const char* base = src;
+    const char* p = base;
+    const char* end = p + size;
+    int line = 1;
+
+    while (p < end) {
+        const char* start = p;
+        unsigned char c = *p;
+        switch (char_class[c]) {
+            case CC_NEWLINE:
+            case CC_SPACE:
+                p = scan->skip_whitespace(p, end, &line);
                 break;
-            case '+':
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(PLUS_EQUAL, "+=", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(PLUS, "+", line));
-                }
+            case CC_HASH:
+                // move to the end of the line and go to next line
+                p = scan->find_eol(p, end);
+                if (p < end) ++p;
+                ++line;
                 break;
-            case '!': 
-                // check for != or just !
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(BANG_EQUAL, "!=", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(BANG, "!", line));
-                }
+            case CC_SINGLE:
+                ++p;
+                add_token(prog, single_token[c], start - base, 1, line, -1);
                 break;
-            case '=':
-                // check for == or just =
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(EQUAL_EQUAL, "==", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(EQUAL, "=", line));
+            case CC_EQ_SUFFIX:
+                if (p + 1 < end && p[1] == '=') {
+                    p += 2;
+                    add_token(prog, eq_token[c], start - base, 2, line, -1);
+                } else {
+                    ++p;
+                    add_token(prog, single_token[c], start - base, 1, line, -1);
                 }
                 break;
-            case '>':
-                // check for >= or just >
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(GREATER_EQUAL, ">=", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(GREATER, ">", line));
+            case CC_QUOTE: {
+                // string, kept with its surrounding quotes
+                int start_line = line;
+                p = scan->find_quote(p + 1, end, &line);
+                if (p == end) {
+                    compile_error("Unterminated string literal on line %d\n", start_line);
                 }
+                ++p;
+                int id = intern_string(&prog->strings, start, p - start);
+                add_token(prog, STRING_LITERAL, start - base, p - start, start_line, id);
                 break;
-            case '<':
-                // check for <= or just <
-                if ((c = getc(fp)) == '=') {
-                    add_token(tokens, token_count, token_capacity, create_token(LESS_EQUAL, "<=", line));
-                }else{
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(LESS, "<", line));
-                }
+            }
+            case CC_ALPHA: {
+                // identifier or keyword or main
+                p = scan->ident_run(p + 1, end);
+                int id = intern_string(&prog->strings, start, p - start);
+                add_token(prog, check_keyword(id), start - base, p - start, line, id);
                 break;
-            case '"':
-                // string
-                buf[0] = c;
-                int i = 1;
-                while ((c = getc(fp))) {
-                    buf[i] = c;
-                    ++i;
-                    if (c == '"') break;
-                }
-                buf[i] = '\0';
-                add_token(tokens, token_count, token_capacity, create_token(STRING_LITERAL, buf, line));
+            }
+            case CC_DIGIT: {
+                // number
+                p = scan->digit_run(p + 1, end);
+                int id = intern_string(&prog->strings, start, p - start);
+                add_token(prog, INT_LITERAL, start - base, p - start, line, id);
                 break;
+            }
             default:
-                buf[0] = c;
-                if (isalpha(c)){
-                    // identifier or keyword or main
-                    int i = 1;
-                    while (isalnum(c = getc(fp)) || c == '_') {
-                        buf[i] = c;
-                        ++i;
-                    }
-                    buf[i] = '\0';
-                    ungetc(c, fp); // put the ending char back into file stream
-                    TokenType type = check_keyword(buf);
-                    add_token(tokens, token_count, token_capacity, create_token(type, buf, line));
-                } else if (isdigit(c)) {
-                    // number
-                    int i = 1;
-                    while (isdigit(c = getc(fp))) {
-                        buf[i] = c;
-                        ++i;
-                    }
-                    buf[i] = '\0';
-                    ungetc(c, fp);
-                    add_token(tokens, token_count, token_capacity, create_token(INT_LITERAL, buf, line));
-                } else {
-                    fprintf(stderr, "Illegal token: '%c' on line %d\n", c, line);
-                    exit(EXIT_FAILURE);
-                }
-                break;
+                compile_error("Illegal token: '%c' on line %d\n", c, line);
         }
     }
 }
+
+void lex_file(FILE* fp, Program* prog){
+    prog->tokens = NULL;
+    prog->token_count = 0;
+    prog->token_capacity = 0;
+    if (load_source(fp, &prog->source) != 0) {
+        compile_error("Error: could not read input file\n");
+    }
+    lex_buffer(prog);
+}
+
+void free_program(Program* prog){
+    counted_free(prog->tokens);
+    prog->tokens = NULL;
+    prog->token_count = prog->token_capacity = 0;
+    free_string_pool(&prog->strings);
+    free_source(&prog->source);
+}
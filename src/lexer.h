@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "string_pool.h"
 
 typedef enum{
     OPEN_PAREN, CLOSE_PAREN, OPEN_BRACE, CLOSE_BRACE,
@@ -22,10 +23,15 @@ typedef enum{
     ROOT
 } TokenType;
 
+// A token is a span into the source buffer. Identifiers, keywords and
+// literals also carry the id of their text in the program's string pool;
+// punctuation has no id (-1) and gets its text from the token type.
 typedef struct{
     TokenType type;
-    char* data;
     int line;
+    unsigned int offset;
+    unsigned int length;
+    int id;
 } Token;
 
 typedef struct {
@@ -33,9 +39,28 @@ typedef struct {
     TokenType type;
 } Keyword;
 
-TokenType check_keyword(const char* str);
-Token* create_token(TokenType type, const char* data, int line);
-void add_token(Token** tokens, int* token_count, int* token_capacity, Token* token);
-void lex_file(FILE* fp, Token** tokens, int* token_count, int* token_capacity);
+// whole input file, either mmap'd or read into a heap buffer
+typedef struct {
+    const char* data;
+    size_t size;
+    int mapped;
+} SourceBuffer;
+
+typedef struct{
+    Token* tokens;
+    int token_count;
+    int token_capacity;
+    SourceBuffer source;  // tokens point into this, so it lives as long as they do
+    StringPool strings;
+} Program;
+
+TokenType check_keyword(int id);
+void add_token(Program* prog, TokenType type, unsigned int offset, unsigned int length, int line, int id);
+const char* token_text(const Program* prog, const Token* token);
+int load_source(FILE* fp, SourceBuffer* src);
+void free_source(SourceBuffer* src);
+void lex_buffer(Program* prog);
+void lex_file(FILE* fp, Program* prog);
+void free_program(Program* prog);
 
 #endif
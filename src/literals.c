@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "literals.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+// a literal's bytes as the assembler lays them out, quotes and escapes gone
+typedef struct {
+    int id;
+    const unsigned char* bytes;
+    int length;
+} Decoded;
+
+static void* grow(void* ptr, size_t size) {
+    ptr = counted_realloc(ptr, size);
+    if (!ptr) {
+        compile_error("Error: Realloc Failed on layout_literals\n");
+    }
+    return ptr;
+}
+
+// Decodes text (quotes included) into out. Returns 0 for an escape that is
+// not plainly one byte, such a literal is left to itself.
+static int decode(const char* text, int length, unsigned char* out, int* out_length) {
+    int n = 0;
+    for (int i = 1; i < length - 1; ++i) {
+        char c = text[i];
+        if (c == '\\') {
+            if (i + 1 >= length - 1) return 0;
+            switch (text[++i]) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                case '\\': c = '\\'; break;
+                default: return 0;
+            }
+        }
+        out[n++] = (unsigned char) c;
+    }
+    *out_length = n;
+    return 1;
+}
+
+// string literals under node, each pool id once
+static void collect(const AST* ast, int node, unsigned char* seen, int* ids, int* count) {
+    if (ast->kind[node] == NODE_STRING && !seen[ast->value[node]]) {
+        seen[ast->value[node]] = 1;
+        ids[(*count)++] = ast->value[node];
+    }
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        collect(ast, child, seen, ids, count);
+    }
+}
+
+// orders by the reversed bytes, so that the literals a literal is a suffix of
+// follow it directly
+static int compare_reversed(const void* a, const void* b) {
+    const Decoded* x = (const Decoded*) a;
+    const Decoded* y = (const Decoded*) b;
+    int n = x->length < y->length ? x->length : y->length;
+    for (int k = 1; k <= n; ++k) {
+        int d = (int) x->bytes[x->length - k] - (int) y->bytes[y->length - k];
+        if (d) return d;
+    }
+    if (x->length != y->length) return x->length - y->length;
+    return x->id - y->id;
+}
+
+static int is_suffix(const Decoded* suffix, const Decoded* of) {
+    return suffix->length <= of->length &&
+        memcmp(suffix->bytes, of->bytes + of->length - suffix->length, suffix->length) == 0;
+}
+
+void layout_literals(const AST* ast, LiteralLayout* layout) {
+    const StringPool* strings = &ast->prog->strings;
+    int count = strings->count;
+    layout->count = count;
+    layout->host = (int*) grow(NULL, sizeof(int) * (count + 1));
+    layout->offset = (int*) grow(NULL, sizeof(int) * (count + 1));
+    layout->length = (int*) grow(NULL, sizeof(int) * (count + 1));
+    for (int id = 0; id < count; ++id) {
+        layout->host[id] = id;
+        layout->offset[id] = 0;
+        layout->length[id] = -1;
+    }
+    if (ast->root == NO_NODE) return;
+
+    unsigned char* seen = (unsigned char*) grow(NULL, count + 1);
+    memset(seen, 0, count + 1);
+    int* ids = (int*) grow(NULL, sizeof(int) * (count + 1));
+    int id_count = 0;
+    collect(ast, ast->root, seen, ids, &id_count);
+
+    size_t total = 0;
+    for (int i = 0; i < id_count; ++i) total += pool_length(strings, ids[i]);
+    unsigned char* bytes = (unsigned char*) grow(NULL, total + 1);
+    Decoded* decoded = (Decoded*) grow(NULL, sizeof(Decoded) * (id_count + 1));
+    int n = 0;
+    size_t used = 0;
+    for (int i = 0; i < id_count; ++i) {
+        Decoded* d = &decoded[n];
+        d->id = ids[i];
+        d->bytes = bytes + used;
+        if (!decode(pool_string(strings, ids[i]), pool_length(strings, ids[i]), bytes + used, &d->length)) continue;
+        if (!memchr(d->bytes, 0, d->length)) layout->length[ids[i]] = d->length;
+        used += d->length;
+        ++n;
+    }
+
+    // a literal that is a suffix of the next one in this order lives wherever
+    // that one does
+    qsort(decoded, n, sizeof(Decoded), compare_reversed);
+    for (int i = n - 2; i >= 0; --i) {
+        const Decoded* next = &decoded[i + 1];
+        if (!is_suffix(&decoded[i], next)) continue;
+        layout->host[decoded[i].id] = layout->host[next->id];
+        layout->offset[decoded[i].id] = layout->offset[next->id] + next->length - decoded[i].length;
+    }
+
+    counted_free(decoded);
+    counted_free(bytes);
+    counted_free(ids);
+    counted_free(seen);
+}
+
+void free_literal_layout(LiteralLayout* layout) {
+    counted_free(layout->host);
+    counted_free(layout->offset);
+    counted_free(layout->length);
+    layout->host = layout->offset = layout->length = NULL;
+    layout->count = 0;
+}
+
+int compare_literals(const StringPool* strings, int a, int b, int* result) {
+    int a_length, b_length;
+    unsigned char* bytes = (unsigned char*) grow(NULL, pool_length(strings, a) + pool_length(strings, b) + 2);
+    unsigned char* a_bytes = bytes;
+    unsigned char* b_bytes = bytes + pool_length(strings, a) + 1;
+    int known = decode(pool_string(strings, a), pool_length(strings, a), a_bytes, &a_length)
+        && decode(pool_string(strings, b), pool_length(strings, b), b_bytes, &b_length);
+    if (known) {
+        // the terminator ends either early when there is a \0 inside
+        a_bytes[a_length] = b_bytes[b_length] = '\0';
+        int d = strcmp((const char*) a_bytes, (const char*) b_bytes);
+        *result = (d > 0) - (d < 0);
+    }
+    counted_free(bytes);
+    return known;
+}
@@ -0,0 +1,28 @@
+#ifndef LITERALS_H
+#define LITERALS_H
+
+#include "parser.h"
+
+// Where the bytes of the string literals of a program live in .data, indexed
+// by string pool id. The pool already keys literals by their text, so each
+// distinct one is stored once; on top of that a literal whose bytes end
+// another one points into it instead of getting storage of its own: "ing" is
+// "string" + 3, both ending in the same NUL.
+typedef struct {
+    int* host;    // pool id of the literal holding the bytes, the id itself when stored on its own
+    int* offset;  // byte offset into the host
+    int* length;  // bytes before the terminator, -1 when escapes hide them or a \0 ends the literal early
+    int count;
+} LiteralLayout;
+
+// Lays out the literals reachable from the root, so ones folded away don't
+// end up holding the bytes of others.
+void layout_literals(const AST* ast, LiteralLayout* layout);
+void free_literal_layout(LiteralLayout* layout);
+
+// Compares two string pool entries the way util/strcmp.asm compares their
+// bytes at run time, *result is -1, 0 or 1. Returns 0 when an escape keeps
+// either one's bytes unknown.
+int compare_literals(const StringPool* strings, int a, int b, int* result);
+
+#endif
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loop_opt.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+typedef struct {
+    int head;  // first label of the loop, the preheader goes in front of it
+    int back;  // the backward branch or jump closing it
+    int first; // its hoisted instructions in the preheader list
+    int count;
+} Loop;
+
+static void* grow(void* block, size_t size) {
+    block = counted_realloc(block, size);
+    if (!block) {
+        compile_error("Error: Realloc Failed on hoist_loop_invariants\n");
+    }
+    return block;
+}
+
+static int by_span(const void* a, const void* b) {
+    const Loop* x = (const Loop*) a;
+    const Loop* y = (const Loop*) b;
+    return (x->back - x->head) - (y->back - y->head);
+}
+
+static int by_head(const void* a, const void* b) {
+    return ((const Loop*) a)->head - ((const Loop*) b)->head;
+}
+
+// is every label in [head, back] only reached from inside it?
+static int single_entry(const FlowGraph* flow, int head, int back) {
+    for (int i = head; i <= back; ++i) {
+        const Instr* in = &flow->code[i];
+        if (in->op != OP_LABEL || in->label < 0 || in->label >= flow->label_count) continue;
+        int inside = 0;
+        for (int k = head; k <= back; ++k) {
+            const Instr* ref = &flow->code[k];
+            if ((is_branch(ref->op) || ref->op == OP_J) && ref->label == in->label) ++inside;
+        }
+        if (inside != flow->label_refs[in->label]) return 0;
+    }
+    return 1;
+}
+
+// the explicit register operands instr_uses reports, renamed from -> to
+static void rename_use(Instr* in, int from, int to) {
+    switch (in->op) {
+        case OP_SW:
+            if (in->rd == from) in->rd = to;
+            if (in->rs == from) in->rs = to;
+            return;
+        case OP_ADD: case OP_SUB: case OP_ADDU: case OP_SUBU: case OP_MUL: case OP_AND: case OP_OR: case OP_DIV: case OP_MULT:
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BLE: case OP_BGT: case OP_BGE:
+            if (in->rt == from) in->rt = to;
+            // fall through
+        default:
+            if (in->rs == from) in->rs = to;
+            return;
+    }
+}
+
+static int written(const int* def_count, unsigned regs) {
+    for (int r = 1; r < 32; ++r) {
+        if ((regs & BIT(r)) && def_count[r]) return 1;
+    }
+    return 0;
+}
+
+static int has_implicit_uses(int op) {
+    return op == OP_SYSCALL || op == OP_JAL || op == OP_JR || op == OP_MFLO || op == OP_MFHI;
+}
+
+// Collects the uses of what code[def] leaves in its rd, up to where that value
+// dies within its basic block. Returns 0 when the value reaches past the
+// block or is read by something that cannot be renamed.
+static int block_uses(const FlowGraph* flow, int def, int* uses, int* use_count) {
+    int reg = flow->code[def].rd;
+    *use_count = 0;
+    for (int j = next_instr(flow, def); j < flow->count; j = next_instr(flow, j)) {
+        const Instr* in = &flow->code[j];
+        if (in->op == OP_LABEL) return !(flow->live_in[j] & BIT(reg));
+        if (instr_uses(in) & BIT(reg)) {
+            if (has_implicit_uses(in->op)) return 0;
+            uses[(*use_count)++] = j;
+        }
+        if (is_branch(in->op) || in->op == OP_J || in->op == OP_JR) return !(live_out(flow, j) & BIT(reg));
+        if (instr_defs(in) & BIT(reg)) return 1;
+    }
+    return 0;
+}
+
+// Pulls what it can out of the loop, appending the moved instructions to
+// preheader. Returns how many were moved.
+static int hoist_loop(FlowGraph* flow, Loop* loop, Instr** preheader, int* preheader_count, int* scratch) {
+    Instr* code = flow->code;
+    int def_count[32] = {0};
+    unsigned referenced = 0;
+    int stores_memory = 0;
+    unsigned char frame_stored[64] = {0}; // frame slots the loop writes, the far ones share the last entry
+    for (int i = loop->head; i <= loop->back; ++i) {
+        const Instr* in = &code[i];
+        unsigned defs = instr_defs(in);
+        for (int r = 0; r < 32; ++r) {
+            if (defs & BIT(r)) ++def_count[r];
+        }
+        referenced |= defs | instr_uses(in);
+        if (in->op == OP_SW) {
+            if (in->rs == REG_FP) {
+                int slot = in->imm / 4;
+                frame_stored[slot >= 0 && slot < 63 ? slot : 63] = 1;
+            } else if (in->rs != REG_SP) {
+                stores_memory = 1;
+            }
+        }
+    }
+    unsigned free_regs = TEMP_REGS & ~referenced & ~flow->live_in[loop->head];
+
+    int moved = 0;
+    for (int i = loop->head; i <= loop->back && free_regs; ++i) {
+        Instr* in = &code[i];
+        int invariant;
+        switch (in->op) {
+            case OP_LI: case OP_LA:
+                invariant = 1;
+                break;
+            case OP_LW:
+                if (in->rs == REG_FP) {
+                    int slot = in->imm / 4;
+                    invariant = !frame_stored[slot >= 0 && slot < 63 ? slot : 63];
+                } else {
+                    invariant = in->rs != REG_SP && !stores_memory && !written(def_count, BIT(in->rs));
+                }
+                break;
+            // add, sub and addi trap on overflow, so they stay where the
+            // program put them
+            case OP_ADDU: case OP_SUBU: case OP_MUL:
+            case OP_SLL: case OP_SRL: case OP_SRA: case OP_AND: case OP_OR:
+            case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_SLTI:
+                invariant = !written(def_count, instr_uses(in));
+                if (in->op == OP_MUL && (live_out(flow, i) & (BIT(REG_LO) | BIT(REG_HI)))) invariant = 0;
+                break;
+            default:
+                invariant = 0;
+                break;
+        }
+        if (!invariant || in->rd == REG_ZERO) continue;
+
+        int use_count;
+        int renamable = block_uses(flow, i, scratch, &use_count) && use_count > 0;
+        // an address still beats its two instruction la as a move, say when
+        // it is a syscall argument
+        int wide = in->op == OP_LA || (in->op == OP_LI && (in->imm < -32768 || in->imm > 65535));
+        if (!renamable && !wide) continue;
+
+        // the same constant or address twice shares one register
+        int reg = -1;
+        if (in->op == OP_LI || in->op == OP_LA) {
+            for (int p = loop->first; p < *preheader_count; ++p) {
+                const Instr* earlier = &(*preheader)[p];
+                if (earlier->op == in->op && earlier->imm == in->imm && earlier->label == in->label) reg = earlier->rd;
+            }
+        }
+        if (reg < 0) {
+            reg = __builtin_ctz(free_regs);
+            free_regs &= ~BIT(reg);
+            (*preheader)[(*preheader_count)++] = *in;
+            (*preheader)[*preheader_count - 1].rd = reg;
+            ++loop->count;
+        }
+        if (renamable) {
+            for (int u = 0; u < use_count; ++u) rename_use(&code[scratch[u]], in->rd, reg);
+            unsigned defs = instr_defs(in);
+            for (int r = 0; r < 32; ++r) {
+                if (defs & BIT(r)) --def_count[r];
+            }
+            in->op = OP_NOP;
+        } else {
+            *in = (Instr){OP_MOVE, in->rd, reg, 0, 0, NO_LABEL, in->line};
+        }
+        ++moved;
+    }
+    return moved;
+}
+
+int hoist_loop_invariants(CodeBuffer* buffer, FlowGraph* flow) {
+    int total = 0;
+    Loop* loops = NULL;
+    int loop_capacity = 0;
+    Instr* preheader = NULL;
+    int* scratch = NULL;
+    char* touched = NULL;
+
+    for (;;) {
+        analyze_flow(flow, buffer->body, buffer->body_count);
+        int count = flow->count;
+        Instr* code = flow->code;
+
+        int loop_count = 0;
+        for (int b = 0; b < count; ++b) {
+            if (!is_branch(code[b].op) && code[b].op != OP_J) continue;
+            int label = code[b].label;
+            if (label < 0 || label >= flow->label_count) continue;
+            int head = flow->label_pos[label];
+            if (head < 0 || head > b) continue;
+            // labels stacked on the head belong to it
+            while (head > 0 && (code[head - 1].op == OP_LABEL || code[head - 1].op == OP_COMMENT)) --head;
+            if (!single_entry(flow, head, b)) continue;
+            if (loop_count == loop_capacity) {
+                loop_capacity = loop_capacity ? loop_capacity * 2 : 16;
+                loops = (Loop*) grow(loops, sizeof(Loop) * loop_capacity);
+            }
+            loops[loop_count++] = (Loop){head, b, 0, 0};
+        }
+        if (loop_count == 0) break;
+
+        preheader = (Instr*) grow(preheader, sizeof(Instr) * count);
+        scratch = (int*) grow(scratch, sizeof(int) * count);
+        touched = (char*) grow(touched, count);
+        memset(touched, 0, count);
+
+        // innermost first; a loop around one that changed waits for the next
+        // round, when the flow facts describe the moved code
+        qsort(loops, loop_count, sizeof(Loop), by_span);
+        int preheader_count = 0;
+        int moved = 0;
+        for (int l = 0; l < loop_count; ++l) {
+            Loop* loop = &loops[l];
+            if (memchr(&touched[loop->head], 1, loop->back - loop->head + 1)) continue;
+            loop->first = preheader_count;
+            int n = hoist_loop(flow, loop, &preheader, &preheader_count, scratch);
+            if (n == 0) continue;
+            moved += n;
+            memset(&touched[loop->head], 1, loop->back - loop->head + 1);
+        }
+        if (moved == 0) break;
+        total += moved;
+
+        qsort(loops, loop_count, sizeof(Loop), by_head);
+        Instr* body = (Instr*) counted_malloc(sizeof(Instr) * (buffer->body_capacity > count + moved ? buffer->body_capacity : count + moved));
+        if (!body) {
+            compile_error("Error: Malloc Failed on hoist_loop_invariants\n");
+        }
+        int kept = 0;
+        int l = 0;
+        for (int i = 0; i < count; ++i) {
+            for (; l < loop_count && loops[l].head == i; ++l) {
+                memcpy(&body[kept], &preheader[loops[l].first], sizeof(Instr) * loops[l].count);
+                kept += loops[l].count;
+            }
+            if (code[i].op != OP_NOP) body[kept++] = code[i];
+        }
+        counted_free(buffer->body);
+        buffer->body = body;
+        buffer->body_count = kept;
+        if (buffer->body_capacity < count + moved) buffer->body_capacity = count + moved;
+    }
+
+    counted_free(loops);
+    counted_free(preheader);
+    counted_free(scratch);
+    counted_free(touched);
+    return total;
+}
@@ -0,0 +1,16 @@
+#ifndef LOOP_OPT_H
+#define LOOP_OPT_H
+
+#include "code_gen.h"
+#include "flow.h"
+
+// Loop-invariant code motion over the body segment. A loop is a backward
+// branch or jump together with everything from its target label down to it,
+// entered only by falling into the label. Address and constant loads, loads of
+// frame slots and memory words the loop never stores to, and pure operations
+// on registers the loop never writes are moved in front of the loop into a
+// temporary the loop leaves alone. Returns how many instructions were moved;
+// flow is clobbered.
+int hoist_loop_invariants(CodeBuffer* buffer, FlowGraph* flow);
+
+#endif
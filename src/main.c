@@ -1,41 +1,283 @@
-
+#include <time.h>
 #include "lexer.h"
 #include "parser.h"
 #include "code_gen.h"
+#include "sim.h"
+#include "counted_alloc.h"
+#include "batch.h"
+
+#define MAX_PHASES 8
+
+// where one phase of the compile went, for --stats
+typedef struct {
+    const char* name;
+    double wall;              // seconds
+    double cpu;
+    long long allocations;    // made through the counting allocator during the phase
+    size_t peak_bytes;        // most bytes it held at once, whatever earlier phases left included
+} Phase;
+
+typedef struct {
+    Phase phases[MAX_PHASES];
+    int count;
+    double wall_start, cpu_start;
+    long long allocations_start;
+} PhaseTimer;
+
+static double clock_seconds(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-void free_program_tokens(Program* prog){
-    int i;
-    for (i=0; i<prog->token_count; ++i) {
-        free(prog->tokens[i].data);
-        prog->tokens[i].data = NULL;
+static void begin_phase(PhaseTimer* timer){
+    AllocStats alloc;
+    counted_reset_peak();
+    counted_stats(&alloc);
+    timer->allocations_start = alloc.allocations;
+    timer->wall_start = clock_seconds(CLOCK_MONOTONIC);
+    timer->cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static void end_phase(PhaseTimer* timer, const char* name){
+    double wall = clock_seconds(CLOCK_MONOTONIC);
+    double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    AllocStats alloc;
+    counted_stats(&alloc);
+    if (timer->count == MAX_PHASES) return;
+    Phase* phase = &timer->phases[timer->count++];
+    phase->name = name;
+    phase->wall = wall - timer->wall_start;
+    phase->cpu = cpu - timer->cpu_start;
+    phase->allocations = alloc.allocations - timer->allocations_start;
+    phase->peak_bytes = alloc.peak_bytes;
+}
+
+static void print_stats(const PhaseTimer* timer, const Program* prog, const AST* ast,
+                        const CodeBuffer* buffer, size_t asm_bytes){
+    double wall = 0, cpu = 0;
+    long long allocations = 0;
+    size_t peak = 0;
+    fprintf(stderr, "stats:\n");
+    fprintf(stderr, "  %-8s %10s %10s %12s %12s\n", "phase", "wall ms", "cpu ms", "allocations", "peak KB");
+    for (int i = 0; i < timer->count; ++i){
+        const Phase* phase = &timer->phases[i];
+        fprintf(stderr, "  %-8s %10.3f %10.3f %12lld %12.1f\n", phase->name, phase->wall * 1e3,
+                phase->cpu * 1e3, phase->allocations, phase->peak_bytes / 1024.0);
+        wall += phase->wall;
+        cpu += phase->cpu;
+        allocations += phase->allocations;
+        if (phase->peak_bytes > peak) peak = phase->peak_bytes;
     }
-    free(prog->tokens);
-    prog->tokens = NULL;
+    fprintf(stderr, "  %-8s %10.3f %10.3f %12lld %12.1f\n", "total", wall * 1e3, cpu * 1e3,
+            allocations, peak / 1024.0);
+    fprintf(stderr, "  source: %zu bytes, %d tokens, %d distinct strings\n",
+            prog->source.size, prog->token_count, prog->strings.count);
+    fprintf(stderr, "  ast: %d nodes, %d symbols\n", ast->count, buffer->symbol_count);
+    fprintf(stderr, "  output: %zu bytes, .text %d instructions + %d bytes of runtime, .data %d entries\n",
+            asm_bytes, buffer->body_count, buffer->util_size, buffer->data_count);
+}
+
+static void usage(void){
+    fprintf(stderr, "Usage: ./a.out [-O0|-O1] [--peephole-stats] [-fno-strength-reduce] [-funroll=N] [-g] [--run] [--profile] [--stats] [-v] input.code\n");
+    fprintf(stderr, "       ./a.out [-O0|-O1] [-fno-strength-reduce] [-funroll=N] [-g] [-j N] -o outdir input.code...\n");
+    exit(EXIT_FAILURE);
+}
+
+// Prints the source lines that ran, the most cycles first, with the
+// instructions and cycles they account for.
+static void print_profile(const SimProfile* profile, const SimStats* stats, const SourceBuffer* source){
+    int* order = (int*) malloc(sizeof(int) * (profile->line_count + 1));
+    const char** text = (const char**) calloc(profile->line_count + 1, sizeof(const char*));
+    if (!order || !text){
+        fprintf(stderr, "Error: Malloc Failed on print_profile\n");
+        exit(EXIT_FAILURE);
+    }
+    int line = 1;
+    for (size_t i = 0; i < source->size && line < profile->line_count; ++i){
+        if (i == 0 || source->data[i - 1] == '\n'){
+            text[line++] = source->data + i;
+        }
+    }
+
+    int count = 0;
+    for (int l = 0; l < profile->line_count; ++l){
+        if (profile->instructions[l]) order[count++] = l;
+    }
+    // insertion sort, there are only as many entries as source lines
+    for (int i = 1; i < count; ++i){
+        int l = order[i], j = i;
+        for (; j > 0 && profile->cycles[order[j - 1]] < profile->cycles[l]; --j) order[j] = order[j - 1];
+        order[j] = l;
+    }
+
+    fprintf(stderr, "profile: cycles per source line, runtime routines included in the line calling them\n");
+    fprintf(stderr, "  %6s %14s %14s %6s  %s\n", "line", "instructions", "cycles", "%", "source");
+    for (int i = 0; i < count; ++i){
+        int l = order[i];
+        double share = stats->cycles ? 100.0 * profile->cycles[l] / stats->cycles : 0.0;
+        fprintf(stderr, "  %6d %14lld %14lld %6.1f  ", l, profile->instructions[l], profile->cycles[l], share);
+        if (l && text[l]){
+            const char* start = text[l];
+            const char* end = source->data + source->size;
+            while (start < end && (*start == ' ' || *start == '\t')) ++start;
+            const char* stop = start;
+            while (stop < end && *stop != '\n' && *stop != '\r') ++stop;
+            fprintf(stderr, "%.*s\n", (int) (stop - start), start);
+        }else{
+            fprintf(stderr, "(no source line)\n");
+        }
+    }
+    free(text);
+    free(order);
+}
+
+// runs the generated assembly in the built-in simulator, the program's
+// output to stdout and the counters to stderr, with a per line profile
+// when given the source
+static void run_output(const char* filename, const SourceBuffer* source){
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char* text = (char*) malloc(size + 1);
+    if (!text || fread(text, 1, size, fp) != (size_t) size){
+        fprintf(stderr, "Error reading %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+
+    SimStats stats;
+    SimProfile profile = {0};
+    simulate(text, size, stdout, &stats, source ? &profile : NULL);
+    print_sim_stats(&stats, stderr);
+    if (source){
+        print_profile(&profile, &stats, source);
+        free_sim_profile(&profile);
+    }
+    free(text);
 }
 
 int main(int argc, char** argv){
-    if (argc != 2){
-        fprintf(stderr, "Usage: ./a.out input.code\n");
+    CodegenOptions options = {0, 0, 1, 1, 0};
+    const char** inputs = (const char**) malloc(sizeof(const char*) * argc);
+    if (!inputs){
+        fprintf(stderr, "Error: Malloc Failed on main\n");
         exit(EXIT_FAILURE);
     }
-    FILE* fp = fopen(argv[1], "r");
+    int input_count = 0;
+    const char* outdir = NULL;
+    int threads = 0;
+    int run = 0;
+    int profile = 0;
+    int stats = 0;
+    int verbose = 0;
+    for (int i = 1; i < argc; ++i){
+        if (strcmp(argv[i], "-O0") == 0){
+            options.opt_level = 0;
+        }else if (strcmp(argv[i], "-O1") == 0){
+            options.opt_level = 1;
+        }else if (strcmp(argv[i], "--peephole-stats") == 0){
+            options.peephole_stats = 1;
+        }else if (strcmp(argv[i], "--run") == 0){
+            run = 1;
+        }else if (strcmp(argv[i], "--stats") == 0){
+            stats = 1;
+        }else if (strcmp(argv[i], "-v") == 0){
+            verbose = 1;
+        }else if (strcmp(argv[i], "-g") == 0){
+            options.line_comments = 1;
+        }else if (strcmp(argv[i], "--profile") == 0){
+            run = profile = 1;
+            options.line_comments = 1;
+        }else if (strcmp(argv[i], "-fno-strength-reduce") == 0){
+            options.strength_reduce = 0;
+        }else if (strncmp(argv[i], "-funroll=", 9) == 0){
+            char* end;
+            long factor = strtol(argv[i] + 9, &end, 10);
+            if (end == argv[i] + 9 || *end != '\0' || factor < 1 || factor > 64){
+                usage();
+            }
+            options.unroll = (int) factor;
+        }else if (strncmp(argv[i], "-j", 2) == 0){
+            const char* count = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            char* end;
+            long n = strtol(count, &end, 10);
+            if (end == count || *end != '\0' || n < 1 || n > 1024){
+                usage();
+            }
+            threads = (int) n;
+        }else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc){
+            outdir = argv[++i];
+        }else if (argv[i][0] == '-'){
+            usage();
+        }else{
+            inputs[input_count++] = argv[i];
+        }
+    }
+    if (input_count == 0){
+        usage();
+    }
+
+    // several inputs, -j or -o: each file into outdir, on a pool of threads
+    if (input_count > 1 || threads || outdir){
+        if (!outdir || run || stats || verbose || options.peephole_stats){
+            usage();
+        }
+        int failed = compile_batch(inputs, input_count, outdir, threads ? threads : 1, &options);
+        free(inputs);
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    const char* input = inputs[0];
+    FILE* fp = fopen(input, "r");
     if (fp == NULL){
-        fprintf(stderr, "Invalid input file: %s\n", argv[1]);
+        fprintf(stderr, "Invalid input file: %s\n", input);
         exit(EXIT_FAILURE);
     }
 
-    Program prog = {NULL, 0, 0};
-    lex_file(fp, &prog.tokens, &prog.token_count, &prog.token_capacity);
+    PhaseTimer timer = {0};
+    Program prog;
+    begin_phase(&timer);
+    lex_file(fp, &prog);
+    end_phase(&timer, "lex");
 
     AST ast;
+    begin_phase(&timer);
     build_ast(&prog, &ast);
+    end_phase(&timer, "parse");
 
-    print_ast(ast.root, 0);
+    if (verbose){
+        begin_phase(&timer);
+        print_ast(&ast, ast.root, 0);
+        end_phase(&timer, "ast dump");
+    }
+
+    CodeBuffer buffer;
+    begin_phase(&timer);
+    generate_mips_buffer(&ast, &buffer, &options);
+    end_phase(&timer, "codegen");
+
+    begin_phase(&timer);
+    size_t asm_bytes = write_buffer_to_file(&buffer, "out.asm");
+    end_phase(&timer, "write");
 
-    generate_mips_code(&ast, "out.asm");
+    if (run){
+        begin_phase(&timer);
+        run_output("out.asm", profile ? &prog.source : NULL);
+        end_phase(&timer, "run");
+    }
+    if (stats){
+        print_stats(&timer, &prog, &ast, &buffer, asm_bytes);
+    }
 
+    free_buffer(&buffer);
     free_ast(&ast);
-    free_program_tokens(&prog);
+    free_program(&prog);
     fclose(fp);
+    free(inputs);
     return EXIT_SUCCESS;
 }
@@ -3,39 +3,69 @@
 #include <string.h>
 #include "lexer.h"
 #include "parser.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
 
-void add_child(struct TokenNode* parent, Token* child) {
-    if (parent->children == NULL) {
-        parent->children_capacity = 5;
-        parent->children = (struct TokenNode*)malloc(sizeof(struct TokenNode) * parent->children_capacity);
-    } else if (parent->children_count == parent->children_capacity){
-        parent->children_capacity *= 2;
-        parent->children = (struct TokenNode*)realloc(parent->children, sizeof(struct TokenNode) * parent->children_capacity);
+#define INITIAL_AST_NODES 64
+
+static void reserve_nodes(AST* ast, int capacity) {
+    ast->capacity = capacity;
+    ast->kind = (NodeKind*)counted_realloc(ast->kind, sizeof(NodeKind) * ast->capacity);
+    ast->op = (TokenType*)counted_realloc(ast->op, sizeof(TokenType) * ast->capacity);
+    ast->value = (int*)counted_realloc(ast->value, sizeof(int) * ast->capacity);
+    ast->token = (int*)counted_realloc(ast->token, sizeof(int) * ast->capacity);
+    ast->first_child = (int*)counted_realloc(ast->first_child, sizeof(int) * ast->capacity);
+    ast->next_sibling = (int*)counted_realloc(ast->next_sibling, sizeof(int) * ast->capacity);
+    ast->last_child = (int*)counted_realloc(ast->last_child, sizeof(int) * ast->capacity);
+    if (!ast->kind || !ast->op || !ast->value || !ast->token || !ast->first_child || !ast->next_sibling || !ast->last_child) {
+        compile_error("Error: Realloc Failed on add_node\n");
     }
+}
 
-    parent->children[parent->children_count].children_count = 0;
-    parent->children[parent->children_count].children_capacity = 0;
-    parent->children[parent->children_count].children = NULL;
-    parent->children[parent->children_count].token_data = child;
+int add_node(AST* ast, NodeKind kind, int token) {
+    if (ast->count == ast->capacity) {
+        reserve_nodes(ast, ast->capacity ? ast->capacity * 2 : INITIAL_AST_NODES);
+    }
+    int node = ast->count++;
+    ast->kind[node] = kind;
+    ast->op[node] = ROOT;
+    ast->value[node] = 0;
+    ast->token[node] = token;
+    ast->first_child[node] = NO_NODE;
+    ast->next_sibling[node] = NO_NODE;
+    ast->last_child[node] = NO_NODE;
+    return node;
+}
 
-    ++parent->children_count;
+void append_child(AST* ast, int parent, int child) {
+    if (ast->last_child[parent] == NO_NODE) {
+        ast->first_child[parent] = child;
+    } else {
+        ast->next_sibling[ast->last_child[parent]] = child;
+    }
+    ast->last_child[parent] = child;
 }
 
-void stack_push(Stack* s, struct TokenNode* node){
-    if (s->buf == NULL){
-        s->capacity = 10;
-        s->buf = (struct TokenNode**) malloc(sizeof(struct TokenNode*) * s->capacity);
-    }else if (s->size == s->capacity){
-        s->capacity *= 2;
-        s->buf = (struct TokenNode**) realloc(s->buf, sizeof(struct TokenNode*) * s->capacity);
+Token* ast_token(const AST* ast, int node) {
+    if (node == NO_NODE || ast->token[node] < 0) return NULL;
+    return &ast->prog->tokens[ast->token[node]];
+}
+
+// index-th child of node, NO_NODE if it has fewer children
+int ast_child(const AST* ast, int node, int index) {
+    int child = ast->first_child[node];
+    while (child != NO_NODE && index-- > 0) {
+        child = ast->next_sibling[child];
     }
-    s->buf[s->size] = node;
-    ++s->size;
+    return child;
 }
 
-void stack_pop(Stack* s){
-    if (s->buf == NULL || s->size <= 0) return;
-    --s->size;
+int ast_child_count(const AST* ast, int node) {
+    int count = 0;
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        ++count;
+    }
+    return count;
 }
 
 // TODO: this is only a helper for debugging
@@ -50,124 +80,398 @@ const char *token_type_to_string[] = {
 
     "IDENTIFIER", "STRING_LITERAL", "INT_LITERAL", "STRING_TYPE", "INT_TYPE", "MAIN",
 
-    "BIT_AND", "BIT_OR", "LOGIC_AND", "LOGIC_OR", "IF", "ELSEIF", "ELSE", "TRUE", "FALSE", "FOR", "WHILE", 
+    "BIT_AND", "BIT_OR", "LOGIC_AND", "LOGIC_OR", "IF", "TRUE", "FALSE", "FOR", "WHILE",
     "PRINT", "RETURN", "ROOT"
 };
 
-void build_ast(Program* prog, AST* ast) {
-    if (!prog || prog->token_count == 0) {
-        fprintf(stderr, "Error: Program has no tokens.\n");
-        return;
-    }
-
-    ast->root = (struct TokenNode*)malloc(sizeof(struct TokenNode));
-    ast->root->token_data = create_token(ROOT, "", 0);
-    ast->root->children = NULL;
-    ast->root->children_capacity = 0;
-    ast->root->children_count = 0;
-
-    Stack parent_stack = {NULL, 0, 0};
-    stack_push(&parent_stack, ast->root);
-
-    TokenType parent_keywords[][2] = {{IF, CLOSE_BRACE}, {WHILE, CLOSE_BRACE}, {FOR, CLOSE_BRACE},
-                                    {MAIN, CLOSE_BRACE}, {RETURN, INT_LITERAL},
-                                    {PRINT, CLOSE_PAREN}, {STRING_TYPE, STRING_LITERAL}, {INT_TYPE, INT_LITERAL},
-                                    {PLUS, SEMICOLON}, {MINUS, SEMICOLON}, {SLASH, SEMICOLON}, {STAR, SEMICOLON},
-                                    {PLUS_EQUAL, SEMICOLON}, {MINUS_EQUAL, SEMICOLON}, {MODULO, SEMICOLON},
-                                    {BIT_AND, SEMICOLON}, {BIT_OR, SEMICOLON}};
-
-    TokenType parent_enclosers[][2] = {{OPEN_BRACE, CLOSE_BRACE}, {OPEN_PAREN, CLOSE_PAREN},
-                                    {OPEN_BRACKET, CLOSE_BRACKET}};
-
-    for (int i=0; i<prog->token_count; ++i) {
-        if (parent_stack.size == 0) break; // we removed the root
-
-        Token* curr_token = &prog->tokens[i];
-        struct TokenNode* parent_node = parent_stack.buf[parent_stack.size-1];
-
-        // TokenNode is 4 bytes, each parent_token is one tokens
-        int new_layer = 0;
-        for (int j = 0; j < (int)(sizeof(parent_enclosers)/(sizeof(TokenType)*2)); ++j){
-            if (curr_token->type == parent_enclosers[j][0]) {
-                new_layer = 1; break;
-            }else if (curr_token->type == parent_enclosers[j][1]) {
-                new_layer = -1; break;
-            }
+const char *node_kind_to_string[] = {
+    "PROGRAM", "FUNCTION", "BLOCK", "VAR_DECL", "ASSIGN", "IF", "WHILE", "FOR", "PRINT", "RETURN",
+    "BINOP", "INT", "STRING", "BOOL", "VAR"
+};
+
+// Binding power of the infix operators, loosest first. Anything that is not
+// in the table ends an expression, which is how juxtaposed print items
+// ("print(x "\n")") are told apart.
+enum {
+    PREC_NONE = 0,
+    PREC_OR,
+    PREC_AND,
+    PREC_COMPARE,
+    PREC_BIT_OR,
+    PREC_BIT_AND,
+    PREC_SUM,
+    PREC_PRODUCT,
+};
+
+static const int binary_precedence[ROOT + 1] = {
+    [LOGIC_OR] = PREC_OR, [LOGIC_AND] = PREC_AND,
+    [EQUAL_EQUAL] = PREC_COMPARE, [BANG_EQUAL] = PREC_COMPARE,
+    [LESS] = PREC_COMPARE, [LESS_EQUAL] = PREC_COMPARE,
+    [GREATER] = PREC_COMPARE, [GREATER_EQUAL] = PREC_COMPARE,
+    [BIT_OR] = PREC_BIT_OR, [BIT_AND] = PREC_BIT_AND,
+    [PLUS] = PREC_SUM, [MINUS] = PREC_SUM,
+    [STAR] = PREC_PRODUCT, [SLASH] = PREC_PRODUCT, [MODULO] = PREC_PRODUCT,
+};
+
+typedef struct {
+    Program* prog;
+    AST* ast;
+    int pos; // index of the lookahead token
+} Parser;
+
+static TokenType peek(const Parser* p) {
+    return p->pos < p->prog->token_count ? p->prog->tokens[p->pos].type : ROOT;
+}
+
+static void syntax_error(const Parser* p, const char* expected) {
+    if (p->pos < p->prog->token_count) {
+        Token* token = &p->prog->tokens[p->pos];
+        compile_error("Syntax error on line %d: expected %s, found '%s'\n",
+                      token->line, expected, token_text(p->prog, token));
+    }
+    compile_error("Syntax error: expected %s, found end of input\n", expected);
+}
+
+static void node_error(const Parser* p, int node, const char* message) {
+    compile_error("Error on line %d: %s\n", ast_token(p->ast, node)->line, message);
+}
+
+// consumes a token of the given type and returns its index
+static int expect(Parser* p, TokenType type, const char* expected) {
+    if (peek(p) != type) syntax_error(p, expected);
+    return p->pos++;
+}
+
+static int comparison_op(TokenType t) {
+    return binary_precedence[t] == PREC_COMPARE;
+}
+
+// true/false, comparisons and and/or: only meaningful as an if/while condition
+int is_condition_node(const AST* ast, int node) {
+    if (ast->kind[node] == NODE_BOOL) return 1;
+    if (ast->kind[node] != NODE_BINOP) return 0;
+    TokenType op = ast->op[node];
+    return op == LOGIC_AND || op == LOGIC_OR || comparison_op(op);
+}
+
+static int make_binop(Parser* p, TokenType op, int token, int left, int right) {
+    int node = add_node(p->ast, NODE_BINOP, token);
+    p->ast->op[node] = op;
+    append_child(p->ast, node, left);
+    append_child(p->ast, node, right);
+    return node;
+}
+
+static int make_var(Parser* p, int token) {
+    int node = add_node(p->ast, NODE_VAR, token);
+    p->ast->value[node] = p->prog->tokens[token].id;
+    return node;
+}
+
+static int make_int(Parser* p, int token) {
+    const char* text = token_text(p->prog, &p->prog->tokens[token]);
+    long long value = strtoll(text, NULL, 10);
+    int node = add_node(p->ast, NODE_INT, token);
+    if (value > 0x7fffffffLL) node_error(p, node, "integer literal does not fit in 32 bits");
+    p->ast->value[node] = (int) value;
+    return node;
+}
+
+static int parse_expression(Parser* p, int min_prec);
+
+static int parse_primary(Parser* p) {
+    int token = p->pos;
+    int node;
+    switch (peek(p)) {
+        case INT_LITERAL:
+            ++p->pos;
+            return make_int(p, token);
+        case STRING_LITERAL:
+            ++p->pos;
+            node = add_node(p->ast, NODE_STRING, token);
+            p->ast->value[node] = p->prog->tokens[token].id;
+            return node;
+        case TRUE:
+        case FALSE:
+            ++p->pos;
+            node = add_node(p->ast, NODE_BOOL, token);
+            p->ast->value[node] = p->prog->tokens[token].type == TRUE;
+            return node;
+        case IDENTIFIER:
+            ++p->pos;
+            return make_var(p, token);
+        case OPEN_PAREN:
+            ++p->pos;
+            node = parse_expression(p, PREC_OR);
+            expect(p, CLOSE_PAREN, "')'");
+            return node;
+        default:
+            syntax_error(p, "an expression");
+            return NO_NODE;
+    }
+}
+
+// precedence climbing: parses operators that bind at least as tightly as
+// min_prec, all of them left associative except comparisons, which do not chain
+static int parse_expression(Parser* p, int min_prec) {
+    int left = parse_primary(p);
+    for (;;) {
+        TokenType op = peek(p);
+        int prec = binary_precedence[op];
+        if (prec == PREC_NONE || prec < min_prec) break;
+        int token = p->pos++;
+        int right = parse_expression(p, prec + 1);
+
+        if (prec >= PREC_COMPARE) {
+            if (is_condition_node(p->ast, left)) node_error(p, left, "a condition cannot be an operand here");
+            if (is_condition_node(p->ast, right)) node_error(p, right, "a condition cannot be an operand here");
         }
-        for (int j=0; j < (int)(sizeof(parent_keywords)/(sizeof(TokenType)*2)); ++j){
-            if (curr_token->type == parent_keywords[j][0]){
-                new_layer = 1; break;
-            }else if (parent_node->token_data->type == parent_keywords[j][0]
-                     && curr_token->type == parent_keywords[j][1]){
-                new_layer = -1; break;
-            }
-        }
-        if (new_layer == 1){
-            // open new ast layer
-            add_child(parent_node, curr_token);
-            stack_push(&parent_stack, &parent_node->children[parent_node->children_count - 1]);
-
-        } else if (new_layer == -1) {
-            // close ast layer
-            add_child(parent_node, curr_token); // add the child that terminates this parent layer
-            stack_pop(&parent_stack);
-            parent_node = parent_stack.buf[parent_stack.size-1]; // have to update the new top of stack
-
-            // Go back to original scope of conditonal
-            for (int j=0; j < (int)(sizeof(parent_keywords)/(sizeof(TokenType)*2)); ++j){
-                if (parent_node->token_data->type == parent_keywords[j][0] && curr_token->type == parent_keywords[j][1]){
-                    stack_pop(&parent_stack);
-                    parent_node = parent_stack.buf[parent_stack.size-1]; // have to update the new top of stack
-                    break;
-                }
-            }
-        } else {
-            // either adding to ast->root or adding within some ast layer
-            add_child(parent_node, curr_token);
+        if (prec > PREC_COMPARE &&
+            (p->ast->kind[left] == NODE_STRING || p->ast->kind[right] == NODE_STRING)) {
+            node_error(p, p->ast->kind[left] == NODE_STRING ? left : right,
+                       "arithmetic on a string literal");
         }
+        left = make_binop(p, op, token, left, right);
     }
-    if (parent_stack.buf){ // only the root should remain in stack
-        free(parent_stack.buf);
-        parent_stack.buf = NULL;
+    return left;
+}
+
+// an integer valued expression: print items, return values and operands
+static int parse_value(Parser* p) {
+    int node = parse_expression(p, PREC_OR);
+    if (is_condition_node(p->ast, node)) {
+        node_error(p, node, "conditions can only be used in if and while statements");
     }
+    return node;
 }
 
-void print_ast(struct TokenNode* root, int depth){
-    if (!root) return;
-    for (int i=0; i<depth; ++i){
-        printf("-");
+static int parse_condition(Parser* p) {
+    expect(p, OPEN_PAREN, "'(' before the condition");
+    int node = parse_expression(p, PREC_OR);
+    expect(p, CLOSE_PAREN, "')' after the condition");
+    return node;
+}
+
+static int parse_block(Parser* p);
+
+// int x = 5, string s = "text"
+static int parse_declaration(Parser* p) {
+    int type_token = p->pos++;
+    TokenType type = p->prog->tokens[type_token].type;
+    int name = expect(p, IDENTIFIER, "a variable name");
+    expect(p, EQUAL, "'='");
+
+    int node = add_node(p->ast, NODE_VAR_DECL, name);
+    p->ast->op[node] = type;
+    p->ast->value[node] = p->prog->tokens[name].id;
+    if (type == INT_TYPE) {
+        append_child(p->ast, node, make_int(p, expect(p, INT_LITERAL, "an integer literal")));
+    } else {
+        int literal = expect(p, STRING_LITERAL, "a string literal");
+        int value = add_node(p->ast, NODE_STRING, literal);
+        p->ast->value[value] = p->prog->tokens[literal].id;
+        append_child(p->ast, node, value);
+    }
+    return node;
+}
+
+// prefix arithmetic: "+ x a b;" is x = a + b, "+= x a;" is x = x + a. The
+// step of a for loop ends in its ')' instead of the ';'.
+static int parse_operation(Parser* p, TokenType end) {
+    int op_token = p->pos++;
+    TokenType op = p->prog->tokens[op_token].type;
+    int name = expect(p, IDENTIFIER, "the variable to assign");
+
+    int left, right;
+    if (op == PLUS_EQUAL || op == MINUS_EQUAL) {
+        left = make_var(p, name);
+        right = parse_primary(p);
+        op = op == PLUS_EQUAL ? PLUS : MINUS;
+    } else {
+        left = parse_primary(p);
+        if (peek(p) == end) syntax_error(p, "a second operand");
+        right = parse_primary(p);
     }
-    if (root->token_data){
-        printf("%s\t\t(%s, %d)\n", root->token_data->data,
-               token_type_to_string[root->token_data->type], root->children_count);
+    expect(p, end, end == SEMICOLON ? "';' to end the operation" : "')' after the step");
+    if (is_condition_node(p->ast, left) || p->ast->kind[left] == NODE_STRING) {
+        node_error(p, left, "operands of an arithmetic operation must be integers");
     }
-    for(int i=0; i<root->children_count; ++i){
-        print_ast(&root->children[i], depth+1);
+    if (is_condition_node(p->ast, right) || p->ast->kind[right] == NODE_STRING) {
+        node_error(p, right, "operands of an arithmetic operation must be integers");
     }
+
+    int node = add_node(p->ast, NODE_ASSIGN, name);
+    p->ast->value[node] = p->prog->tokens[name].id;
+    append_child(p->ast, node, make_binop(p, op, op_token, left, right));
+    return node;
 }
 
-void free_ast_children(struct TokenNode* node) {
-    if (!node) return;
-    for (int i = 0; i < node->children_count; ++i){
-        // search all possible depths
-        if (node->children[i].children_count > 0){
-            free_ast_children(&node->children[i]);
-        }
+static int is_operation(TokenType type) {
+    switch (type) {
+        case PLUS: case MINUS: case STAR: case SLASH: case MODULO:
+        case BIT_AND: case BIT_OR: case PLUS_EQUAL: case MINUS_EQUAL:
+            return 1;
+        default:
+            return 0;
     }
-    // we have found a node that, for all its children, has no more depth
-    if (node->children){
-        free(node->children);
-        node->children = NULL;
+}
+
+// for (int i = 0; i < n; += i 1) { ... }, the init is an int declaration
+// scoped to the loop or an operation
+static int parse_for(Parser* p, int token) {
+    int node = add_node(p->ast, NODE_FOR, token);
+    expect(p, OPEN_PAREN, "'(' after for");
+    if (peek(p) == INT_TYPE) {
+        append_child(p->ast, node, parse_declaration(p));
+        expect(p, SEMICOLON, "';' after the declaration");
+    } else if (is_operation(peek(p))) {
+        append_child(p->ast, node, parse_operation(p, SEMICOLON));
+    } else {
+        syntax_error(p, "an int declaration or an operation");
     }
+    append_child(p->ast, node, parse_expression(p, PREC_OR));
+    expect(p, SEMICOLON, "';' after the condition");
+    if (!is_operation(peek(p))) syntax_error(p, "an operation");
+    append_child(p->ast, node, parse_operation(p, CLOSE_PAREN));
+    append_child(p->ast, node, parse_block(p));
+    return node;
 }
 
-void free_ast(AST* ast){
-    if (ast == NULL) return;
-    free_ast_children(ast->root);
+static int parse_statement(Parser* p) {
+    int token = p->pos;
+    int node;
+    switch (peek(p)) {
+        case INT_TYPE:
+        case STRING_TYPE:
+            return parse_declaration(p);
+        case PLUS: case MINUS: case STAR: case SLASH: case MODULO:
+        case BIT_AND: case BIT_OR: case PLUS_EQUAL: case MINUS_EQUAL:
+            return parse_operation(p, SEMICOLON);
+        case PRINT:
+            ++p->pos;
+            node = add_node(p->ast, NODE_PRINT, token);
+            expect(p, OPEN_PAREN, "'(' after print");
+            while (peek(p) != CLOSE_PAREN) {
+                append_child(p->ast, node, parse_value(p));
+            }
+            ++p->pos;
+            return node;
+        case IF:
+        case WHILE:
+            ++p->pos;
+            node = add_node(p->ast, p->prog->tokens[token].type == IF ? NODE_IF : NODE_WHILE, token);
+            append_child(p->ast, node, parse_condition(p));
+            append_child(p->ast, node, parse_block(p));
+            return node;
+        case FOR:
+            ++p->pos;
+            return parse_for(p, token);
+        case RETURN:
+            ++p->pos;
+            node = add_node(p->ast, NODE_RETURN, token);
+            append_child(p->ast, node, parse_value(p));
+            return node;
+        default:
+            syntax_error(p, "a statement");
+            return NO_NODE;
+    }
+}
 
-    free(ast->root->token_data->data);
-    free(ast->root->token_data);
-    free(ast->root);
+// { statement* }
+static int parse_block(Parser* p) {
+    int node = add_node(p->ast, NODE_BLOCK, expect(p, OPEN_BRACE, "'{'"));
+    while (peek(p) != CLOSE_BRACE) {
+        if (peek(p) == ROOT) syntax_error(p, "'}'");
+        append_child(p->ast, node, parse_statement(p));
+    }
+    ++p->pos;
+    return node;
+}
+
+// One pass over the tokens with a single token of lookahead; every node comes
+// out typed, so code generation never has to look at raw tokens again.
+void build_ast(Program* prog, AST* ast) {
+    ast->kind = NULL;
+    ast->op = NULL;
+    ast->value = ast->token = ast->first_child = ast->next_sibling = ast->last_child = NULL;
+    ast->count = ast->capacity = 0;
+    ast->prog = prog;
+    ast->root = NO_NODE;
 
-    ast->root = NULL;
+    if (!prog || prog->token_count == 0) {
+        compile_error("Error: Program has no tokens.\n");
+    }
+
+    Parser parser = {prog, ast, 0};
+    Parser* p = &parser;
+
+    // every node but the root comes from a token and most tokens make at
+    // most one node, so this is close to the final size
+    reserve_nodes(ast, prog->token_count + 1);
+    ast->root = add_node(ast, NODE_PROGRAM, -1);
+
+    // only a main function for now
+    int name = expect(p, MAIN, "the main function");
+    expect(p, OPEN_PAREN, "'(' after main");
+    expect(p, CLOSE_PAREN, "')'");
+    int function = add_node(ast, NODE_FUNCTION, name);
+    append_child(ast, function, parse_block(p));
+    append_child(ast, ast->root, function);
+
+    if (peek(p) != ROOT) syntax_error(p, "end of input after main");
+}
+
+void print_ast(const AST* ast, int node, int depth){
+    if (node == NO_NODE) return;
+    for (int i=0; i<depth; ++i){
+        printf("-");
+    }
+    Token* token = ast_token(ast, node);
+    printf("%s", node_kind_to_string[ast->kind[node]]);
+    switch (ast->kind[node]) {
+        case NODE_FUNCTION:
+        case NODE_STRING:
+            printf(" %s", token_text(ast->prog, token));
+            break;
+        case NODE_VAR_DECL:
+            printf(" %s %s", ast->op[node] == INT_TYPE ? "int" : "string",
+                   pool_string(&ast->prog->strings, ast->value[node]));
+            break;
+        case NODE_ASSIGN:
+        case NODE_VAR:
+            printf(" %s", pool_string(&ast->prog->strings, ast->value[node]));
+            break;
+        case NODE_BINOP:
+            printf(" %s", token_text(ast->prog, token));
+            break;
+        case NODE_INT:
+            printf(" %d", ast->value[node]);
+            break;
+        case NODE_BOOL:
+            printf(" %s", ast->value[node] ? "true" : "false");
+            break;
+        default:
+            break;
+    }
+    if (token) printf("\t\t(line %d)", token->line);
+    printf("\n");
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]){
+        print_ast(ast, child, depth+1);
+    }
+}
+
+void free_ast(AST* ast){
+    if (ast == NULL) return;
+    counted_free(ast->kind);
+    counted_free(ast->op);
+    counted_free(ast->value);
+    counted_free(ast->token);
+    counted_free(ast->first_child);
+    counted_free(ast->next_sibling);
+    counted_free(ast->last_child);
+    ast->kind = NULL;
+    ast->op = NULL;
+    ast->value = ast->token = ast->first_child = ast->next_sibling = ast->last_child = NULL;
+    ast->count = ast->capacity = 0;
+    ast->root = NO_NODE;
 }
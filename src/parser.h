@@ -3,39 +3,57 @@
 
 #include "lexer.h"
 
-typedef struct{
-    Token* tokens;
-    int token_count;
-    int token_capacity;
-} Program;
-
-struct TokenNode {
-    Token* token_data;
-    struct TokenNode* children;
-    int children_count;
-    int children_capacity;
-};
-
-// abstract syntax tree
+#define NO_NODE -1
+
+typedef enum {
+    NODE_PROGRAM,   // children: functions
+    NODE_FUNCTION,  // token: name; child: body block
+    NODE_BLOCK,     // children: statements, one scope
+    NODE_VAR_DECL,  // op: INT_TYPE/STRING_TYPE, value: name id; child: initial value literal
+    NODE_ASSIGN,    // value: name id; child: expression
+    NODE_IF,        // children: condition, then block
+    NODE_WHILE,     // value: the trip count when known, -1 when only known to run at least once, else 0; children: condition, body block
+    NODE_FOR,       // value: as for NODE_WHILE; children: init statement, condition, step, body block; one scope
+    NODE_PRINT,     // children: items
+    NODE_RETURN,    // child: expression
+    NODE_BINOP,     // op: operator token type; children: left, right
+    NODE_INT,       // value: the integer
+    NODE_STRING,    // value: string pool id of the literal (quotes included)
+    NODE_BOOL,      // value: 0 or 1
+    NODE_VAR,       // value: name id
+} NodeKind;
+
+// Flat abstract syntax tree. Node i is described by the i-th entry of each
+// array; children form a singly linked list through next_sibling. Nodes are
+// only ever appended, so a node index stays valid for the life of the tree
+// and freeing it is a handful of frees regardless of its size.
 typedef struct {
-    struct TokenNode* root;
-} AST;
-
-typedef struct{
-    struct TokenNode** buf;
-    int size;
+    NodeKind* kind;
+    TokenType* op;
+    int* value;
+    int* token;          // index into prog->tokens of the token the node came from
+    int* first_child;
+    int* next_sibling;
+    int* last_child;     // so appending a child is O(1)
+    int count;
     int capacity;
-} Stack;
 
-void add_child(struct TokenNode* parent, Token* child);
-void stack_push(Stack* s, struct TokenNode* node);
-void stack_pop(Stack* s);
+    int root;
+    Program* prog;
+} AST;
+
+int add_node(AST* ast, NodeKind kind, int token);
+void append_child(AST* ast, int parent, int child);
+Token* ast_token(const AST* ast, int node);
+int ast_child(const AST* ast, int node, int index);
+int ast_child_count(const AST* ast, int node);
+int is_condition_node(const AST* ast, int node);
 void build_ast(Program* prog, AST* ast);
-void print_ast(struct TokenNode* root, int depth);
-void free_ast_children(struct TokenNode* node);
+void print_ast(const AST* ast, int node, int depth);
 void free_ast(AST* ast);
 
 // TODO: this is only a helper for debugging
 extern const char* token_type_to_string[];
+extern const char* node_kind_to_string[];
 
 #endif
@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <string.h>
+#include "peephole.h"
+#include "flow.h"
+#include "loop_opt.h"
+
+// give up on reaching a fixed point after this many sweeps, in case two
+// rules keep undoing each other
+#define MAX_ITERATIONS 64
+
+#define NO_HIT -1
+
+// does control falling out of i land on label without executing anything?
+static int falls_into_label(const FlowGraph* ph, int i, int label) {
+    for (i = next_instr(ph, i); i < ph->count && ph->code[i].op == OP_LABEL; i = next_instr(ph, i)) {
+        if (ph->code[i].label == label) return 1;
+    }
+    return 0;
+}
+
+// ---- rules ----
+// Each rule looks at the instruction at i and either returns NO_HIT or
+// rewrites it (and possibly the ones after it) and returns the index to resume
+// from. Rules only ever shrink live ranges outside the window they touch, so
+// the liveness computed at the start of a sweep stays a safe over-estimate.
+
+// anything after an unconditional jump up to the next label never runs
+static int rule_unreachable(FlowGraph* ph, int i) {
+    if (ph->code[i].op != OP_J && ph->code[i].op != OP_JR) return NO_HIT;
+    int hit = 0;
+    int k;
+    for (k = i + 1; k < ph->count && ph->code[k].op != OP_LABEL; ++k) {
+        if (ph->code[k].op != OP_COMMENT && ph->code[k].op != OP_NOP) {
+            ph->code[k].op = OP_NOP;
+            hit = 1;
+        }
+    }
+    return hit ? k : NO_HIT;
+}
+
+// j L / beq ..., L immediately followed by L:
+static int rule_branch_to_next(FlowGraph* ph, int i) {
+    Instr* in = &ph->code[i];
+    if (!is_branch(in->op) && in->op != OP_J) return NO_HIT;
+    if (!falls_into_label(ph, i, in->label)) return NO_HIT;
+    in->op = OP_NOP;
+    return i + 1;
+}
+
+// a branch to a label that only jumps elsewhere goes straight there
+static int rule_jump_threading(FlowGraph* ph, int i) {
+    Instr* in = &ph->code[i];
+    if (!is_branch(in->op) && in->op != OP_J) return NO_HIT;
+    int target = label_target(ph, in->label);
+    if (target >= ph->count || ph->code[target].op != OP_J || ph->code[target].label == in->label) return NO_HIT;
+    in->label = ph->code[target].label;
+    return i + 1;
+}
+
+static const Opcode inverted_branch[] = {
+    [OP_BEQ] = OP_BNE, [OP_BNE] = OP_BEQ, [OP_BLT] = OP_BGE,
+    [OP_BGE] = OP_BLT, [OP_BLE] = OP_BGT, [OP_BGT] = OP_BLE,
+};
+
+// beq a, b, L1 / j L2 / L1:  =>  bne a, b, L2 / L1:
+static int rule_branch_over_jump(FlowGraph* ph, int i) {
+    Instr* in = &ph->code[i];
+    if (!is_branch(in->op)) return NO_HIT;
+    int jump = next_instr(ph, i);
+    if (jump >= ph->count || ph->code[jump].op != OP_J) return NO_HIT;
+    if (!falls_into_label(ph, jump, in->label)) return NO_HIT;
+    in->op = inverted_branch[in->op];
+    in->label = ph->code[jump].label;
+    ph->code[jump].op = OP_NOP;
+    return jump + 1;
+}
+
+// la rA, L / sw rV, 0(rA) / la rB, L / lw rD, 0(rB)  =>  ... / move rD, rV
+static int rule_store_reload(FlowGraph* ph, int i) {
+    Instr* c = ph->code;
+    if (c[i].op != OP_LA || c[i].imm != 0) return NO_HIT;
+    int store = next_instr(ph, i);
+    if (store >= ph->count || c[store].op != OP_SW || c[store].rs != c[i].rd ||
+        c[store].imm != 0 || c[store].rd == c[i].rd) return NO_HIT;
+    int address = next_instr(ph, store);
+    if (address >= ph->count || c[address].op != OP_LA || c[address].label != c[i].label ||
+        c[address].imm != 0) return NO_HIT;
+    int load = next_instr(ph, address);
+    if (load >= ph->count || c[load].op != OP_LW || c[load].rs != c[address].rd || c[load].imm != 0) return NO_HIT;
+
+    // the second la goes away, so its register must not be needed afterwards
+    int value = c[store].rd;
+    int base = c[address].rd;
+    if (base != c[load].rd && (live_out(ph, load) & BIT(base))) return NO_HIT;
+
+    c[address].op = OP_NOP;
+    if (c[load].rd == value) {
+        c[load].op = OP_NOP;
+    } else {
+        c[load].op = OP_MOVE;
+        c[load].rs = value;
+        c[load].imm = 0;
+    }
+    return load + 1;
+}
+
+// li rB, k / add rD, rS, rB  =>  addi rD, rS, k  (also sub, and, or,
+// branches against 0 and ordered branches against small constants)
+static int rule_li_immediate(FlowGraph* ph, int i) {
+    Instr* c = ph->code;
+    if (c[i].op != OP_LI || c[i].rd == REG_ZERO) return NO_HIT;
+    int j = next_instr(ph, i);
+    if (j >= ph->count) return NO_HIT;
+    Instr* use = &c[j];
+    int reg = c[i].rd;
+    int k = c[i].imm;
+    // the constant must not be needed after the instruction that consumes it
+    int dies = !(live_out(ph, j) & BIT(reg)) || (defines_rd(use->op) && use->rd == reg);
+
+    if (use->op == OP_ADD || use->op == OP_SUB || use->op == OP_AND || use->op == OP_OR) {
+        int other;
+        if (use->rt == reg && use->rs != reg) {
+            other = use->rs;
+        } else if (use->rs == reg && use->rt != reg && use->op != OP_SUB) {
+            other = use->rt;
+        } else {
+            return NO_HIT;
+        }
+        int imm = use->op == OP_SUB ? -k : k;
+        int fits = (use->op == OP_ADD || use->op == OP_SUB)
+            ? (imm >= -32768 && imm <= 32767 && !(use->op == OP_SUB && k == -2147483647 - 1))
+            : (imm >= 0 && imm <= 65535);
+        if (!fits || !dies) return NO_HIT;
+        use->op = use->op == OP_AND ? OP_ANDI : use->op == OP_OR ? OP_ORI : OP_ADDI;
+        use->rs = other;
+        use->rt = 0;
+        use->imm = imm;
+        c[i].op = OP_NOP;
+        return j + 1;
+    }
+    if (is_branch(use->op) && k == 0 && dies && (use->rs == reg || use->rt == reg)) {
+        if (use->rs == reg) use->rs = REG_ZERO;
+        if (use->rt == reg) use->rt = REG_ZERO;
+        c[i].op = OP_NOP;
+        return j + 1;
+    }
+    // li rB, k / blt rS, rB, L  =>  slti rB, rS, k / bne rB, $zero, L
+    // one slt less than what the assembler makes of an ordered branch
+    if (use->op >= OP_BLT && use->op <= OP_BGE && dies && (use->rs == reg) != (use->rt == reg)) {
+        static const Opcode mirrored[] = {
+            [OP_BLT] = OP_BGT, [OP_BLE] = OP_BGE, [OP_BGT] = OP_BLT, [OP_BGE] = OP_BLE,
+        };
+        Opcode op = use->rt == reg ? use->op : mirrored[use->op];
+        int other = use->rt == reg ? use->rs : use->rt;
+        // x <= k is x < k + 1
+        if (op == OP_BLE || op == OP_BGT) {
+            if (k == 2147483647) return NO_HIT;
+            ++k;
+        }
+        if (k < -32768 || k > 32767) return NO_HIT;
+        c[i].op = OP_SLTI;
+        c[i].rs = other;
+        c[i].imm = k;
+        use->op = op == OP_BLT || op == OP_BLE ? OP_BNE : OP_BEQ;
+        use->rs = reg;
+        use->rt = REG_ZERO;
+        return j + 1;
+    }
+    return NO_HIT;
+}
+
+// add rX, ... / move rY, rX  =>  add rY, ...  when rX dies at the move
+static int rule_move_coalesce(FlowGraph* ph, int i) {
+    Instr* c = ph->code;
+    if (c[i].op == OP_MOVE && c[i].rd == c[i].rs) {
+        c[i].op = OP_NOP;
+        return i + 1;
+    }
+    if (!defines_rd(c[i].op)) return NO_HIT;
+    int j = next_instr(ph, i);
+    if (j >= ph->count || c[j].op != OP_MOVE || c[j].rs != c[i].rd || c[j].rd == c[j].rs) return NO_HIT;
+    if (live_out(ph, j) & BIT(c[i].rd)) return NO_HIT;
+    c[i].rd = c[j].rd;
+    c[j].op = OP_NOP;
+    return j + 1;
+}
+
+// pure instructions whose results nobody reads, unless they can trap
+static int rule_dead_def(FlowGraph* ph, int i) {
+    Instr* in = &ph->code[i];
+    if (!is_pure(in->op) || may_trap(in->op)) return NO_HIT;
+    unsigned defs = instr_defs(in);
+    if (defs & BIT(REG_SP)) return NO_HIT;
+    if (defs & live_out(ph, i)) return NO_HIT;
+    in->op = OP_NOP;
+    return i + 1;
+}
+
+static int rule_unused_label(FlowGraph* ph, int i) {
+    Instr* in = &ph->code[i];
+    if (in->op != OP_LABEL || in->label < 0 || in->label >= ph->label_count) return NO_HIT;
+    if (ph->label_refs[in->label] != 0) return NO_HIT;
+    in->op = OP_NOP;
+    return i + 1;
+}
+
+typedef struct {
+    const char* name;
+    int (*apply)(FlowGraph* ph, int i);
+} PeepholeRule;
+
+// tried in order at every instruction, the first one that fires wins
+static const PeepholeRule rules[PEEPHOLE_RULE_COUNT] = {
+    {"unreachable", rule_unreachable},
+    {"branch-to-next", rule_branch_to_next},
+    {"jump-threading", rule_jump_threading},
+    {"branch-over-jump", rule_branch_over_jump},
+    {"store-reload", rule_store_reload},
+    {"li-immediate", rule_li_immediate},
+    {"move-coalesce", rule_move_coalesce},
+    {"dead-def", rule_dead_def},
+    {"unused-label", rule_unused_label},
+};
+
+static int count_instructions(const Instr* code, int count) {
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        if (code[i].op != OP_LABEL && code[i].op != OP_COMMENT && code[i].op != OP_NOP) ++n;
+    }
+    return n;
+}
+
+// drops the deleted instructions
+static void compact(CodeBuffer* buffer) {
+    int kept = 0;
+    for (int i = 0; i < buffer->body_count; ++i) {
+        if (buffer->body[i].op != OP_NOP) buffer->body[kept++] = buffer->body[i];
+    }
+    buffer->body_count = kept;
+}
+
+void peephole_optimize(CodeBuffer* buffer, PeepholeStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->instructions_before = count_instructions(buffer->body, buffer->body_count);
+
+    FlowGraph ph;
+    init_flow(&ph, buffer->label_counter);
+
+    int changed = 1;
+    while (changed && stats->iterations < MAX_ITERATIONS) {
+        changed = 0;
+        ++stats->iterations;
+        analyze_flow(&ph, buffer->body, buffer->body_count);
+
+        int i = 0;
+        while (i < ph.count) {
+            int next = NO_HIT;
+            if (ph.code[i].op != OP_NOP && ph.code[i].op != OP_COMMENT) {
+                for (int r = 0; r < PEEPHOLE_RULE_COUNT; ++r) {
+                    next = rules[r].apply(&ph, i);
+                    if (next != NO_HIT) {
+                        ++stats->hits[r];
+                        changed = 1;
+                        break;
+                    }
+                }
+            }
+            i = next != NO_HIT ? next : i + 1;
+        }
+        compact(buffer);
+
+        // once the local rules run dry, take what they left invariant out
+        // of loops, which can give them more to do
+        if (!changed) {
+            int hoisted = hoist_loop_invariants(buffer, &ph);
+            stats->hoisted += hoisted;
+            changed = hoisted > 0;
+        }
+    }
+
+    free_flow(&ph);
+    stats->instructions_after = count_instructions(buffer->body, buffer->body_count);
+}
+
+void print_peephole_stats(const PeepholeStats* stats, FILE* out) {
+    fprintf(out, "peephole: %d -> %d instructions in %d iterations\n",
+            stats->instructions_before, stats->instructions_after, stats->iterations);
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; ++r) {
+        fprintf(out, "  %-18s %d\n", rules[r].name, stats->hits[r]);
+    }
+    fprintf(out, "  %-18s %d\n", "loop-invariant", stats->hoisted);
+}
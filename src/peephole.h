@@ -0,0 +1,22 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+#include "code_gen.h"
+
+#define PEEPHOLE_RULE_COUNT 9
+
+typedef struct {
+    int hits[PEEPHOLE_RULE_COUNT];
+    int hoisted;    // instructions moved out of loops
+    int iterations;
+    int instructions_before;
+    int instructions_after;
+} PeepholeStats;
+
+// Rewrites the body segment in place until no rule applies any more and no
+// loop has anything left to hoist.
+void peephole_optimize(CodeBuffer* buffer, PeepholeStats* stats);
+void print_peephole_stats(const PeepholeStats* stats, FILE* out);
+
+#endif
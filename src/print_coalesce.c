@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "print_coalesce.h"
+#include "const_fold.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+typedef struct {
+    char* data;
+    int size;
+    int capacity;
+} Text;
+
+static void append_text(Text* text, const char* s, int length) {
+    if (text->size + length > text->capacity) {
+        while (text->size + length > text->capacity) text->capacity = text->capacity ? text->capacity * 2 : 64;
+        text->data = (char*) counted_realloc(text->data, text->capacity);
+        if (!text->data) {
+            compile_error("Error: Realloc Failed on coalesce_prints\n");
+        }
+    }
+    memcpy(text->data + text->size, s, length);
+    text->size += length;
+}
+
+// whether the text of a literal (quotes included) means the same wherever
+// it is pasted
+static int pastes_safely(const char* s, int length) {
+    for (int i = 1; i < length - 1; ++i) {
+        if (s[i] != '\\') continue;
+        if (i + 1 >= length - 1 || !strchr("ntr\\", s[i + 1])) return 0;
+        ++i;
+    }
+    return 1;
+}
+
+static int is_known_item(const AST* ast, int item) {
+    if (ast->kind[item] == NODE_INT) return 1;
+    if (ast->kind[item] != NODE_STRING) return 0;
+    const StringPool* strings = &ast->prog->strings;
+    return pastes_safely(pool_string(strings, ast->value[item]), pool_length(strings, ast->value[item]));
+}
+
+// the text an item prints, appended without quotes
+static void append_item(const AST* ast, int item, Text* text) {
+    if (ast->kind[item] == NODE_INT) {
+        char digits[16];
+        int length = snprintf(digits, sizeof(digits), "%d", ast->value[item]);
+        append_text(text, digits, length);
+        return;
+    }
+    const StringPool* strings = &ast->prog->strings;
+    append_text(text, pool_string(strings, ast->value[item]) + 1, pool_length(strings, ast->value[item]) - 2);
+}
+
+static void coalesce_items(AST* ast, int print, Text* text) {
+    int item = ast->first_child[print];
+    while (item != NO_NODE) {
+        if (!is_known_item(ast, item)) {
+            item = ast->next_sibling[item];
+            continue;
+        }
+        int last = item;
+        while (ast->next_sibling[last] != NO_NODE && is_known_item(ast, ast->next_sibling[last])) {
+            last = ast->next_sibling[last];
+        }
+        if (last != item) {
+            text->size = 0;
+            append_text(text, "\"", 1);
+            for (int k = item;; k = ast->next_sibling[k]) {
+                append_item(ast, k, text);
+                if (k == last) break;
+            }
+            append_text(text, "\"", 1);
+            // the first item of the run becomes the whole run
+            ast->kind[item] = NODE_STRING;
+            ast->value[item] = intern_string(&ast->prog->strings, text->data, text->size);
+            ast->next_sibling[item] = ast->next_sibling[last];
+            if (ast->last_child[print] == last) ast->last_child[print] = item;
+        }
+        item = ast->next_sibling[item];
+    }
+}
+
+// declarations and assignments that can't raise an exception only change a
+// variable, so a print that doesn't read it can run before them
+static int steps_over(const AST* ast, int stmt) {
+    if (ast->kind[stmt] == NODE_VAR_DECL) return 1;
+    return ast->kind[stmt] == NODE_ASSIGN && !can_trap(ast, ast->first_child[stmt]);
+}
+
+static int reads_name(const AST* ast, int node, int name) {
+    if (ast->kind[node] == NODE_VAR) return ast->value[node] == name;
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        if (reads_name(ast, child, name)) return 1;
+    }
+    return 0;
+}
+
+// whether the print reads a variable declared or assigned by a statement
+// from first up to (not including) last
+static int reads_any(const AST* ast, int print, int first, int last) {
+    for (int stmt = first; stmt != last; stmt = ast->next_sibling[stmt]) {
+        if (reads_name(ast, print, ast->value[stmt])) return 1;
+    }
+    return 0;
+}
+
+static void coalesce_block(AST* ast, int node, Text* text) {
+    if (ast->kind[node] == NODE_BLOCK) {
+        for (int stmt = ast->first_child[node]; stmt != NO_NODE; stmt = ast->next_sibling[stmt]) {
+            if (ast->kind[stmt] != NODE_PRINT) continue;
+            // the items of the prints that follow move over to this one, past
+            // the declarations and assignments in between
+            int before = stmt;
+            for (;;) {
+                int next = ast->next_sibling[before];
+                while (next != NO_NODE && steps_over(ast, next)) {
+                    before = next;
+                    next = ast->next_sibling[next];
+                }
+                if (next == NO_NODE || ast->kind[next] != NODE_PRINT) break;
+                if (reads_any(ast, next, ast->next_sibling[stmt], next)) break;
+                if (ast->first_child[next] != NO_NODE) {
+                    if (ast->first_child[stmt] == NO_NODE) ast->first_child[stmt] = ast->first_child[next];
+                    else ast->next_sibling[ast->last_child[stmt]] = ast->first_child[next];
+                    ast->last_child[stmt] = ast->last_child[next];
+                }
+                ast->next_sibling[before] = ast->next_sibling[next];
+                if (ast->last_child[node] == next) ast->last_child[node] = before;
+            }
+            coalesce_items(ast, stmt, text);
+        }
+    }
+    for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+        coalesce_block(ast, child, text);
+    }
+}
+
+void coalesce_prints(AST* ast, int function) {
+    Text text = {NULL, 0, 0};
+    coalesce_block(ast, ast->first_child[function], &text);
+    counted_free(text.data);
+}
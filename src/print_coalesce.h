@@ -0,0 +1,18 @@
+#ifndef PRINT_COALESCE_H
+#define PRINT_COALESCE_H
+
+#include "parser.h"
+
+// Merges the print statements of a block into the first of them, stepping
+// over declarations and assignments that can't trap as long as the prints
+// moved don't read what those write, then each run of two or more items
+// whose text is known at compile time (string literals and int literals,
+// which is what constant folding leaves of known variables) into a single
+// string literal, so the run costs one call.
+// Items in between stay where they are, so output keeps its order however
+// an item with side effects ends up. Literals with escapes whose meaning
+// could change next to other text (\0, anything but \n \t \r \\) are left
+// alone.
+void coalesce_prints(AST* ast, int function);
+
+#endif
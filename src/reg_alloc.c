@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "reg_alloc.h"
+#include "code_gen.h"
+#include "symbol_table.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+// weight of one use at loop depth d is 8^d, capped so it cannot overflow
+#define MAX_WEIGHT_DEPTH 9
+
+typedef struct {
+    int decl;    // VAR_DECL node
+    int start;   // position of the declaration
+    int end;     // position of the last use
+    int weight;
+    int loop;    // last outermost loop that uses the variable but does not declare it, -1 if none
+} Interval;
+
+typedef struct {
+    const AST* ast;
+    SymbolTable scopes;  // a symbol's label is the index of its interval, -1 for strings
+
+    Interval* intervals;
+    int count;
+    int capacity;
+
+    int* loop_start;     // position of each loop, indexed by loop id
+    int* loop_end;
+    int loop_count;
+    int loop_capacity;
+
+    int* open_loops;     // ids of the loops being walked, outermost first
+    int depth;
+
+    int pos;
+} IntervalBuilder;
+
+static void* grow(void* ptr, size_t size) {
+    ptr = counted_realloc(ptr, size);
+    if (!ptr) {
+        compile_error("Error: Realloc Failed on allocate_registers\n");
+    }
+    return ptr;
+}
+
+static void use_variable(IntervalBuilder* b, int name) {
+    Symbol* sym = find_symbol(&b->scopes, name);
+    if (!sym || sym->label < 0) return;
+    Interval* iv = &b->intervals[sym->label];
+    iv->end = b->pos;
+    int depth = b->depth < MAX_WEIGHT_DEPTH ? b->depth : MAX_WEIGHT_DEPTH;
+    int weight = 1 << (3 * depth);
+    iv->weight = iv->weight > INT_MAX - weight ? INT_MAX : iv->weight + weight;
+    // the value has to survive the back edge of every loop entered after the
+    // declaration; the outermost one covers the rest, and as uses come in
+    // program order the last such loop seen is the one that ends last
+    for (int i = 0; i < b->depth; ++i) {
+        int loop = b->open_loops[i];
+        if (b->loop_start[loop] > iv->start) {
+            iv->loop = loop;
+            break;
+        }
+    }
+}
+
+static void walk(IntervalBuilder* b, int node);
+
+// walks first and its siblings as the body of one loop
+static void walk_loop(IntervalBuilder* b, int first) {
+    if (b->loop_count == b->loop_capacity) {
+        b->loop_capacity *= 2;
+        b->loop_start = (int*) grow(b->loop_start, sizeof(int) * b->loop_capacity);
+        b->loop_end = (int*) grow(b->loop_end, sizeof(int) * b->loop_capacity);
+        b->open_loops = (int*) grow(b->open_loops, sizeof(int) * b->loop_capacity);
+    }
+    int loop = b->loop_count++;
+    // strictly after whatever was declared just before it, a for's init included
+    b->loop_start[loop] = ++b->pos;
+    b->open_loops[b->depth++] = loop;
+    for (int child = first; child != NO_NODE; child = b->ast->next_sibling[child]) {
+        walk(b, child);
+    }
+    --b->depth;
+    b->loop_end[loop] = b->pos;
+}
+
+static void walk(IntervalBuilder* b, int node) {
+    const AST* ast = b->ast;
+    ++b->pos;
+    switch (ast->kind[node]) {
+        case NODE_BLOCK:
+            push_scope(&b->scopes);
+            for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+                walk(b, child);
+            }
+            pop_scope(&b->scopes);
+            return;
+        case NODE_VAR_DECL: {
+            int label = -1;
+            if (ast->op[node] == INT_TYPE) {
+                if (b->count == b->capacity) {
+                    b->capacity *= 2;
+                    b->intervals = (Interval*) grow(b->intervals, sizeof(Interval) * b->capacity);
+                }
+                label = b->count++;
+                b->intervals[label] = (Interval){node, b->pos, b->pos, 0, -1};
+            }
+            // duplicates are reported by the code generator
+            add_symbol(&b->scopes, ast->value[node], label, ast->op[node], 0);
+            return;
+        }
+        case NODE_VAR:
+            use_variable(b, ast->value[node]);
+            return;
+        case NODE_ASSIGN:
+            walk(b, ast->first_child[node]);
+            use_variable(b, ast->value[node]);
+            return;
+        case NODE_WHILE:
+            walk_loop(b, ast->first_child[node]);
+            return;
+        case NODE_FOR: {
+            // the init runs once in front of the loop
+            push_scope(&b->scopes);
+            int init = ast->first_child[node];
+            int step = ast_child(ast, node, 2);
+            int count = b->count;
+            walk(b, init);
+            walk_loop(b, ast->next_sibling[init]);
+            // the induction variable is the last thing to leave its register:
+            // the one the init declares, or else the one the step assigns
+            int induction = -1;
+            if (ast->kind[init] == NODE_VAR_DECL && ast->op[init] == INT_TYPE) {
+                induction = count;
+            } else if (ast->kind[step] == NODE_ASSIGN) {
+                Symbol* sym = find_symbol(&b->scopes, ast->value[step]);
+                if (sym) induction = sym->label;
+            }
+            if (induction >= 0) b->intervals[induction].weight = INT_MAX;
+            pop_scope(&b->scopes);
+            return;
+        }
+        default:
+            for (int child = ast->first_child[node]; child != NO_NODE; child = ast->next_sibling[child]) {
+                walk(b, child);
+            }
+            return;
+    }
+}
+
+void allocate_registers(const AST* ast, int function, RegAllocation* alloc) {
+    IntervalBuilder b;
+    b.ast = ast;
+    init_symbol_table(&b.scopes);
+    b.capacity = 16;
+    b.count = 0;
+    b.intervals = (Interval*) grow(NULL, sizeof(Interval) * b.capacity);
+    b.loop_capacity = 16;
+    b.loop_count = 0;
+    b.loop_start = (int*) grow(NULL, sizeof(int) * b.loop_capacity);
+    b.loop_end = (int*) grow(NULL, sizeof(int) * b.loop_capacity);
+    b.open_loops = (int*) grow(NULL, sizeof(int) * b.loop_capacity);
+    b.depth = 0;
+    b.pos = 0;
+    walk(&b, function);
+
+    for (int i = 0; i < b.count; ++i) {
+        Interval* iv = &b.intervals[i];
+        if (iv->loop >= 0 && b.loop_end[iv->loop] > iv->end) iv->end = b.loop_end[iv->loop];
+    }
+
+    alloc->node_count = ast->count;
+    alloc->reg = (int*) grow(NULL, sizeof(int) * ast->count);
+    alloc->frame_offset = (int*) grow(NULL, sizeof(int) * ast->count);
+    memset(alloc->reg, 0, sizeof(int) * ast->count);
+    memset(alloc->frame_offset, -1, sizeof(int) * ast->count);
+    alloc->saved_regs = 0;
+    alloc->spill_count = 0;
+
+    // intervals were created in order of their start, so they are already sorted
+    int active[ALLOCATABLE_REGS];
+    int active_count = 0;
+    unsigned free_regs = (1u << ALLOCATABLE_REGS) - 1;
+    int* spilled = (int*) grow(NULL, sizeof(int) * (b.count + 1));
+    int spill_count = 0;
+
+    for (int i = 0; i < b.count; ++i) {
+        Interval* iv = &b.intervals[i];
+        // never used, say because folding replaced every use with its value
+        if (iv->weight == 0) continue;
+        for (int a = 0; a < active_count; ) {
+            Interval* old = &b.intervals[active[a]];
+            if (old->end < iv->start) {
+                free_regs |= 1u << (alloc->reg[old->decl] - REG_S0);
+                active[a] = active[--active_count];
+            } else {
+                ++a;
+            }
+        }
+
+        if (free_regs) {
+            int r = __builtin_ctz(free_regs);
+            free_regs &= ~(1u << r);
+            alloc->reg[iv->decl] = REG_S0 + r;
+            active[active_count++] = i;
+            continue;
+        }
+
+        // out of registers: the lightest of the live variables goes to the stack
+        int victim = -1;
+        for (int a = 0; a < active_count; ++a) {
+            if (victim < 0 || b.intervals[active[a]].weight < b.intervals[active[victim]].weight) victim = a;
+        }
+        Interval* loser = &b.intervals[active[victim]];
+        if (loser->weight < iv->weight) {
+            alloc->reg[iv->decl] = alloc->reg[loser->decl];
+            alloc->reg[loser->decl] = 0;
+            spilled[spill_count++] = loser->decl;
+            active[victim] = i;
+        } else {
+            spilled[spill_count++] = iv->decl;
+        }
+    }
+
+    for (int i = 0; i < b.count; ++i) {
+        int reg = alloc->reg[b.intervals[i].decl];
+        if (reg) alloc->saved_regs |= 1u << reg;
+    }
+
+    // frame: $ra, then the saved registers, then $fp and the spill slots
+    int offset = 4 + 4 * __builtin_popcount(alloc->saved_regs);
+    alloc->fp_offset = -1;
+    if (spill_count > 0) {
+        alloc->fp_offset = offset;
+        offset += 4;
+        for (int i = 0; i < spill_count; ++i) {
+            alloc->frame_offset[spilled[i]] = offset;
+            offset += 4;
+        }
+    }
+    alloc->spill_count = spill_count;
+    alloc->frame_size = offset;
+
+    counted_free(spilled);
+    counted_free(b.intervals);
+    counted_free(b.loop_start);
+    counted_free(b.loop_end);
+    counted_free(b.open_loops);
+    free_symbol_table(&b.scopes);
+}
+
+void free_allocation(RegAllocation* alloc) {
+    counted_free(alloc->reg);
+    counted_free(alloc->frame_offset);
+    alloc->reg = alloc->frame_offset = NULL;
+    alloc->node_count = 0;
+}
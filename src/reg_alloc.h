@@ -0,0 +1,30 @@
+#ifndef REG_ALLOC_H
+#define REG_ALLOC_H
+
+#include "parser.h"
+
+// $s0..$s7 hold variables, everything else is scratch for the code generator
+#define ALLOCATABLE_REGS 8
+
+// Where the int variables of one function live, indexed by the AST node of
+// each variable's declaration. String variables always stay in .data, and an
+// int variable nothing reads or assigns gets neither a register nor a slot.
+typedef struct {
+    int* reg;             // register number, 0 when the variable is not in a register
+    int* frame_offset;    // offset of the variable's slot from $fp, -1 when it has none
+    int node_count;
+
+    unsigned saved_regs;  // mask of the $s registers handed out, saved by the prologue unless peephole left them unused
+    int spill_count;
+    int fp_offset;        // where the caller's $fp is saved, -1 when nothing spilled
+    int frame_size;       // bytes: $ra, the saved registers, $fp and the spill slots
+} RegAllocation;
+
+// Linear scan over live intervals numbered in program order. Uses inside a
+// loop of a variable declared outside it keep the variable live to the end of
+// the loop. When registers run out the variable with the lowest use count,
+// weighted by loop depth, goes to the stack.
+void allocate_registers(const AST* ast, int function, RegAllocation* alloc);
+void free_allocation(RegAllocation* alloc);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+// The assembly routines of util/strcmp.asm and util/print.asm, embedded as
+// runtime_<name> by the Makefile so that the compiler runs from any
+// directory.
+extern const char runtime_strcmp[];
+extern const char runtime_print[];
+
+#endif
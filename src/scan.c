@@ -0,0 +1,297 @@
+#include <stddef.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// ---- scalar ----
+// same character sets as the lexer's class table
+
+static inline int is_space_char(unsigned char c){
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static inline int is_ident_char(unsigned char c){
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static const char* scalar_skip_whitespace(const char* p, const char* end, int* line){
+    while (p < end && is_space_char(*p)) {
+        if (*p == '\n') ++*line;
+        ++p;
+    }
+    return p;
+}
+
+static const char* scalar_find_eol(const char* p, const char* end){
+    while (p < end && *p != '\n') ++p;
+    return p;
+}
+
+static const char* scalar_find_quote(const char* p, const char* end, int* line){
+    while (p < end && *p != '"') {
+        if (*p == '\n') ++*line;
+        ++p;
+    }
+    return p;
+}
+
+static const char* scalar_ident_run(const char* p, const char* end){
+    while (p < end && is_ident_char(*p)) ++p;
+    return p;
+}
+
+static const char* scalar_digit_run(const char* p, const char* end){
+    while (p < end && (unsigned char)(*p - '0') < 10) ++p;
+    return p;
+}
+
+static const ScanKernels scalar_kernels = {
+    "scalar", scalar_skip_whitespace, scalar_find_eol, scalar_find_quote,
+    scalar_ident_run, scalar_digit_run,
+};
+
+#ifdef SCAN_X86
+
+// Each kernel builds a bitmask of the bytes that belong to the run, 16 (SSE2)
+// or 32 (AVX2) at a time, and stops at the first clear bit. Unsigned range
+// checks use x <= k <=> min(x, k) == x. Tails shorter than a vector go through
+// the scalar loop so nothing is read past end.
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+static inline SSE2 __m128i sse2_in_range(__m128i v, char lo, char span){
+    __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(span)), x);
+}
+
+static inline SSE2 unsigned sse2_space_mask(__m128i v){
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    return _mm_movemask_epi8(_mm_or_si128(space, sse2_in_range(v, '\t', '\r' - '\t')));
+}
+
+static inline SSE2 unsigned sse2_byte_mask(__m128i v, char c){
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+static inline SSE2 unsigned sse2_ident_mask(__m128i v){
+    __m128i alpha = sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+    __m128i digit = sse2_in_range(v, '0', 9);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+
+static SSE2 const char* sse2_skip_whitespace(const char* p, const char* end, int* line){
+    while (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        unsigned run = sse2_space_mask(v);
+        unsigned newlines = sse2_byte_mask(v, '\n');
+        if (run != 0xffff) {
+            int k = __builtin_ctz(~run);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return scalar_skip_whitespace(p, end, line);
+}
+
+static SSE2 const char* sse2_find_eol(const char* p, const char* end){
+    while (p + 16 <= end) {
+        unsigned hit = sse2_byte_mask(_mm_loadu_si128((const __m128i*) p), '\n');
+        if (hit) return p + __builtin_ctz(hit);
+        p += 16;
+    }
+    return scalar_find_eol(p, end);
+}
+
+static SSE2 const char* sse2_find_quote(const char* p, const char* end, int* line){
+    while (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        unsigned hit = sse2_byte_mask(v, '"');
+        unsigned newlines = sse2_byte_mask(v, '\n');
+        if (hit) {
+            int k = __builtin_ctz(hit);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return scalar_find_quote(p, end, line);
+}
+
+static SSE2 const char* sse2_ident_run(const char* p, const char* end){
+    while (p + 16 <= end) {
+        unsigned run = sse2_ident_mask(_mm_loadu_si128((const __m128i*) p));
+        if (run != 0xffff) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    return scalar_ident_run(p, end);
+}
+
+static SSE2 const char* sse2_digit_run(const char* p, const char* end){
+    while (p + 16 <= end) {
+        unsigned run = _mm_movemask_epi8(sse2_in_range(_mm_loadu_si128((const __m128i*) p), '0', 9));
+        if (run != 0xffff) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    return scalar_digit_run(p, end);
+}
+
+static const ScanKernels sse2_kernels = {
+    "sse2", sse2_skip_whitespace, sse2_find_eol, sse2_find_quote,
+    sse2_ident_run, sse2_digit_run,
+};
+
+static inline AVX2 __m256i avx2_in_range(__m256i v, char lo, char span){
+    __m256i x = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(span)), x);
+}
+
+static inline AVX2 unsigned avx2_space_mask(__m256i v){
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    return _mm256_movemask_epi8(_mm256_or_si256(space, avx2_in_range(v, '\t', '\r' - '\t')));
+}
+
+static inline AVX2 unsigned avx2_byte_mask(__m256i v, char c){
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+static inline AVX2 unsigned avx2_ident_mask(__m256i v){
+    __m256i alpha = avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 25);
+    __m256i digit = avx2_in_range(v, '0', 9);
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+}
+
+// Most runs in real sources are a handful of bytes, so the AVX2 kernels probe
+// the first 16 bytes with SSE2 before switching to 32 byte steps, and finish
+// with the 16 byte kernel rather than the scalar loop.
+
+static AVX2 const char* avx2_skip_whitespace(const char* p, const char* end, int* line){
+    if (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        unsigned run = sse2_space_mask(v);
+        unsigned newlines = sse2_byte_mask(v, '\n');
+        if (run != 0xffff) {
+            int k = __builtin_ctz(~run);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 16;
+    }
+    while (p + 32 <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) p);
+        unsigned run = avx2_space_mask(v);
+        unsigned newlines = avx2_byte_mask(v, '\n');
+        if (run != 0xffffffffu) {
+            int k = __builtin_ctz(~run);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return sse2_skip_whitespace(p, end, line);
+}
+
+static AVX2 const char* avx2_find_eol(const char* p, const char* end){
+    if (p + 16 <= end) {
+        unsigned hit = sse2_byte_mask(_mm_loadu_si128((const __m128i*) p), '\n');
+        if (hit) return p + __builtin_ctz(hit);
+        p += 16;
+    }
+    while (p + 32 <= end) {
+        unsigned hit = avx2_byte_mask(_mm256_loadu_si256((const __m256i*) p), '\n');
+        if (hit) return p + __builtin_ctz(hit);
+        p += 32;
+    }
+    return sse2_find_eol(p, end);
+}
+
+static AVX2 const char* avx2_find_quote(const char* p, const char* end, int* line){
+    if (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        unsigned hit = sse2_byte_mask(v, '"');
+        unsigned newlines = sse2_byte_mask(v, '\n');
+        if (hit) {
+            int k = __builtin_ctz(hit);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 16;
+    }
+    while (p + 32 <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) p);
+        unsigned hit = avx2_byte_mask(v, '"');
+        unsigned newlines = avx2_byte_mask(v, '\n');
+        if (hit) {
+            int k = __builtin_ctz(hit);
+            *line += __builtin_popcount(newlines & ((1u << k) - 1));
+            return p + k;
+        }
+        *line += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return sse2_find_quote(p, end, line);
+}
+
+static AVX2 const char* avx2_ident_run(const char* p, const char* end){
+    if (p + 16 <= end) {
+        unsigned run = sse2_ident_mask(_mm_loadu_si128((const __m128i*) p));
+        if (run != 0xffff) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    while (p + 32 <= end) {
+        unsigned run = avx2_ident_mask(_mm256_loadu_si256((const __m256i*) p));
+        if (run != 0xffffffffu) return p + __builtin_ctz(~run);
+        p += 32;
+    }
+    return sse2_ident_run(p, end);
+}
+
+static AVX2 const char* avx2_digit_run(const char* p, const char* end){
+    if (p + 16 <= end) {
+        unsigned run = _mm_movemask_epi8(sse2_in_range(_mm_loadu_si128((const __m128i*) p), '0', 9));
+        if (run != 0xffff) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    while (p + 32 <= end) {
+        unsigned run = _mm256_movemask_epi8(avx2_in_range(_mm256_loadu_si256((const __m256i*) p), '0', 9));
+        if (run != 0xffffffffu) return p + __builtin_ctz(~run);
+        p += 32;
+    }
+    return sse2_digit_run(p, end);
+}
+
+static const ScanKernels avx2_kernels = {
+    "avx2", avx2_skip_whitespace, avx2_find_eol, avx2_find_quote,
+    avx2_ident_run, avx2_digit_run,
+};
+
+#endif
+
+const ScanKernels* scan_kernels_by_name(const char* name){
+    if (strcmp(name, "scalar") == 0) return &scalar_kernels;
+#ifdef SCAN_X86
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return &sse2_kernels;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return &avx2_kernels;
+#endif
+    return NULL;
+}
+
+const ScanKernels* scan_kernels(void){
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2")) return &avx2_kernels;
+    if (__builtin_cpu_supports("sse2")) return &sse2_kernels;
+#endif
+    return &scalar_kernels;
+}
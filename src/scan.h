@@ -0,0 +1,23 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Bulk scanning kernels for the lexer's long runs: whitespace, comment bodies,
+// string literal bodies, identifiers and digit runs. Every kernel takes the
+// current position and the end of the buffer and returns the first position
+// that is not part of the run (or end). The kernels that can cross lines add
+// the newlines they pass over to *line.
+typedef struct {
+    const char* name;
+    const char* (*skip_whitespace)(const char* p, const char* end, int* line);
+    const char* (*find_eol)(const char* p, const char* end);
+    const char* (*find_quote)(const char* p, const char* end, int* line);
+    const char* (*ident_run)(const char* p, const char* end);
+    const char* (*digit_run)(const char* p, const char* end);
+} ScanKernels;
+
+// widest kernel set the running CPU supports
+const ScanKernels* scan_kernels(void);
+// "scalar", "sse2" or "avx2"; NULL when unknown or not supported by this CPU
+const ScanKernels* scan_kernels_by_name(const char* name);
+
+#endif
@@ -0,0 +1,834 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sim.h"
+
+// spim's memory layout
+#define TEXT_BASE 0x00400000u
+#define DATA_BASE 0x10010000u
+#define STACK_END 0x80000000u
+#define STACK_SIZE (1u << 20)
+// main's $ra, jumping there ends the program
+#define EXIT_ADDRESS 0u
+
+typedef enum {
+    S_ADD, S_ADDU, S_SUB, S_SUBU, S_AND, S_OR, S_XOR, S_NOR, S_SLT, S_SLTU, S_SLLV, S_SRLV, S_SRAV, S_MUL,
+    S_ADDI, S_ADDIU, S_ANDI, S_ORI, S_XORI, S_SLTI, S_SLTIU, S_SLL, S_SRL, S_SRA,
+    S_LI, S_LUI, S_MOVE, S_NOT,
+    S_MULT, S_MULTU, S_DIV, S_DIVU, S_MFHI, S_MFLO,
+    S_LW, S_LB, S_LBU, S_SW, S_SB,
+    S_BEQ, S_BNE, S_BLT, S_BLE, S_BGT, S_BGE, S_BLTU, S_BLEU, S_BGTU, S_BGEU,
+    S_BEQZ, S_BNEZ, S_BLTZ, S_BLEZ, S_BGTZ, S_BGEZ,
+    S_J, S_JAL, S_JR, S_SYSCALL, S_NOP,
+} SimOp;
+
+// operand shapes
+typedef enum {
+    F_RRR,    // rd, rs, rt (or an immediate, giving the I form)
+    F_RRI,    // rd, rs, imm
+    F_RI,     // rd, imm
+    F_RA,     // rd, address (la)
+    F_RR,     // rd, rs
+    F_ST,     // rs, rt
+    F_D,      // rd
+    F_S,      // rs
+    F_MEM,    // rd, imm(rs) or address
+    F_BRANCH, // rs, rt (or an immediate), label
+    F_BZ,     // rs, label
+    F_JUMP,   // label
+    F_NONE,
+} Form;
+
+typedef struct {
+    const char* name;
+    SimOp op;
+    Form form;
+    SimClass cls;
+    int native;   // machine instructions spim expands it to
+    int latency;  // cycles on top of one per machine instruction
+    int imm_op;   // the op taking an immediate third operand, -1 for none
+} OpInfo;
+
+static const OpInfo ops[] = {
+    {"add", S_ADD, F_RRR, SIM_ALU, 1, 0, S_ADDI}, {"addu", S_ADDU, F_RRR, SIM_ALU, 1, 0, S_ADDIU},
+    {"sub", S_SUB, F_RRR, SIM_ALU, 1, 0, -1}, {"subu", S_SUBU, F_RRR, SIM_ALU, 1, 0, -1},
+    {"and", S_AND, F_RRR, SIM_ALU, 1, 0, S_ANDI}, {"or", S_OR, F_RRR, SIM_ALU, 1, 0, S_ORI},
+    {"xor", S_XOR, F_RRR, SIM_ALU, 1, 0, S_XORI}, {"nor", S_NOR, F_RRR, SIM_ALU, 1, 0, -1},
+    {"slt", S_SLT, F_RRR, SIM_ALU, 1, 0, S_SLTI}, {"sltu", S_SLTU, F_RRR, SIM_ALU, 1, 0, S_SLTIU},
+    {"sllv", S_SLLV, F_RRR, SIM_ALU, 1, 0, S_SLL}, {"srlv", S_SRLV, F_RRR, SIM_ALU, 1, 0, S_SRL},
+    {"srav", S_SRAV, F_RRR, SIM_ALU, 1, 0, S_SRA}, {"mul", S_MUL, F_RRR, SIM_MULDIV, 2, 11, -1},
+    {"addi", S_ADDI, F_RRI, SIM_ALU, 1, 0, -1}, {"addiu", S_ADDIU, F_RRI, SIM_ALU, 1, 0, -1},
+    {"andi", S_ANDI, F_RRI, SIM_ALU, 1, 0, -1}, {"ori", S_ORI, F_RRI, SIM_ALU, 1, 0, -1},
+    {"xori", S_XORI, F_RRI, SIM_ALU, 1, 0, -1}, {"slti", S_SLTI, F_RRI, SIM_ALU, 1, 0, -1},
+    {"sltiu", S_SLTIU, F_RRI, SIM_ALU, 1, 0, -1}, {"sll", S_SLL, F_RRI, SIM_ALU, 1, 0, -1},
+    {"srl", S_SRL, F_RRI, SIM_ALU, 1, 0, -1}, {"sra", S_SRA, F_RRI, SIM_ALU, 1, 0, -1},
+    {"li", S_LI, F_RI, SIM_ALU, 1, 0, -1}, {"lui", S_LUI, F_RI, SIM_ALU, 1, 0, -1},
+    {"la", S_LI, F_RA, SIM_ALU, 2, 0, -1}, {"move", S_MOVE, F_RR, SIM_ALU, 1, 0, -1},
+    {"not", S_NOT, F_RR, SIM_ALU, 1, 0, -1},
+    {"mult", S_MULT, F_ST, SIM_MULDIV, 1, 11, -1}, {"multu", S_MULTU, F_ST, SIM_MULDIV, 1, 11, -1},
+    {"div", S_DIV, F_ST, SIM_MULDIV, 1, 34, -1}, {"divu", S_DIVU, F_ST, SIM_MULDIV, 1, 34, -1},
+    {"mfhi", S_MFHI, F_D, SIM_MULDIV, 1, 0, -1}, {"mflo", S_MFLO, F_D, SIM_MULDIV, 1, 0, -1},
+    {"lw", S_LW, F_MEM, SIM_LOAD, 1, 0, -1}, {"lb", S_LB, F_MEM, SIM_LOAD, 1, 0, -1},
+    {"lbu", S_LBU, F_MEM, SIM_LOAD, 1, 0, -1}, {"sw", S_SW, F_MEM, SIM_STORE, 1, 0, -1},
+    {"sb", S_SB, F_MEM, SIM_STORE, 1, 0, -1},
+    {"beq", S_BEQ, F_BRANCH, SIM_BRANCH, 1, 0, -1}, {"bne", S_BNE, F_BRANCH, SIM_BRANCH, 1, 0, -1},
+    {"blt", S_BLT, F_BRANCH, SIM_BRANCH, 2, 0, -1}, {"ble", S_BLE, F_BRANCH, SIM_BRANCH, 2, 0, -1},
+    {"bgt", S_BGT, F_BRANCH, SIM_BRANCH, 2, 0, -1}, {"bge", S_BGE, F_BRANCH, SIM_BRANCH, 2, 0, -1},
+    {"bltu", S_BLTU, F_BRANCH, SIM_BRANCH, 2, 0, -1}, {"bleu", S_BLEU, F_BRANCH, SIM_BRANCH, 2, 0, -1},
+    {"bgtu", S_BGTU, F_BRANCH, SIM_BRANCH, 2, 0, -1}, {"bgeu", S_BGEU, F_BRANCH, SIM_BRANCH, 2, 0, -1},
+    {"beqz", S_BEQZ, F_BZ, SIM_BRANCH, 1, 0, -1}, {"bnez", S_BNEZ, F_BZ, SIM_BRANCH, 1, 0, -1},
+    {"bltz", S_BLTZ, F_BZ, SIM_BRANCH, 1, 0, -1}, {"blez", S_BLEZ, F_BZ, SIM_BRANCH, 1, 0, -1},
+    {"bgtz", S_BGTZ, F_BZ, SIM_BRANCH, 1, 0, -1}, {"bgez", S_BGEZ, F_BZ, SIM_BRANCH, 1, 0, -1},
+    {"j", S_J, F_JUMP, SIM_JUMP, 1, 0, -1}, {"b", S_J, F_JUMP, SIM_JUMP, 1, 0, -1},
+    {"jal", S_JAL, F_JUMP, SIM_JUMP, 1, 0, -1}, {"jr", S_JR, F_S, SIM_JUMP, 1, 0, -1},
+    {"syscall", S_SYSCALL, F_NONE, SIM_SYSCALL, 1, 0, -1}, {"nop", S_NOP, F_NONE, SIM_ALU, 1, 0, -1},
+};
+
+static const char* class_names[SIM_CLASS_COUNT] = {
+    [SIM_ALU] = "alu", [SIM_MULDIV] = "mul/div", [SIM_LOAD] = "load", [SIM_STORE] = "store",
+    [SIM_BRANCH] = "branch", [SIM_JUMP] = "jump", [SIM_SYSCALL] = "syscall",
+};
+
+static const char* register_names[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+// An instruction decoded once before the run. Branch and jump targets are
+// instruction indices, label operands are resolved to addresses in imm.
+typedef struct {
+    unsigned char op;
+    unsigned char rd, rs, rt;
+    unsigned char imm_operand; // a branch compares rs with imm instead of rt
+    unsigned char cls;
+    unsigned char native;
+    unsigned char cycles;
+    int32_t imm;
+    int target;
+    int source_line;           // from the last "# .loc" before it, 0 for none
+} Decoded;
+
+// an instruction line between the two passes
+typedef struct {
+    const OpInfo* info;
+    char* operands[3];
+    int operand_count;
+    int line;
+    int source_line;
+} Pending;
+
+typedef struct {
+    const char* name;
+    int is_text;
+    uint32_t offset; // instruction index in text, byte offset in data
+} Label;
+
+typedef struct {
+    Label* labels;
+    int label_count;
+    int label_capacity;
+    int* slots;      // open addressing over labels, -1 when empty
+    int slot_capacity;
+
+    unsigned char* data;
+    uint32_t data_size;
+    uint32_t data_capacity;
+
+    Pending* pending;
+    int pending_count;
+    int pending_capacity;
+
+    int source_line;  // of the last "# .loc"
+    int max_source_line;
+    int handler;      // first instruction of .ktext, the exception handler; -1 for none
+} Assembler;
+
+static void* grow(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Error: Realloc Failed on simulate\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void asm_error(int line, const char* message, const char* detail) {
+    fprintf(stderr, "Simulator error on assembly line %d: %s%s%s\n", line, message, detail ? " " : "", detail ? detail : "");
+    exit(EXIT_FAILURE);
+}
+
+static uint32_t hash_name(const char* name) {
+    uint32_t h = 2166136261u;
+    for (; *name; ++name) h = (h ^ (unsigned char) *name) * 16777619u;
+    return h;
+}
+
+static int find_label(const Assembler* as, const char* name) {
+    if (!as->slot_capacity) return -1;
+    for (uint32_t s = hash_name(name);; ++s) {
+        int index = as->slots[s & (as->slot_capacity - 1)];
+        if (index < 0) return -1;
+        if (strcmp(as->labels[index].name, name) == 0) return index;
+    }
+}
+
+static void insert_slot(Assembler* as, int index) {
+    uint32_t s = hash_name(as->labels[index].name);
+    while (as->slots[s & (as->slot_capacity - 1)] >= 0) ++s;
+    as->slots[s & (as->slot_capacity - 1)] = index;
+}
+
+static void add_label(Assembler* as, const char* name, int is_text, uint32_t offset, int line) {
+    if (find_label(as, name) >= 0) asm_error(line, "duplicate label", name);
+    if (as->label_count == as->label_capacity) {
+        as->label_capacity = as->label_capacity ? as->label_capacity * 2 : 64;
+        as->labels = (Label*) grow(as->labels, sizeof(Label) * as->label_capacity);
+    }
+    as->labels[as->label_count++] = (Label){name, is_text, offset};
+    if (as->label_count * 2 > as->slot_capacity) {
+        as->slot_capacity = as->slot_capacity ? as->slot_capacity * 2 : 128;
+        while (as->label_count * 2 > as->slot_capacity) as->slot_capacity *= 2;
+        as->slots = (int*) grow(as->slots, sizeof(int) * as->slot_capacity);
+        memset(as->slots, -1, sizeof(int) * as->slot_capacity);
+        for (int i = 0; i < as->label_count; ++i) insert_slot(as, i);
+    } else {
+        insert_slot(as, as->label_count - 1);
+    }
+}
+
+static void put_data(Assembler* as, const void* bytes, uint32_t length) {
+    while (as->data_size + length > as->data_capacity) {
+        as->data_capacity = as->data_capacity ? as->data_capacity * 2 : 1024;
+        as->data = (unsigned char*) grow(as->data, as->data_capacity);
+    }
+    if (bytes) memcpy(as->data + as->data_size, bytes, length);
+    else memset(as->data + as->data_size, 0, length);
+    as->data_size += length;
+}
+
+// Pads data to a multiple of alignment. Labels defined at the old end since
+// first_label move along, as spim's automatic alignment of .word does.
+static void align_data(Assembler* as, uint32_t alignment, int first_label) {
+    uint32_t old_size = as->data_size;
+    while (as->data_size % alignment) put_data(as, NULL, 1);
+    for (int i = first_label; i < as->label_count; ++i) {
+        if (!as->labels[i].is_text && as->labels[i].offset == old_size) as->labels[i].offset = as->data_size;
+    }
+}
+
+static char* skip_space(char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+    return p;
+}
+
+static void trim_end(char* p) {
+    size_t n = strlen(p);
+    while (n && (p[n - 1] == ' ' || p[n - 1] == '\t' || p[n - 1] == '\r')) p[--n] = '\0';
+}
+
+static int is_name_char(char c, int first) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.' || c == '$'
+        || (!first && c >= '0' && c <= '9');
+}
+
+static long long parse_int(const char* text, int line) {
+    char* end;
+    long long value = strtoll(text, &end, 0);
+    if (end == text || *skip_space(end) != '\0') asm_error(line, "expected a number, got", text);
+    return value;
+}
+
+// the bytes of a quoted string, escapes decoded
+static void put_string(Assembler* as, char* p, int terminate, int line) {
+    p = skip_space(p);
+    if (*p != '"') asm_error(line, "expected a string", NULL);
+    for (++p; *p && *p != '"'; ++p) {
+        char c = *p;
+        if (c == '\\' && p[1]) {
+            switch (*++p) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                default: c = *p; break;
+            }
+        }
+        put_data(as, &c, 1);
+    }
+    if (*p != '"') asm_error(line, "unterminated string", NULL);
+    if (terminate) put_data(as, "", 1);
+}
+
+static void directive(Assembler* as, char* p, int* in_text, int first_label, int line) {
+    char* name = p;
+    while (*p && *p != ' ' && *p != '\t') ++p;
+    if (*p) *p++ = '\0';
+    p = skip_space(p);
+    if (strcmp(name, ".data") == 0) {
+        *in_text = 0;
+    } else if (strcmp(name, ".text") == 0) {
+        *in_text = 1;
+    } else if (strcmp(name, ".ktext") == 0) {
+        // wherever it is put, exceptions go there
+        *in_text = 1;
+        if (as->handler < 0) as->handler = as->pending_count;
+    } else if (strcmp(name, ".globl") == 0) {
+        // everything is visible anyway
+    } else if (strcmp(name, ".align") == 0) {
+        if (!*in_text) align_data(as, 1u << parse_int(p, line), first_label);
+    } else if (*in_text) {
+        asm_error(line, "data directive in .text:", name);
+    } else if (strcmp(name, ".asciiz") == 0 || strcmp(name, ".ascii") == 0) {
+        put_string(as, p, name[6] == 'z', line);
+    } else if (strcmp(name, ".word") == 0 || strcmp(name, ".byte") == 0) {
+        int word = name[1] == 'w';
+        if (word) align_data(as, 4, first_label);
+        for (char* item = strtok(p, ","); item; item = strtok(NULL, ",")) {
+            trim_end(item);
+            uint32_t value = (uint32_t) parse_int(skip_space(item), line);
+            unsigned char bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24};
+            put_data(as, bytes, word ? 4 : 1);
+        }
+    } else if (strcmp(name, ".space") == 0) {
+        put_data(as, NULL, (uint32_t) parse_int(p, line));
+    } else {
+        asm_error(line, "unknown directive", name);
+    }
+}
+
+static const OpInfo* find_op(const char* name) {
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strcmp(ops[i].name, name) == 0) return &ops[i];
+    }
+    return NULL;
+}
+
+static void instruction(Assembler* as, char* p, int line) {
+    char* name = p;
+    while (*p && *p != ' ' && *p != '\t') ++p;
+    if (*p) *p++ = '\0';
+    const OpInfo* info = find_op(name);
+    if (!info) asm_error(line, "unknown instruction", name);
+
+    if (as->pending_count == as->pending_capacity) {
+        as->pending_capacity = as->pending_capacity ? as->pending_capacity * 2 : 256;
+        as->pending = (Pending*) grow(as->pending, sizeof(Pending) * as->pending_capacity);
+    }
+    Pending* in = &as->pending[as->pending_count++];
+    in->info = info;
+    in->line = line;
+    in->source_line = as->source_line;
+    in->operand_count = 0;
+    p = skip_space(p);
+    while (*p) {
+        if (in->operand_count == 3) asm_error(line, "too many operands", NULL);
+        in->operands[in->operand_count++] = p;
+        char* comma = strchr(p, ',');
+        if (comma) *comma = '\0';
+        trim_end(p);
+        if (!comma) break;
+        p = skip_space(comma + 1);
+    }
+}
+
+// First pass: labels, data and the instruction lines. Cuts text into
+// strings in place.
+static void assemble(Assembler* as, char* text) {
+    int in_text = 1;
+    int line = 0;
+    char* next;
+    for (char* p = text; p; p = next) {
+        ++line;
+        next = strchr(p, '\n');
+        if (next) *next++ = '\0';
+
+        p = skip_space(p);
+        if (strncmp(p, "# .loc ", 7) == 0) {
+            as->source_line = atoi(p + 7);
+            if (as->source_line > as->max_source_line) as->max_source_line = as->source_line;
+            continue;
+        }
+
+        // drop the comment, a # inside a string literal aside
+        int quoted = 0;
+        for (char* c = p; *c; ++c) {
+            if (*c == '\\' && quoted && c[1]) ++c;
+            else if (*c == '"') quoted = !quoted;
+            else if (*c == '#' && !quoted) {
+                *c = '\0';
+                break;
+            }
+        }
+        p = skip_space(p);
+        trim_end(p);
+
+        int first_label = as->label_count;
+        for (;;) {
+            char* end = p;
+            if (!is_name_char(*end, 1)) break;
+            while (is_name_char(*end, 0)) ++end;
+            char* colon = skip_space(end);
+            if (*colon != ':') break;
+            *end = '\0';
+            add_label(as, p, in_text, in_text ? (uint32_t) as->pending_count : as->data_size, line);
+            p = skip_space(colon + 1);
+        }
+        if (!*p) continue;
+        if (*p == '.') directive(as, p, &in_text, first_label, line);
+        else if (in_text) instruction(as, p, line);
+        else asm_error(line, "instruction in .data:", p);
+    }
+}
+
+static int parse_register(const char* text, int line) {
+    if (text[0] != '$') asm_error(line, "expected a register, got", text);
+    const char* name = text + 1;
+    if (name[0] >= '0' && name[0] <= '9') {
+        char* end;
+        long number = strtol(name, &end, 10);
+        if (*end == '\0' && number < 32) return (int) number;
+    }
+    for (int r = 0; r < 32; ++r) {
+        if (strcmp(register_names[r], name) == 0) return r;
+    }
+    asm_error(line, "unknown register", text);
+    return 0;
+}
+
+// label, label+N, label-N or a number
+static uint32_t parse_address(const Assembler* as, char* text, int line) {
+    if (!is_name_char(text[0], 1)) return (uint32_t) parse_int(text, line);
+    char* end = text;
+    while (is_name_char(*end, 0)) ++end;
+    uint32_t offset = *end ? (uint32_t) parse_int(end, line) : 0;
+    char saved = *end;
+    *end = '\0';
+    int index = find_label(as, text);
+    if (index < 0) asm_error(line, "unknown label", text);
+    *end = saved;
+    const Label* label = &as->labels[index];
+    return (label->is_text ? TEXT_BASE + 4 * label->offset : DATA_BASE + label->offset) + offset;
+}
+
+static int parse_target(const Assembler* as, const char* text, int line) {
+    int index = find_label(as, text);
+    if (index < 0) asm_error(line, "unknown label", text);
+    if (!as->labels[index].is_text) asm_error(line, "not a code label:", text);
+    return (int) as->labels[index].offset;
+}
+
+static int is_register(const char* text) {
+    return text[0] == '$';
+}
+
+// Second pass: operands resolved into a decoded instruction.
+static Decoded decode(const Assembler* as, Pending* in) {
+    const OpInfo* info = in->info;
+    static const int operand_counts[] = {
+        [F_RRR] = 3, [F_RRI] = 3, [F_RI] = 2, [F_RA] = 2, [F_RR] = 2, [F_ST] = 2, [F_D] = 1,
+        [F_S] = 1, [F_MEM] = 2, [F_BRANCH] = 3, [F_BZ] = 2, [F_JUMP] = 1, [F_NONE] = 0,
+    };
+    if (in->operand_count != operand_counts[info->form]) asm_error(in->line, "wrong operand count for", info->name);
+
+    Decoded d = {0};
+    d.op = info->op;
+    d.cls = info->cls;
+    d.native = info->native;
+    char** o = in->operands;
+    switch (info->form) {
+        case F_RRR:
+            d.rd = parse_register(o[0], in->line);
+            d.rs = parse_register(o[1], in->line);
+            if (is_register(o[2])) {
+                d.rt = parse_register(o[2], in->line);
+            } else {
+                if (info->imm_op < 0) asm_error(in->line, "expected a register, got", o[2]);
+                d.op = info->imm_op;
+                d.imm = (int32_t) parse_int(o[2], in->line);
+            }
+            break;
+        case F_RRI:
+            d.rd = parse_register(o[0], in->line);
+            d.rs = parse_register(o[1], in->line);
+            d.imm = (int32_t) parse_int(o[2], in->line);
+            break;
+        case F_RI:
+            d.rd = parse_register(o[0], in->line);
+            d.imm = (int32_t) parse_int(o[1], in->line);
+            if (d.op == S_LI && (d.imm < -32768 || d.imm > 65535)) d.native = 2;
+            break;
+        case F_RA:
+            d.rd = parse_register(o[0], in->line);
+            d.imm = (int32_t) parse_address(as, o[1], in->line);
+            break;
+        case F_RR:
+            d.rd = parse_register(o[0], in->line);
+            d.rs = parse_register(o[1], in->line);
+            break;
+        case F_ST:
+            d.rs = parse_register(o[0], in->line);
+            d.rt = parse_register(o[1], in->line);
+            break;
+        case F_D:
+            d.rd = parse_register(o[0], in->line);
+            break;
+        case F_S:
+            d.rs = parse_register(o[0], in->line);
+            break;
+        case F_MEM: {
+            d.rd = parse_register(o[0], in->line);
+            char* open = strchr(o[1], '(');
+            if (open) {
+                char* close = strchr(open, ')');
+                if (!close) asm_error(in->line, "expected ), got", o[1]);
+                *close = '\0';
+                d.rs = parse_register(skip_space(open + 1), in->line);
+                *open = '\0';
+                trim_end(o[1]);
+                d.imm = *o[1] ? (int32_t) parse_int(o[1], in->line) : 0;
+            } else {
+                // a label address takes a lui in front
+                d.imm = (int32_t) parse_address(as, o[1], in->line);
+                ++d.native;
+            }
+            break;
+        }
+        case F_BRANCH:
+            d.rs = parse_register(o[0], in->line);
+            if (is_register(o[1])) {
+                d.rt = parse_register(o[1], in->line);
+            } else {
+                // spim loads the immediate into $at first
+                d.imm_operand = 1;
+                d.imm = (int32_t) parse_int(o[1], in->line);
+                ++d.native;
+            }
+            d.target = parse_target(as, o[2], in->line);
+            break;
+        case F_BZ:
+            d.rs = parse_register(o[0], in->line);
+            d.target = parse_target(as, o[1], in->line);
+            break;
+        case F_JUMP:
+            d.target = parse_target(as, o[0], in->line);
+            break;
+        case F_NONE:
+            break;
+    }
+    d.cycles = d.native + info->latency;
+    d.source_line = in->source_line;
+    return d;
+}
+
+typedef struct {
+    uint32_t r[32];
+    uint32_t hi, lo;
+    unsigned char* data;
+    uint32_t data_size;
+    unsigned char* stack;
+    const int* lines; // assembly line of each instruction, for faults
+    int handler;      // where an overflow trap goes, -1 to stop right there
+    int raised;       // the current instruction trapped
+    int exception;    // the handler is running
+} Machine;
+
+static void report_fault(const Machine* m, int pc, const char* message, uint32_t value) {
+    fprintf(stderr, "Simulator fault at assembly line %d: %s 0x%08x\n", m->lines[pc], message, value);
+}
+
+static void fault(const Machine* m, int pc, const char* message, uint32_t value) {
+    report_fault(m, pc, message, value);
+    exit(EXIT_FAILURE);
+}
+
+static unsigned char* memory(Machine* m, int pc, uint32_t address, uint32_t size) {
+    if (address % size) fault(m, pc, "unaligned address", address);
+    if (address >= DATA_BASE && address - DATA_BASE + size <= m->data_size) return m->data + (address - DATA_BASE);
+    if (address >= STACK_END - STACK_SIZE && address <= STACK_END - size) return m->stack + (address - (STACK_END - STACK_SIZE));
+    fault(m, pc, "address out of range", address);
+    return NULL;
+}
+
+static uint32_t load_word(Machine* m, int pc, uint32_t address) {
+    const unsigned char* p = memory(m, pc, address, 4);
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void store_word(Machine* m, int pc, uint32_t address, uint32_t value) {
+    unsigned char* p = memory(m, pc, address, 4);
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = value >> 24;
+}
+
+static void print_string(Machine* m, int pc, uint32_t address, FILE* output) {
+    for (;; ++address) {
+        char c = (char) *memory(m, pc, address, 1);
+        if (!c) return;
+        fputc(c, output);
+    }
+}
+
+// traps like add and sub do when the signed result does not fit, to the
+// program's exception handler when it has one
+static uint32_t checked(Machine* m, int pc, int64_t value) {
+    if (value < INT32_MIN || value > INT32_MAX) {
+        if (m->handler < 0 || m->exception) fault(m, pc, "arithmetic overflow, result", (uint32_t) value);
+        report_fault(m, pc, "arithmetic overflow, result", (uint32_t) value);
+        m->raised = 1;
+    }
+    return (uint32_t) value;
+}
+
+// Runs from main; counts[i] is how often instruction i ran.
+static int run(Machine* m, const Decoded* code, int count, int pc, long long* counts, long long* taken,
+               SimProfile* profile, FILE* output) {
+    uint32_t* r = m->r;
+    int source_line = 0; // of the last instruction that had one, so calls count for their caller
+    for (;;) {
+        const Decoded* d = &code[pc];
+        ++counts[pc];
+        if (profile) {
+            if (d->source_line) source_line = d->source_line;
+            ++profile->instructions[source_line];
+            profile->cycles[source_line] += d->cycles;
+        }
+        int next = pc + 1;
+        int32_t s = (int32_t) r[d->rs], t = (int32_t) r[d->rt];
+        uint32_t value = 0;
+        switch (d->op) {
+            case S_ADD: value = checked(m, pc, (int64_t) s + t); break;
+            case S_ADDU: value = r[d->rs] + r[d->rt]; break;
+            case S_SUB: value = checked(m, pc, (int64_t) s - t); break;
+            case S_SUBU: value = r[d->rs] - r[d->rt]; break;
+            case S_AND: value = r[d->rs] & r[d->rt]; break;
+            case S_OR: value = r[d->rs] | r[d->rt]; break;
+            case S_XOR: value = r[d->rs] ^ r[d->rt]; break;
+            case S_NOR: value = ~(r[d->rs] | r[d->rt]); break;
+            case S_SLT: value = s < t; break;
+            case S_SLTU: value = r[d->rs] < r[d->rt]; break;
+            case S_SLLV: value = r[d->rs] << (r[d->rt] & 31); break;
+            case S_SRLV: value = r[d->rs] >> (r[d->rt] & 31); break;
+            case S_SRAV: value = (uint32_t) (s >> (r[d->rt] & 31)); break;
+            case S_MUL: {
+                int64_t product = (int64_t) s * t;
+                m->lo = (uint32_t) product;
+                m->hi = (uint32_t) ((uint64_t) product >> 32);
+                value = m->lo;
+                break;
+            }
+            case S_ADDI: value = checked(m, pc, (int64_t) s + d->imm); break;
+            case S_ADDIU: value = r[d->rs] + (uint32_t) d->imm; break;
+            case S_ANDI: value = r[d->rs] & ((uint32_t) d->imm & 0xffff); break;
+            case S_ORI: value = r[d->rs] | ((uint32_t) d->imm & 0xffff); break;
+            case S_XORI: value = r[d->rs] ^ ((uint32_t) d->imm & 0xffff); break;
+            case S_SLTI: value = s < d->imm; break;
+            case S_SLTIU: value = r[d->rs] < (uint32_t) d->imm; break;
+            case S_SLL: value = r[d->rs] << (d->imm & 31); break;
+            case S_SRL: value = r[d->rs] >> (d->imm & 31); break;
+            case S_SRA: value = (uint32_t) (s >> (d->imm & 31)); break;
+            case S_LI: value = (uint32_t) d->imm; break;
+            case S_LUI: value = (uint32_t) d->imm << 16; break;
+            case S_MOVE: value = r[d->rs]; break;
+            case S_NOT: value = ~r[d->rs]; break;
+            case S_MULT: {
+                int64_t product = (int64_t) s * t;
+                m->lo = (uint32_t) product;
+                m->hi = (uint32_t) ((uint64_t) product >> 32);
+                break;
+            }
+            case S_MULTU: {
+                uint64_t product = (uint64_t) r[d->rs] * r[d->rt];
+                m->lo = (uint32_t) product;
+                m->hi = (uint32_t) (product >> 32);
+                break;
+            }
+            case S_DIV:
+                // the result of a division by zero is undefined, HI and LO stay
+                if (t != 0) {
+                    int64_t quotient = (int64_t) s / t;
+                    m->lo = (uint32_t) quotient;
+                    m->hi = (uint32_t) ((int64_t) s - quotient * t);
+                }
+                break;
+            case S_DIVU:
+                if (r[d->rt] != 0) {
+                    m->lo = r[d->rs] / r[d->rt];
+                    m->hi = r[d->rs] % r[d->rt];
+                }
+                break;
+            case S_MFHI: value = m->hi; break;
+            case S_MFLO: value = m->lo; break;
+            case S_LW: value = load_word(m, pc, r[d->rs] + (uint32_t) d->imm); break;
+            case S_LB: value = (uint32_t) (int32_t) (signed char) *memory(m, pc, r[d->rs] + (uint32_t) d->imm, 1); break;
+            case S_LBU: value = *memory(m, pc, r[d->rs] + (uint32_t) d->imm, 1); break;
+            case S_SW: store_word(m, pc, r[d->rs] + (uint32_t) d->imm, r[d->rd]); break;
+            case S_SB: *memory(m, pc, r[d->rs] + (uint32_t) d->imm, 1) = r[d->rd] & 0xff; break;
+            case S_BEQ: case S_BNE: case S_BLT: case S_BLE: case S_BGT: case S_BGE:
+            case S_BLTU: case S_BLEU: case S_BGTU: case S_BGEU: {
+                if (d->imm_operand) t = d->imm;
+                uint32_t us = (uint32_t) s, ut = (uint32_t) t;
+                int jump = 0;
+                switch (d->op) {
+                    case S_BEQ: jump = s == t; break;
+                    case S_BNE: jump = s != t; break;
+                    case S_BLT: jump = s < t; break;
+                    case S_BLE: jump = s <= t; break;
+                    case S_BGT: jump = s > t; break;
+                    case S_BGE: jump = s >= t; break;
+                    case S_BLTU: jump = us < ut; break;
+                    case S_BLEU: jump = us <= ut; break;
+                    case S_BGTU: jump = us > ut; break;
+                    default: jump = us >= ut; break;
+                }
+                if (jump) {
+                    next = d->target;
+                    ++*taken;
+                }
+                break;
+            }
+            case S_BEQZ: case S_BNEZ: case S_BLTZ: case S_BLEZ: case S_BGTZ: case S_BGEZ: {
+                int jump = d->op == S_BEQZ ? s == 0 : d->op == S_BNEZ ? s != 0 : d->op == S_BLTZ ? s < 0
+                    : d->op == S_BLEZ ? s <= 0 : d->op == S_BGTZ ? s > 0 : s >= 0;
+                if (jump) {
+                    next = d->target;
+                    ++*taken;
+                }
+                break;
+            }
+            case S_J: next = d->target; break;
+            case S_JAL:
+                r[31] = TEXT_BASE + 4 * (uint32_t) next;
+                next = d->target;
+                break;
+            case S_JR: {
+                uint32_t address = r[d->rs];
+                if (address == EXIT_ADDRESS) return (int32_t) r[2];
+                if (address % 4 || address < TEXT_BASE || (address - TEXT_BASE) / 4 >= (uint32_t) count) {
+                    fault(m, pc, "jump to a bad address", address);
+                }
+                next = (int) ((address - TEXT_BASE) / 4);
+                break;
+            }
+            case S_SYSCALL:
+                switch (r[2]) {
+                    case 1: fprintf(output, "%d", (int32_t) r[4]); break;
+                    case 4: print_string(m, pc, r[4], output); break;
+                    case 11: fputc((char) r[4], output); break;
+                    case 10: return 0;
+                    case 17: return (int32_t) r[4];
+                    default: fault(m, pc, "unsupported syscall", r[2]);
+                }
+                break;
+            case S_NOP:
+                break;
+        }
+        if (m->raised) {
+            // the destination keeps its value, the handler takes over
+            m->raised = 0;
+            m->exception = 1;
+            pc = m->handler;
+            continue;
+        }
+        // only these write a register
+        if (d->cls == SIM_ALU || d->cls == SIM_LOAD || d->op == S_MUL || d->op == S_MFHI || d->op == S_MFLO) {
+            if (d->rd) r[d->rd] = value;
+        }
+        if (next >= count) fault(m, pc, "ran past the last instruction, next address", TEXT_BASE + 4 * (uint32_t) next);
+        pc = next;
+    }
+}
+
+void simulate(const char* text, size_t length, FILE* output, SimStats* stats, SimProfile* profile) {
+    char* copy = (char*) grow(NULL, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    Assembler as = {0};
+    as.handler = -1;
+    assemble(&as, copy);
+    Decoded* code = (Decoded*) grow(NULL, sizeof(Decoded) * (as.pending_count + 1));
+    int* lines = (int*) grow(NULL, sizeof(int) * (as.pending_count + 1));
+    for (int i = 0; i < as.pending_count; ++i) {
+        code[i] = decode(&as, &as.pending[i]);
+        lines[i] = as.pending[i].line;
+    }
+    int main_label = find_label(&as, "main");
+    if (main_label < 0 || !as.labels[main_label].is_text) {
+        fprintf(stderr, "Simulator error: no main label\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Machine m = {0};
+    m.data = as.data;
+    m.data_size = as.data_size;
+    m.stack = (unsigned char*) calloc(STACK_SIZE, 1);
+    m.lines = lines;
+    m.handler = as.handler;
+    if (!m.stack) {
+        fprintf(stderr, "Error: Malloc Failed on simulate\n");
+        exit(EXIT_FAILURE);
+    }
+    m.r[29] = STACK_END - 16; // $sp
+    m.r[31] = EXIT_ADDRESS;   // $ra
+
+    long long* counts = (long long*) calloc(as.pending_count + 1, sizeof(long long));
+    if (!counts) {
+        fprintf(stderr, "Error: Malloc Failed on simulate\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (profile) {
+        profile->line_count = as.max_source_line + 1;
+        profile->instructions = (long long*) calloc(profile->line_count, sizeof(long long));
+        profile->cycles = (long long*) calloc(profile->line_count, sizeof(long long));
+        if (!profile->instructions || !profile->cycles) {
+            fprintf(stderr, "Error: Malloc Failed on simulate\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stats->exit_code = run(&m, code, as.pending_count, (int) as.labels[main_label].offset, counts,
+                           &stats->taken_branches, profile, output);
+    fflush(output);
+    // a trap still ends the run as a fault, once the handler has finished
+    if (m.exception) exit(EXIT_FAILURE);
+
+    // totals from how often each instruction ran
+    for (int i = 0; i < as.pending_count; ++i) {
+        stats->instructions += counts[i];
+        stats->native += counts[i] * code[i].native;
+        stats->cycles += counts[i] * code[i].cycles;
+        stats->by_class[code[i].cls] += counts[i];
+    }
+
+    free(counts);
+    free(m.stack);
+    free(lines);
+    free(code);
+    free(as.pending);
+    free(as.data);
+    free(as.labels);
+    free(as.slots);
+    free(copy);
+}
+
+void print_sim_stats(const SimStats* stats, FILE* out) {
+    fprintf(out, "simulator: %lld instructions, %lld after pseudo instruction expansion, %lld cycles\n",
+            stats->instructions, stats->native, stats->cycles);
+    for (int c = 0; c < SIM_CLASS_COUNT; ++c) {
+        fprintf(out, "  %-18s %lld\n", class_names[c], stats->by_class[c]);
+    }
+    fprintf(out, "  %-18s %lld\n", "taken branches", stats->taken_branches);
+    fprintf(out, "  %-18s %d\n", "exit code", stats->exit_code);
+}
+
+void free_sim_profile(SimProfile* profile) {
+    free(profile->instructions);
+    free(profile->cycles);
+    profile->instructions = profile->cycles = NULL;
+    profile->line_count = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// what an executed instruction counts as
+typedef enum {
+    SIM_ALU,      // arithmetic, logic, shifts, set-on-compare, li/la/move
+    SIM_MULDIV,   // mult, div and the mfhi/mflo reading their result
+    SIM_LOAD,
+    SIM_STORE,
+    SIM_BRANCH,
+    SIM_JUMP,     // j, jal, jr
+    SIM_SYSCALL,
+    SIM_CLASS_COUNT
+} SimClass;
+
+typedef struct {
+    long long instructions;          // as written, a pseudo instruction counts once
+    long long native;                // after spim's pseudo instruction expansion
+    long long cycles;                // estimate: one per native instruction plus R3000 mult/div latency
+    long long by_class[SIM_CLASS_COUNT];
+    long long taken_branches;
+    int exit_code;                   // $v0 at the return from main, or the exit syscall's
+} SimStats;
+
+// Executed instructions and cycles per source line, taken from the
+// "# .loc <line>" comments of code generated with line comments. The
+// runtime routines count for the line that called them.
+typedef struct {
+    long long* instructions;
+    long long* cycles;
+    int line_count;                  // entries; 0 collects code outside any line
+} SimProfile;
+
+// Assembles MIPS assembly text as the code generator writes it (runtime
+// routines included) and runs it from main until main returns or an exit
+// syscall. Printed output goes to output. A fault, say an overflow trap or a
+// load from outside memory, is reported with its assembly line and exits;
+// an overflow trap runs the program's .ktext exception handler first, when
+// it has one. profile may be NULL.
+void simulate(const char* text, size_t length, FILE* output, SimStats* stats, SimProfile* profile);
+void print_sim_stats(const SimStats* stats, FILE* out);
+void free_sim_profile(SimProfile* profile);
+
+#endif
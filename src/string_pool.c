@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_pool.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+#define INITIAL_POOL_STRINGS 256
+#define INITIAL_POOL_CHARS 4096
+
+// FNV-1a
+static unsigned int hash_bytes(const char* str, int length){
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        h ^= (unsigned char) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void* grow(void* ptr, size_t bytes){
+    void* ret = counted_realloc(ptr, bytes);
+    if (!ret) {
+        compile_error("Error: Realloc Failed on string pool\n");
+    }
+    return ret;
+}
+
+void init_string_pool(StringPool* pool){
+    pool->chars_capacity = INITIAL_POOL_CHARS;
+    pool->chars_size = 0;
+    pool->chars = (char*) grow(NULL, pool->chars_capacity);
+
+    pool->capacity = INITIAL_POOL_STRINGS;
+    pool->count = 0;
+    pool->offsets = (int*) grow(NULL, sizeof(int) * pool->capacity);
+    pool->lengths = (int*) grow(NULL, sizeof(int) * pool->capacity);
+    pool->hashes = (unsigned int*) grow(NULL, sizeof(unsigned int) * pool->capacity);
+
+    // keep the load factor at or below 1/2
+    pool->slot_capacity = INITIAL_POOL_STRINGS * 2;
+    pool->slots = (int*) grow(NULL, sizeof(int) * pool->slot_capacity);
+    memset(pool->slots, -1, sizeof(int) * pool->slot_capacity);
+}
+
+static int lookup_slot(const StringPool* pool, const char* str, int length, unsigned int h){
+    unsigned int mask = pool->slot_capacity - 1;
+    unsigned int i = h & mask;
+    for (;;) {
+        int id = pool->slots[i];
+        if (id < 0) return i;
+        if (pool->hashes[id] == h && pool->lengths[id] == length
+            && memcmp(pool->chars + pool->offsets[id], str, length) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void grow_slots(StringPool* pool){
+    pool->slot_capacity *= 2;
+    pool->slots = (int*) grow(pool->slots, sizeof(int) * pool->slot_capacity);
+    memset(pool->slots, -1, sizeof(int) * pool->slot_capacity);
+
+    unsigned int mask = pool->slot_capacity - 1;
+    for (int id = 0; id < pool->count; ++id) {
+        unsigned int i = pool->hashes[id] & mask;
+        while (pool->slots[i] >= 0) i = (i + 1) & mask;
+        pool->slots[i] = id;
+    }
+}
+
+int intern_string(StringPool* pool, const char* str, int length){
+    unsigned int h = hash_bytes(str, length);
+    int slot = lookup_slot(pool, str, length, h);
+    if (pool->slots[slot] >= 0) return pool->slots[slot];
+
+    if (pool->count == pool->capacity) {
+        pool->capacity *= 2;
+        pool->offsets = (int*) grow(pool->offsets, sizeof(int) * pool->capacity);
+        pool->lengths = (int*) grow(pool->lengths, sizeof(int) * pool->capacity);
+        pool->hashes = (unsigned int*) grow(pool->hashes, sizeof(unsigned int) * pool->capacity);
+    }
+    while (pool->chars_size + length + 1 > pool->chars_capacity) {
+        pool->chars_capacity *= 2;
+        pool->chars = (char*) grow(pool->chars, pool->chars_capacity);
+    }
+
+    int id = pool->count++;
+    pool->offsets[id] = pool->chars_size;
+    pool->lengths[id] = length;
+    pool->hashes[id] = h;
+    memcpy(pool->chars + pool->chars_size, str, length);
+    pool->chars[pool->chars_size + length] = '\0';
+    pool->chars_size += length + 1;
+    pool->slots[slot] = id;
+
+    if (pool->count * 2 > pool->slot_capacity) grow_slots(pool);
+    return id;
+}
+
+// -1 if the string was never interned
+int find_string(const StringPool* pool, const char* str, int length){
+    int slot = lookup_slot(pool, str, length, hash_bytes(str, length));
+    return pool->slots[slot];
+}
+
+const char* pool_string(const StringPool* pool, int id){
+    return pool->chars + pool->offsets[id];
+}
+
+int pool_length(const StringPool* pool, int id){
+    return pool->lengths[id];
+}
+
+void free_string_pool(StringPool* pool){
+    counted_free(pool->chars);
+    counted_free(pool->offsets);
+    counted_free(pool->lengths);
+    counted_free(pool->hashes);
+    counted_free(pool->slots);
+    pool->chars = NULL;
+    pool->offsets = pool->lengths = pool->slots = NULL;
+    pool->hashes = NULL;
+    pool->count = pool->capacity = pool->slot_capacity = 0;
+    pool->chars_size = pool->chars_capacity = 0;
+}
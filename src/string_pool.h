@@ -0,0 +1,29 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+// Interns byte strings: every distinct string is stored once and named by a
+// small integer id. Strings live back to back in one growable buffer, each NUL
+// terminated, so a pointer from pool_string is only valid until the next intern.
+typedef struct {
+    char* chars;
+    int chars_size;
+    int chars_capacity;
+
+    int* offsets;          // id -> start in chars
+    int* lengths;          // id -> length (excluding the NUL)
+    unsigned int* hashes;  // id -> hash, kept so growing the table does not rehash the bytes
+    int count;
+    int capacity;
+
+    int* slots;            // open addressing table of ids, -1 when empty
+    int slot_capacity;     // always a power of two
+} StringPool;
+
+void init_string_pool(StringPool* pool);
+int intern_string(StringPool* pool, const char* str, int length);
+int find_string(const StringPool* pool, const char* str, int length);
+const char* pool_string(const StringPool* pool, int id);
+int pool_length(const StringPool* pool, int id);
+void free_string_pool(StringPool* pool);
+
+#endif
@@ -1,43 +1,138 @@
 
 #include "symbol_table.h"
+#include "counted_alloc.h"
+#include "diagnostics.h"
+
+#define INITIAL_SYMBOLS 16
+#define INITIAL_SCOPES 8
+
+static void* grow(void* ptr, size_t bytes){
+    void* ret = counted_realloc(ptr, bytes);
+    if (!ret) {
+        compile_error("Error: Realloc Failed on symbol table\n");
+    }
+    return ret;
+}
+
+// interned ids are dense small integers, so a multiplicative hash spreads them well
+static unsigned int hash_name(int name){
+    return (unsigned int) name * 2654435761u;
+}
+
+// slot holding name, or the empty slot where it would go
+static int find_slot(const SymbolTable* table, int name){
+    unsigned int mask = table->slot_capacity - 1;
+    unsigned int i = hash_name(name) & mask;
+    while (table->slot_names[i] >= 0 && table->slot_names[i] != name) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void grow_slots(SymbolTable* table){
+    int old_capacity = table->slot_capacity;
+    int* old_names = table->slot_names;
+    int* old_symbols = table->slot_symbols;
+
+    table->slot_capacity *= 2;
+    table->slot_names = (int*) grow(NULL, sizeof(int) * table->slot_capacity);
+    table->slot_symbols = (int*) grow(NULL, sizeof(int) * table->slot_capacity);
+    memset(table->slot_names, -1, sizeof(int) * table->slot_capacity);
+
+    for (int i = 0; i < old_capacity; ++i) {
+        if (old_names[i] < 0) continue;
+        int slot = find_slot(table, old_names[i]);
+        table->slot_names[slot] = old_names[i];
+        table->slot_symbols[slot] = old_symbols[i];
+    }
+    counted_free(old_names);
+    counted_free(old_symbols);
+}
 
 void init_symbol_table(SymbolTable* table) {
     table->count = 0;
-    table->capacity = 16;
-    table->symbols = (Symbol*)malloc(table->capacity * sizeof(Symbol));
+    table->declared = 0;
+    table->capacity = INITIAL_SYMBOLS;
+    table->symbols = (Symbol*) grow(NULL, table->capacity * sizeof(Symbol));
+
+    // the outermost (function) scope is always open
+    table->scope_capacity = INITIAL_SCOPES;
+    table->scope_starts = (int*) grow(NULL, table->scope_capacity * sizeof(int));
+    table->scope_starts[0] = 0;
+    table->scope_depth = 1;
+
+    table->slot_count = 0;
+    table->slot_capacity = INITIAL_SYMBOLS * 2;
+    table->slot_names = (int*) grow(NULL, sizeof(int) * table->slot_capacity);
+    table->slot_symbols = (int*) grow(NULL, sizeof(int) * table->slot_capacity);
+    memset(table->slot_names, -1, sizeof(int) * table->slot_capacity);
 }
 
-void add_symbol(SymbolTable* table, const char* name, const char* label, TokenType type, const char* value) {
-    // check if symbol is already in table (duplicate varaible)
-    if (find_symbol(table, name)){
-        fprintf(stderr, "Error: Symbol '%s' already declared.\n", name);
-        exit(EXIT_FAILURE);
+void push_scope(SymbolTable* table) {
+    if (table->scope_depth == table->scope_capacity) {
+        table->scope_capacity *= 2;
+        table->scope_starts = (int*) grow(table->scope_starts, table->scope_capacity * sizeof(int));
+    }
+    table->scope_starts[table->scope_depth++] = table->count;
+}
+
+void pop_scope(SymbolTable* table) {
+    if (table->scope_depth <= 1) return;
+    int start = table->scope_starts[--table->scope_depth];
+    // unwind innermost first so every name ends up back at its outer symbol
+    while (table->count > start) {
+        Symbol* symbol = &table->symbols[--table->count];
+        table->slot_symbols[find_slot(table, symbol->name)] = symbol->shadowed;
+    }
+}
+
+Symbol* add_symbol(SymbolTable* table, int name, int label, TokenType type, int value) {
+    int slot = find_slot(table, name);
+    int previous = table->slot_names[slot] == name ? table->slot_symbols[slot] : -1;
+
+    // check if symbol is already in the current scope (duplicate variable)
+    if (previous >= table->scope_starts[table->scope_depth - 1]) {
+        return NULL;
     }
 
     if (table->count >= table->capacity) {
         table->capacity *= 2;
-        table->symbols = (Symbol*)realloc(table->symbols, table->capacity * sizeof(Symbol));
+        table->symbols = (Symbol*) grow(table->symbols, table->capacity * sizeof(Symbol));
     }
-    Symbol* symbol = &table->symbols[table->count];
-    ++table->count;
-
-    strncpy(symbol->name, name, sizeof(symbol->name));
-    strncpy(symbol->label, label, sizeof(symbol->label));
+    int index = table->count++;
+    ++table->declared;
+    Symbol* symbol = &table->symbols[index];
+    symbol->name = name;
+    symbol->label = label;
     symbol->type = type;
-    strncpy(symbol->value, value, sizeof(symbol->value));
-}
+    symbol->value = value;
+    symbol->shadowed = previous;
+    symbol->reg = 0;
+    symbol->frame_offset = -1;
 
-Symbol* find_symbol(SymbolTable* table, const char* name) {
-    for (int i = 0; i < table->count; ++i) {
-        if (strcmp(table->symbols[i].name, name) == 0) {
-            return &table->symbols[i];
-        }
+    if (table->slot_names[slot] != name) {
+        table->slot_names[slot] = name;
+        ++table->slot_count;
     }
-    return NULL;
+    table->slot_symbols[slot] = index;
+    if (table->slot_count * 2 > table->slot_capacity) grow_slots(table);
+    return &table->symbols[index];
+}
+
+Symbol* find_symbol(SymbolTable* table, int name) {
+    int slot = find_slot(table, name);
+    if (table->slot_names[slot] != name || table->slot_symbols[slot] < 0) return NULL;
+    return &table->symbols[table->slot_symbols[slot]];
 }
 
 void free_symbol_table(SymbolTable* table) {
-    free(table->symbols);
+    counted_free(table->symbols);
+    counted_free(table->scope_starts);
+    counted_free(table->slot_names);
+    counted_free(table->slot_symbols);
     table->symbols = NULL;
+    table->scope_starts = table->slot_names = table->slot_symbols = NULL;
     table->count = table->capacity = 0;
+    table->scope_depth = table->scope_capacity = 0;
+    table->slot_count = table->slot_capacity = 0;
 }
@@ -4,22 +4,43 @@
 #include "lexer.h"
 
 typedef struct{
-    char name[50];
-    char label[50];
+    int name;      // string pool id of the variable name
+    int label;     // numeric label of the variable's storage (emitted as L<label>)
     TokenType type;
-    char value[50];
+    int value;     // initial value: the integer for INT_TYPE, string pool id of the literal for STRING_TYPE
+    int shadowed;  // index of the symbol this one hides in an outer scope, -1 if none
+    int reg;           // register the variable lives in, 0 when it is in memory
+    int frame_offset;  // offset of its stack slot from $fp, -1 when it has none
 } Symbol;
 
+// Scoped symbol table. Symbols live on a stack, innermost scope last; an open
+// addressing hash table maps each name id to its innermost visible symbol.
+// Name slots are never removed, popping a scope just points them back at the
+// shadowed symbol (or -1).
 typedef struct {
     Symbol* symbols;
     int count;
     int capacity;
+    int declared;       // symbols added over the table's lifetime
+
+    int* scope_starts;  // index in symbols where each open scope begins
+    int scope_depth;
+    int scope_capacity;
+
+    int* slot_names;    // name id per slot, -1 when empty
+    int* slot_symbols;  // innermost symbol for that name, -1 when not in scope
+    int slot_count;
+    int slot_capacity;  // always a power of two
 } SymbolTable;
 
 
 void init_symbol_table(SymbolTable* table);
-void add_symbol(SymbolTable* table, const char* name, const char* label, TokenType type, const char* value);
-Symbol* find_symbol(SymbolTable* table, const char* name);
+void push_scope(SymbolTable* table);
+void pop_scope(SymbolTable* table);
+// NULL if name is already declared in the current scope; the returned pointer
+// is only valid until the next add_symbol
+Symbol* add_symbol(SymbolTable* table, int name, int label, TokenType type, int value);
+Symbol* find_symbol(SymbolTable* table, int name);
 void free_symbol_table(SymbolTable* table);
 
 #endif
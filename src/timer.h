@@ -0,0 +1,7 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// seconds on the monotonic clock, for timing the difference of two calls
+double now_seconds(void);
+
+#endif
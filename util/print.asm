@@ -0,0 +1,98 @@
+# ====== START PRINT ======
+# Buffered output: print_string appends the string at $a0, print_int appends
+# $a0 in decimal and print_flush writes out whatever is buffered. A full
+# buffer is written out on the spot, and so is whatever is buffered when an
+# exception ends the program. Only $a0, $a1, $v0, $t8, $t9, $ra and
+# (print_int) HI/LO are touched, everything else survives a print.
+.data
+print_buffer: .space 4096
+print_buffer_end: .space 1      # room for the NUL a flush needs
+print_digits: .space 12         # sign and up to 10 digits, written backwards, then a NUL
+print_negative: .space 1
+.align 2
+print_used: .word 0             # bytes in print_buffer
+.text
+
+print_string:
+lw $t8, print_used
+la $t9, print_buffer
+addu $t9, $t9, $t8              # next free byte
+la $t8, print_buffer_end
+print_string_loop:
+lbu $v0, 0($a0)
+beq $v0, $zero, print_string_done
+sb $v0, 0($t9)
+addiu $a0, $a0, 1
+addiu $t9, $t9, 1
+bne $t9, $t8, print_string_loop
+# full: write it out and start over
+move $a1, $a0
+sb $zero, 0($t9)
+la $a0, print_buffer
+li $v0, 4
+syscall
+move $a0, $a1
+la $t9, print_buffer
+j print_string_loop
+print_string_done:
+la $t8, print_buffer
+subu $t9, $t9, $t8
+sw $t9, print_used
+jr $ra
+
+print_int:
+la $t9, print_digits+11
+bgez $a0, print_int_positive
+subu $a0, $zero, $a0            # right for -2^31 too, taken as unsigned
+li $t8, 45                      # '-'
+sb $t8, print_negative
+print_int_positive:
+li $a1, -858993459              # 0xcccccccd: n / 10 is the high word of n * it, shifted right 3
+print_int_loop:
+multu $a0, $a1
+mfhi $v0
+srl $v0, $v0, 3                 # n / 10
+sll $t8, $v0, 2
+addu $t8, $t8, $v0
+sll $t8, $t8, 1
+subu $t8, $a0, $t8              # n % 10
+addiu $t8, $t8, 48
+addiu $t9, $t9, -1
+sb $t8, 0($t9)
+move $a0, $v0
+bne $a0, $zero, print_int_loop
+lbu $t8, print_negative
+beq $t8, $zero, print_int_append
+sb $zero, print_negative
+addiu $t9, $t9, -1
+sb $t8, 0($t9)
+print_int_append:
+move $a0, $t9
+j print_string
+
+print_flush:
+lw $t8, print_used
+beq $t8, $zero, print_flush_done
+la $a0, print_buffer
+addu $t9, $a0, $t8
+sb $zero, 0($t9)
+li $v0, 4
+syscall
+sw $zero, print_used
+print_flush_done:
+jr $ra
+
+# An exception, an add, sub or addi overflowing, ends the program; what was
+# printed before it is written out first, then it exits with status 1.
+.ktext 0x80000180
+lw $k0, print_used
+la $a0, print_buffer
+addu $k0, $a0, $k0
+sb $zero, 0($k0)
+li $v0, 4
+syscall
+li $a0, 1
+li $v0, 17
+syscall
+.text
+# ====== END PRINT ======
@@ -1,34 +1,48 @@
 # ====== START STRCMP ======
+# strcmp: $v0 = -1, 0 or 1 as the string at $a0 sorts before, equal to or
+# after the one at $a1, comparing bytes unsigned. When both are word aligned
+# a word is compared per iteration until the words differ or hold the
+# terminator, the bytes of that last word decide. Only $t0..$t7, $v0 and $ra
+# are touched.
 strcmp:
-move $t0, $zero
 move $t1, $a0
 move $t2, $a1
+or $t0, $t1, $t2
+andi $t0, $t0, 3
+bne $t0, $zero, strcmp_loop        # not both aligned: a byte at a time
+li $t5, 0x01010101
+sll $t6, $t5, 7                    # 0x80808080
+strcmp_word:
+lw $t3, 0($t1)
+lw $t4, 0($t2)
+bne $t3, $t4, strcmp_loop          # the bytes of this word decide
+# (w - 0x01010101) & ~w & 0x80808080 is not zero when w has a zero byte
+subu $t0, $t3, $t5
+nor $t7, $t3, $zero
+and $t0, $t0, $t7
+and $t0, $t0, $t6
+bne $t0, $zero, strcmp_equal       # equal up to the terminator
+addiu $t1, $t1, 4
+addiu $t2, $t2, 4
+j strcmp_word
+
 strcmp_loop:
-# read current byte
-lb $t3, 0($t1)
-lb $t4, 0($t2)
-beq $t3, $zero, strcmp_checklower  # s1 is finished
-beq $t4, $zero, strcmp_higher      #str2 is finished
-blt $t3, $t4, strcmp_lower         #if str1 < str2 -> str1 is strcmp_lower
-bgt $t3, $t4, strcmp_higher        #if str1 > str2 -> str1 is strcmp_higher
-# move to next bytes
-addi $t1, $t1,1
-addi $t2, $t2,1
+lbu $t3, 0($t1)
+lbu $t4, 0($t2)
+bne $t3, $t4, strcmp_differ
+beq $t3, $zero, strcmp_equal       # both finished
+addiu $t1, $t1, 1
+addiu $t2, $t2, 1
 j strcmp_loop
 
-strcmp_checklower: # if str2 is not finished str1 < str2
-beq $t4, $zero, strcmp_equal
-j strcmp_lower
+strcmp_differ:                     # a finished string is the lower one, its 0 is the smaller byte
+sltu $t0, $t3, $t4
+sll $t0, $t0, 1
+li $v0, 1
+subu $v0, $v0, $t0
+jr $ra
 
 strcmp_equal:
 li $v0, 0
 jr $ra
-
-strcmp_lower:
-li $v0, -1
-jr $ra
-
-strcmp_higher:
-li $v0, 1
-jr $ra
 # ====== END STRCMP ======